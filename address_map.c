@@ -0,0 +1,64 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <stdlib.h>
+#include "address_map.h"
+
+struct address_map_data {
+    size_t size;
+    uint8_t *bits;
+};
+
+address_map address_map_create(size_t memory_size) {
+    address_map map;
+
+    map = malloc(sizeof(struct address_map_data));
+    if (map) {
+        map->size = memory_size;
+        map->bits = calloc(memory_size / 8 + 1, 1);
+        if (map->bits == NULL) {
+            free(map);
+            map = NULL;
+        }
+    }
+    return map;
+}
+
+void address_map_destroy(address_map map) {
+    free(map->bits);
+    free(map);
+}
+
+int address_map_set(address_map map, uint32_t address, int value) {
+    if (address >= map->size)
+        return -1;
+    if (value)
+        map->bits[address / 8] |= 1 << (address % 8);
+    else
+        map->bits[address / 8] &= ~(1 << (address % 8));
+    return 0;
+}
+
+int address_map_test(address_map map, uint32_t address) {
+    return (address < map->size) &&
+           ((map->bits[address / 8] >> (address % 8)) & 1);
+}
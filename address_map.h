@@ -0,0 +1,39 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#ifndef __ADDRESS_MAP_H__
+#define __ADDRESS_MAP_H__
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Set of addresses of the simulated memory, one bit per address, used to
+ * know with a single test whether an instruction holds a breakpoint or a
+ * tracepoint.
+ */
+typedef struct address_map_data *address_map;
+
+address_map address_map_create(size_t memory_size);
+void address_map_destroy(address_map map);
+/* Returns -1 if address is outside of the memory */
+int address_map_set(address_map map, uint32_t address, int value);
+int address_map_test(address_map map, uint32_t address);
+#endif
@@ -0,0 +1,523 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "agent_expr.h"
+#include "codec.h"
+#include "debug.h"
+
+#define STACK_SIZE 100
+/* Operations executed by an evaluation at most, a backward goto would
+ * otherwise loop forever (gdbserver bounds its evaluations the same way)
+ */
+#define MAX_OPERATIONS 100000
+/* Longest string printed by printf for a %s conversion */
+#define MAX_STRING_SIZE 1024
+
+/* Register numbers used by gdb for the arm target */
+#define GDB_PC   15
+#define GDB_CPSR 25
+
+/* Bytecodes, as defined in gdb's documentation (Agent Expressions) */
+enum {
+    OP_ADD = 0x02, OP_SUB = 0x03, OP_MUL = 0x04, OP_DIV_SIGNED = 0x05,
+    OP_DIV_UNSIGNED = 0x06, OP_REM_SIGNED = 0x07, OP_REM_UNSIGNED = 0x08,
+    OP_LSH = 0x09, OP_RSH_SIGNED = 0x0a, OP_RSH_UNSIGNED = 0x0b,
+    OP_TRACE = 0x0c, OP_TRACE_QUICK = 0x0d, OP_LOG_NOT = 0x0e,
+    OP_BIT_AND = 0x0f, OP_BIT_OR = 0x10, OP_BIT_XOR = 0x11,
+    OP_BIT_NOT = 0x12, OP_EQUAL = 0x13, OP_LESS_SIGNED = 0x14,
+    OP_LESS_UNSIGNED = 0x15, OP_EXT = 0x16, OP_REF8 = 0x17, OP_REF16 = 0x18,
+    OP_REF32 = 0x19, OP_REF64 = 0x1a, OP_IF_GOTO = 0x20, OP_GOTO = 0x21,
+    OP_CONST8 = 0x22, OP_CONST16 = 0x23, OP_CONST32 = 0x24,
+    OP_CONST64 = 0x25, OP_REG = 0x26, OP_END = 0x27, OP_DUP = 0x28,
+    OP_POP = 0x29, OP_ZERO_EXT = 0x2a, OP_SWAP = 0x2b, OP_GETV = 0x2c,
+    OP_SETV = 0x2d, OP_TRACEV = 0x2e, OP_TRACENZ = 0x2f, OP_TRACE16 = 0x30,
+    OP_PICK = 0x32, OP_ROT = 0x33, OP_PRINTF = 0x34
+};
+
+/* Decoded operation: the immediate operand (constant, register, number of
+ * bits, stack position, variable, number of printf arguments) is extracted
+ * and jump targets are converted from byte offsets to operation indexes */
+struct agent_op {
+    uint8_t opcode;
+    uint64_t operand;
+    /* printf only, points into the bytecode */
+    const char *format;
+};
+
+struct agent_expr_data {
+    int count;
+    struct agent_op *ops;
+    uint8_t *bytes;
+};
+
+/* For each supported opcode: size of the immediate operand, number of values
+ * taken from the stack and number of values pushed. Opcodes without entry
+ * (floating point) are not supported. printf has a variable size and takes
+ * a variable number of values, it is handled separately. */
+static const struct {
+    int8_t supported, operand, pops, pushes;
+} bytecode[256] = {
+    [OP_ADD] = { 1, 0, 2, 1 }, [OP_SUB] = { 1, 0, 2, 1 },
+    [OP_MUL] = { 1, 0, 2, 1 }, [OP_DIV_SIGNED] = { 1, 0, 2, 1 },
+    [OP_DIV_UNSIGNED] = { 1, 0, 2, 1 }, [OP_REM_SIGNED] = { 1, 0, 2, 1 },
+    [OP_REM_UNSIGNED] = { 1, 0, 2, 1 }, [OP_LSH] = { 1, 0, 2, 1 },
+    [OP_RSH_SIGNED] = { 1, 0, 2, 1 }, [OP_RSH_UNSIGNED] = { 1, 0, 2, 1 },
+    [OP_TRACE] = { 1, 0, 2, 0 }, [OP_TRACE_QUICK] = { 1, 1, 1, 1 },
+    [OP_LOG_NOT] = { 1, 0, 1, 1 }, [OP_BIT_AND] = { 1, 0, 2, 1 },
+    [OP_BIT_OR] = { 1, 0, 2, 1 }, [OP_BIT_XOR] = { 1, 0, 2, 1 },
+    [OP_BIT_NOT] = { 1, 0, 1, 1 }, [OP_EQUAL] = { 1, 0, 2, 1 },
+    [OP_LESS_SIGNED] = { 1, 0, 2, 1 }, [OP_LESS_UNSIGNED] = { 1, 0, 2, 1 },
+    [OP_EXT] = { 1, 1, 1, 1 }, [OP_REF8] = { 1, 0, 1, 1 },
+    [OP_REF16] = { 1, 0, 1, 1 }, [OP_REF32] = { 1, 0, 1, 1 },
+    [OP_REF64] = { 1, 0, 1, 1 }, [OP_IF_GOTO] = { 1, 2, 1, 0 },
+    [OP_GOTO] = { 1, 2, 0, 0 }, [OP_CONST8] = { 1, 1, 0, 1 },
+    [OP_CONST16] = { 1, 2, 0, 1 }, [OP_CONST32] = { 1, 4, 0, 1 },
+    [OP_CONST64] = { 1, 8, 0, 1 }, [OP_REG] = { 1, 2, 0, 1 },
+    [OP_END] = { 1, 0, 0, 0 }, [OP_DUP] = { 1, 0, 1, 2 },
+    [OP_POP] = { 1, 0, 1, 0 }, [OP_ZERO_EXT] = { 1, 1, 1, 1 },
+    [OP_SWAP] = { 1, 0, 2, 2 }, [OP_GETV] = { 1, 2, 0, 1 },
+    [OP_SETV] = { 1, 2, 1, 1 }, [OP_TRACEV] = { 1, 2, 0, 0 },
+    [OP_TRACENZ] = { 1, 0, 2, 0 }, [OP_TRACE16] = { 1, 2, 1, 1 },
+    [OP_PICK] = { 1, 1, 0, 1 }, [OP_ROT] = { 1, 0, 3, 3 },
+    [OP_PRINTF] = { 1, 1, 2, 0 }
+};
+
+/* Immediates are stored most significant byte first */
+static uint64_t read_immediate(const uint8_t *bytes, int size) {
+    uint64_t value = 0;
+
+    while (size--)
+        value = (value << 8) | *bytes++;
+    return value;
+}
+
+/* Size of the operation at bytes[0], 0 if it is unsupported or truncated */
+static size_t operation_size(const uint8_t *bytes, size_t length) {
+    size_t size;
+
+    if (!bytecode[bytes[0]].supported)
+        return 0;
+    size = 1 + bytecode[bytes[0]].operand;
+    if (bytes[0] == OP_PRINTF) {
+        /* Number of arguments, format length and NUL terminated format */
+        if (length < 4)
+            return 0;
+        size = 4 + read_immediate(bytes + 2, 2);
+        if ((size > length) || (size == 4) || (bytes[size-1] != '\0'))
+            return 0;
+    }
+    return (size <= length) ? size : 0;
+}
+
+static agent_expr compile(uint8_t *bytes, size_t length) {
+    agent_expr expr;
+    int *op_index;
+    size_t i, size;
+    int count;
+
+    expr = calloc(1, sizeof(struct agent_expr_data));
+    op_index = malloc(length * sizeof(int));
+    if (expr) {
+        expr->bytes = bytes;
+        expr->ops = malloc(length * sizeof(struct agent_op));
+    }
+    if (!expr || !op_index || !expr->ops)
+        goto error;
+
+    /* First pass: decoding */
+    count = 0;
+    for (i=0; i<length; i++)
+        op_index[i] = -1;
+    for (i=0; i<length; i += size) {
+        size = operation_size(bytes + i, length - i);
+        if (size == 0) {
+            debug("Unsupported or truncated bytecode %02x at %zu\n",
+                  bytes[i], i);
+            goto error;
+        }
+        op_index[i] = count;
+        expr->ops[count].opcode = bytes[i];
+        expr->ops[count].operand = read_immediate(bytes + i + 1,
+                                                  bytecode[bytes[i]].operand);
+        expr->ops[count].format = NULL;
+        if (bytes[i] == OP_PRINTF)
+            expr->ops[count].format = (char *) bytes + i + 4;
+        count++;
+    }
+    /* Second pass: jump targets */
+    for (i=0; i<count; i++) {
+        if ((expr->ops[i].opcode == OP_IF_GOTO) ||
+            (expr->ops[i].opcode == OP_GOTO)) {
+            if ((expr->ops[i].operand >= length) ||
+                (op_index[expr->ops[i].operand] < 0)) {
+                debug("Invalid jump target %llu\n",
+                      (unsigned long long) expr->ops[i].operand);
+                goto error;
+            }
+            expr->ops[i].operand = op_index[expr->ops[i].operand];
+        }
+    }
+    expr->count = count;
+    free(op_index);
+    return expr;
+
+error:
+    free(op_index);
+    if (expr)
+        agent_expr_destroy(expr);
+    else
+        free(bytes);
+    return NULL;
+}
+
+agent_expr agent_expr_create(const char *encoding, const char **end) {
+    agent_expr expr;
+    uint8_t *bytes;
+    char *position;
+    size_t length;
+
+    if (*encoding != 'X')
+        return NULL;
+    length = strtoul(encoding+1, &position, 16);
+    if ((*position != ',') || (length == 0) ||
+        (strlen(position+1) < 2*length))
+        return NULL;
+    bytes = malloc(length);
+    if (bytes == NULL)
+        return NULL;
+    if (codec_hex_decode(bytes, position+1, length) == -1) {
+        free(bytes);
+        return NULL;
+    }
+    /* The expression keeps the bytecode, printf formats point into it */
+    expr = compile(bytes, length);
+    if (expr && end)
+        *end = position + 1 + 2*length;
+    return expr;
+}
+
+void agent_expr_destroy(agent_expr expr) {
+    if (expr) {
+        free(expr->ops);
+        free(expr->bytes);
+    }
+    free(expr);
+}
+
+static int read_register(arm_core arm, uint64_t reg, uint64_t *value) {
+    if (reg < GDB_PC)
+        *value = arm_read_register(arm, reg);
+    else if (reg == GDB_PC)
+        /* gdb sees the address of the next instruction to execute */
+        *value = arm_read_register(arm, reg) - 4;
+    else if (reg == GDB_CPSR)
+        *value = arm_read_cpsr(arm);
+    else
+        return -1;
+    return 0;
+}
+
+/* Reads size bytes at address as a target integer */
+static int read_memory(memory mem, uint64_t address, int size,
+                       uint64_t *value) {
+    uint8_t bytes[8];
+    int i;
+
+    if ((address > UINT32_MAX) ||
+        (memory_read_block(mem, address, size, bytes) == -1))
+        return -1;
+    *value = 0;
+    for (i=0; i<size; i++) {
+    #ifdef BIG_ENDIAN_SIMULATOR
+        *value = (*value << 8) | bytes[i];
+    #else
+        *value = (*value << 8) | bytes[size-1-i];
+    #endif
+    }
+    return 0;
+}
+
+static int collect(agent_context context, uint64_t address, uint64_t size) {
+    if ((context->collect_memory == NULL) || (address > UINT32_MAX))
+        return -1;
+    return context->collect_memory(context->data, address, size);
+}
+
+/* Collects up to size bytes at address, stopping after the first 0 */
+static int collect_string(agent_context context, uint64_t address,
+                          uint64_t size) {
+    uint8_t byte;
+    uint64_t length;
+
+    for (length=0; length<size; length++) {
+        if ((address + length > UINT32_MAX) ||
+            (memory_read_byte(context->mem, address + length, &byte) == -1))
+            break;
+        if (byte == 0) {
+            length++;
+            break;
+        }
+    }
+    return collect(context, address, length);
+}
+
+/* printf conversions : the arguments are 64 bits integers, strings are read
+ * from the target memory. Floating point conversions are not supported by
+ * gdb's agent. */
+static void agent_printf(agent_context context, const char *format,
+                         uint64_t *args, int count) {
+    char specification[32], string[MAX_STRING_SIZE+1];
+    const char *start;
+    size_t length, i;
+    int argument = 0;
+    uint8_t byte;
+
+    while (*format) {
+        if ((*format != '%') || (format[1] == '%')) {
+            fputc(*format, context->output);
+            format += (*format == '%') ? 2 : 1;
+            continue;
+        }
+        /* Flags, width and precision are kept, length modifiers are
+         * replaced by ll */
+        start = format++;
+        format += strspn(format, "-+ #0123456789.");
+        length = format - start;
+        format += strspn(format, "hlLqjzt");
+        if ((*format == '\0') || (length > sizeof(specification) - 4) ||
+            (argument == count))
+            break;
+        memcpy(specification, start, length);
+        switch (*format) {
+          case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+            sprintf(specification + length, "ll%c", *format);
+            fprintf(context->output, specification,
+                    (long long) args[argument++]);
+            break;
+          case 'c':
+            sprintf(specification + length, "c");
+            fprintf(context->output, specification, (int) args[argument++]);
+            break;
+          case 'p':
+            fprintf(context->output, "0x%llx",
+                    (unsigned long long) args[argument++]);
+            break;
+          case 's':
+            for (i=0; i<MAX_STRING_SIZE; i++) {
+                if ((args[argument] + i > UINT32_MAX) ||
+                    (memory_read_byte(context->mem, args[argument] + i, &byte)
+                     == -1) || (byte == 0))
+                    break;
+                string[i] = byte;
+            }
+            string[i] = '\0';
+            argument++;
+            sprintf(specification + length, "s");
+            fprintf(context->output, specification, string);
+            break;
+          default:
+            fprintf(context->output, "<unsupported %%%c>", *format);
+            argument++;
+        }
+        format++;
+    }
+    fflush(context->output);
+}
+
+int agent_expr_eval(agent_expr expr, agent_context context,
+                    uint64_t *result) {
+    uint64_t stack[STACK_SIZE], a, b;
+    int64_t value;
+    struct agent_op *op;
+    int sp, pc, bits, pops, steps;
+
+    /* sp is the number of values on the stack */
+    sp = 0;
+    pc = 0;
+    steps = 0;
+    while (pc < expr->count) {
+        if (++steps > MAX_OPERATIONS)
+            return -1;
+        op = &expr->ops[pc++];
+        /* Enough values for op, and room for its results */
+        pops = bytecode[op->opcode].pops;
+        if (op->opcode == OP_PRINTF)
+            pops += op->operand;
+        if ((sp < pops) ||
+            (sp - pops + bytecode[op->opcode].pushes > STACK_SIZE))
+            return -1;
+        switch (op->opcode) {
+          case OP_END:
+            /* Commands such as printf may leave an empty stack */
+            if (result)
+                *result = sp ? stack[sp-1] : 0;
+            return 0;
+          case OP_CONST8: case OP_CONST16: case OP_CONST32: case OP_CONST64:
+            stack[sp++] = op->operand;
+            break;
+          case OP_REG:
+            if (read_register(context->arm, op->operand, &stack[sp++]) == -1)
+                return -1;
+            break;
+          case OP_DUP:
+            stack[sp] = stack[sp-1];
+            sp++;
+            break;
+          case OP_PICK:
+            if (op->operand >= sp)
+                return -1;
+            stack[sp] = stack[sp-1-op->operand];
+            sp++;
+            break;
+          case OP_POP:
+            sp--;
+            break;
+          case OP_SWAP:
+            a = stack[sp-1];
+            stack[sp-1] = stack[sp-2];
+            stack[sp-2] = a;
+            break;
+          case OP_ROT:
+            /* a b c => c a b */
+            a = stack[sp-1];
+            stack[sp-1] = stack[sp-2];
+            stack[sp-2] = stack[sp-3];
+            stack[sp-3] = a;
+            break;
+          case OP_GOTO:
+            pc = op->operand;
+            break;
+          case OP_IF_GOTO:
+            if (stack[--sp])
+                pc = op->operand;
+            break;
+          case OP_LOG_NOT:
+            stack[sp-1] = !stack[sp-1];
+            break;
+          case OP_BIT_NOT:
+            stack[sp-1] = ~stack[sp-1];
+            break;
+          case OP_EXT:
+          case OP_ZERO_EXT:
+            bits = op->operand;
+            if ((bits > 0) && (bits < 64)) {
+                a = stack[sp-1] & ((UINT64_C(1) << bits) - 1);
+                if ((op->opcode == OP_EXT) && (a >> (bits - 1)))
+                    a |= ~UINT64_C(0) << bits;
+                stack[sp-1] = a;
+            }
+            break;
+          case OP_REF8: case OP_REF16: case OP_REF32: case OP_REF64:
+            if (read_memory(context->mem, stack[sp-1],
+                            1 << (op->opcode - OP_REF8), &stack[sp-1]) == -1)
+                return -1;
+            break;
+          case OP_GETV:
+            if ((context->get_variable == NULL) ||
+                (context->get_variable(context->data, op->operand, &value)
+                 == -1))
+                return -1;
+            stack[sp++] = value;
+            break;
+          case OP_SETV:
+            if ((context->set_variable == NULL) ||
+                (context->set_variable(context->data, op->operand,
+                                       stack[sp-1]) == -1))
+                return -1;
+            break;
+          case OP_TRACE:
+            sp -= 2;
+            if (collect(context, stack[sp], stack[sp+1]) == -1)
+                return -1;
+            break;
+          case OP_TRACE_QUICK:
+          case OP_TRACE16:
+            if (collect(context, stack[sp-1], op->operand) == -1)
+                return -1;
+            break;
+          case OP_TRACENZ:
+            sp -= 2;
+            if (collect_string(context, stack[sp], stack[sp+1]) == -1)
+                return -1;
+            break;
+          case OP_TRACEV:
+            if ((context->collect_variable == NULL) ||
+                (context->collect_variable(context->data, op->operand) == -1))
+                return -1;
+            break;
+          case OP_PRINTF:
+            {
+                uint64_t args[STACK_SIZE];
+                int i;
+
+                /* Function and channel first, unused here, then the
+                 * arguments in order */
+                sp -= 2;
+                for (i=0; i<op->operand; i++)
+                    args[i] = stack[--sp];
+                agent_printf(context, op->format, args, op->operand);
+            }
+            break;
+          default:
+            /* Binary operations: a b => a op b */
+            b = stack[--sp];
+            a = stack[sp-1];
+            switch (op->opcode) {
+              case OP_ADD: a += b; break;
+              case OP_SUB: a -= b; break;
+              case OP_MUL: a *= b; break;
+              case OP_DIV_SIGNED:
+              case OP_REM_SIGNED:
+                if ((b == 0) || (((int64_t) a == INT64_MIN) &&
+                                 ((int64_t) b == -1)))
+                    return -1;
+                if (op->opcode == OP_DIV_SIGNED)
+                    a = (int64_t) a / (int64_t) b;
+                else
+                    a = (int64_t) a % (int64_t) b;
+                break;
+              case OP_DIV_UNSIGNED:
+              case OP_REM_UNSIGNED:
+                if (b == 0)
+                    return -1;
+                a = (op->opcode == OP_DIV_UNSIGNED) ? a / b : a % b;
+                break;
+              case OP_LSH: a = (b < 64) ? a << b : 0; break;
+              case OP_RSH_SIGNED:
+                a = (int64_t) a >> ((b < 64) ? b : 63);
+                break;
+              case OP_RSH_UNSIGNED: a = (b < 64) ? a >> b : 0; break;
+              case OP_BIT_AND: a &= b; break;
+              case OP_BIT_OR: a |= b; break;
+              case OP_BIT_XOR: a ^= b; break;
+              case OP_EQUAL: a = (a == b); break;
+              case OP_LESS_SIGNED: a = ((int64_t) a < (int64_t) b); break;
+              case OP_LESS_UNSIGNED: a = (a < b); break;
+            }
+            stack[sp-1] = a;
+        }
+    }
+    /* Running past the last operation without an end is invalid */
+    return -1;
+}
@@ -0,0 +1,70 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#ifndef __AGENT_EXPR_H__
+#define __AGENT_EXPR_H__
+#include <stdint.h>
+#include <sys/types.h>
+#include "arm_core.h"
+#include "memory.h"
+
+/* Interpreter for gdb agent expressions, the bytecode gdb sends along with
+ * breakpoints and tracepoints so that conditions, data collection and
+ * dynamic printf are handled by the target. The bytecode is checked and
+ * decoded once when the expression is created, the evaluation then works on
+ * the decoded operations.
+ */
+typedef struct agent_expr_data *agent_expr;
+
+/* What an expression is evaluated against. Besides the registers (numbered
+ * as gdb does) and memory of the target, the callbacks give access to the
+ * trace state variables (getv, setv) and record the data collected by the
+ * trace opcodes. Expressions using them fail when they are NULL.
+ */
+typedef struct agent_context {
+    arm_core arm;
+    memory mem;
+    int (*get_variable)(void *data, int number, int64_t *value);
+    int (*set_variable)(void *data, int number, int64_t value);
+    int (*collect_memory)(void *data, uint32_t address, size_t size);
+    int (*collect_variable)(void *data, int number);
+    void *data;
+    /* Destination of the printf opcode */
+    FILE *output;
+} *agent_context;
+
+/* Builds an expression from the "X len,bytes" encoding of gdb packets (len
+ * and bytes in hexadecimal). If end is not NULL, it is set to the first
+ * character after the encoding. Returns NULL if the encoding or the bytecode
+ * is invalid or uses unsupported operations (floating point).
+ */
+agent_expr agent_expr_create(const char *encoding, const char **end);
+void agent_expr_destroy(agent_expr expr);
+
+/* Evaluates expr in context. Returns 0 and sets result (if not NULL) to the
+ * value on top of the stack at the end, -1 if the evaluation failed (stack
+ * overflow, division by zero, invalid memory access, too many operations
+ * executed...).
+ */
+int agent_expr_eval(agent_expr expr, agent_context context,
+                    uint64_t *result);
+#endif
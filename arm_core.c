@@ -31,6 +31,7 @@ Contact: Guillaume.Huard@imag.fr
 
 struct arm_core_data {
     uint32_t cycle_count;
+    uint32_t pending_exceptions;
     registers reg;
     memory mem;
 };
@@ -42,12 +43,21 @@ arm_core arm_create(memory mem) {
     if (p) {
         p->mem = mem;
 	p->reg = registers_create();
-        arm_exception(p, RESET);
-        p->cycle_count = 0;
+        arm_reset(p);
     }
     return p;
 }
 
+/* Puts the core back in the state it has just after its creation, so that it
+ * can be reused to run another program.
+ */
+void arm_reset(arm_core p) {
+    registers_reset(p->reg);
+    p->cycle_count = 0;
+    p->pending_exceptions = 0;
+    arm_exception(p, RESET);
+}
+
 void arm_destroy(arm_core p) {
     registers_destroy(p->reg);
     free(p);
@@ -65,6 +75,47 @@ uint32_t arm_get_cycle_count(arm_core p) {
     return p->cycle_count;
 }
 
+uint32_t arm_get_fetch_address(arm_core p) {
+    return read_register(p->reg, 15) & 0xFFFFFFFD;
+}
+
+void arm_post_exception(arm_core p, unsigned char exception) {
+    if ((exception >= RESET) && (exception <= FAST_INTERRUPT))
+        __atomic_fetch_or(&p->pending_exceptions, 1 << exception,
+                          __ATOMIC_RELEASE);
+}
+
+/* Exceptions by decreasing priority (ARM manual A2-20) */
+static const unsigned char exception_priority[] = {
+    RESET, DATA_ABORT, FAST_INTERRUPT, INTERRUPT, PREFETCH_ABORT,
+    UNDEFINED_INSTRUCTION, SOFTWARE_INTERRUPT
+};
+
+/* Only the pending exception of highest priority which is not masked (by
+ * the I and F bits of the cpsr) is taken, the others stay pending until
+ * the next instruction boundaries */
+void arm_take_pending_exceptions(arm_core p) {
+    uint32_t pending, cpsr;
+    unsigned char exception;
+    int i;
+
+    pending = __atomic_load_n(&p->pending_exceptions, __ATOMIC_ACQUIRE);
+    if (pending == 0)
+        return;
+    cpsr = read_cpsr(p->reg);
+    for (i=0; i<sizeof(exception_priority); i++) {
+        exception = exception_priority[i];
+        if (!get_bit(pending, exception) ||
+            ((exception == INTERRUPT) && get_bit(cpsr, 7)) ||
+            ((exception == FAST_INTERRUPT) && get_bit(cpsr, 6)))
+            continue;
+        __atomic_fetch_and(&p->pending_exceptions, ~(1 << exception),
+                           __ATOMIC_ACQUIRE);
+        arm_exception(p, exception);
+        return;
+    }
+}
+
 /* In this implementation, the program counter is incremented during the fetch.
  * Thus, to meet the specification (see manual A2-9), we add 4 whenever the
  * value of the pc is read, so that instructions read their own address + 8 when
@@ -189,6 +240,10 @@ int arm_write_word(arm_core p, uint32_t address, uint32_t value) {
     return result;
 }
 
+void arm_get_state(arm_core p, uint32_t *state) {
+    registers_copy(p->reg, state);
+}
+
 void arm_print_state(arm_core p, FILE *out) {
     int mode, reg, count;
 
@@ -31,12 +31,25 @@ typedef struct arm_core_data *arm_core;
 
 void arm_init();
 arm_core arm_create(memory mem);
+void arm_reset(arm_core p);
 void arm_destroy(arm_core p);
 void arm_print_state(arm_core p, FILE *out);
+/* Copies all the physical registers (see registers.h) into state, without
+ * tracing these reads */
+void arm_get_state(arm_core p, uint32_t *state);
 
 int arm_current_mode_has_spsr(arm_core p);
 int arm_in_a_privileged_mode(arm_core p);
 uint32_t arm_get_cycle_count(arm_core p);
+/* Address of the next instruction to fetch, without tracing the read of
+ * the pc */
+uint32_t arm_get_fetch_address(arm_core p);
+
+/* Exceptions coming from outside the core (irqs) can be posted from any
+ * thread, they are taken at the next instruction boundary.
+ */
+void arm_post_exception(arm_core p, unsigned char exception);
+void arm_take_pending_exceptions(arm_core p);
 
 uint32_t arm_read_register(arm_core p, uint8_t reg);
 uint32_t arm_read_usr_register(arm_core p, uint8_t reg);
@@ -0,0 +1,360 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "arm_disassembler.h"
+#include "arm_constants.h"
+#include "util.h"
+
+#define CACHE_SIZE 4096
+
+static const char *conditions[] = { "eq", "ne", "cs", "cc", "mi", "pl", "vs",
+                                    "vc", "hi", "ls", "ge", "lt", "gt", "le",
+                                    "", "" };
+static const char *operations[] = { "and", "eor", "sub", "rsb", "add", "adc",
+                                    "sbc", "rsc", "tst", "teq", "cmp", "cmn",
+                                    "orr", "mov", "bic", "mvn" };
+static const char *shifts[] = { "lsl", "lsr", "asr", "ror" };
+static const char *registers[] = { "r0", "r1", "r2", "r3", "r4", "r5", "r6",
+                                   "r7", "r8", "r9", "r10", "r11", "r12",
+                                   "sp", "lr", "pc" };
+
+#define REG(ins, l) registers[get_bits(ins, (l)+3, l)]
+
+struct arm_disassembly_cache_data {
+    struct {
+        uint32_t address, ins;
+        int valid;
+        char text[ARM_DISASSEMBLY_SIZE];
+    } entries[CACHE_SIZE];
+};
+
+/* Appends formatted text at the end of text, which has size bytes */
+static void append(char *text, size_t size, const char *format, ...) {
+    size_t length = strlen(text);
+    va_list ap;
+
+    if (length + 1 >= size)
+        return;
+    va_start(ap, format);
+    vsnprintf(text + length, size - length, format, ap);
+    va_end(ap);
+}
+
+static void immediate(char *text, size_t size, uint32_t value) {
+    if (value < 10)
+        append(text, size, "#%u", value);
+    else
+        append(text, size, "#0x%x", value);
+}
+
+/* Register operand of data processing and load/store, with its shift */
+static void shifted_register(char *text, size_t size, uint32_t ins) {
+    uint8_t shift = get_bits(ins, 6, 5), amount = get_bits(ins, 11, 7);
+
+    append(text, size, "%s", REG(ins, 0));
+    if (get_bit(ins, 4)) {
+        append(text, size, ", %s %s", shifts[shift], REG(ins, 8));
+    } else if ((shift == ROR) && (amount == 0)) {
+        append(text, size, ", rrx");
+    } else if ((shift != 0) || (amount != 0)) {
+        append(text, size, ", %s #%u", shifts[shift],
+               ((amount == 0) ? 32 : amount));
+    }
+}
+
+static void data_processing(char *text, size_t size, uint32_t ins) {
+    uint8_t opcode = get_bits(ins, 24, 21);
+    uint32_t value;
+    int rotation;
+
+    append(text, size, "%s%s%s ", operations[opcode],
+           (get_bit(ins, 20) && ((opcode < 8) || (opcode > 11))) ? "s" : "",
+           conditions[get_bits(ins, 31, 28)]);
+    if ((opcode == 13) || (opcode == 15))
+        append(text, size, "%s, ", REG(ins, 12));
+    else if ((opcode >= 8) && (opcode <= 11))
+        append(text, size, "%s, ", REG(ins, 16));
+    else
+        append(text, size, "%s, %s, ", REG(ins, 12), REG(ins, 16));
+    if (get_bit(ins, 25)) {
+        rotation = 2 * get_bits(ins, 11, 8);
+        value = get_bits(ins, 7, 0);
+        if (rotation)
+            value = (value >> rotation) | (value << (32 - rotation));
+        immediate(text, size, value);
+    } else {
+        shifted_register(text, size, ins);
+    }
+}
+
+/* Addressing modes of load/store: offset is already formatted, "" if
+ * it is null */
+static void address(char *text, size_t size, uint32_t ins,
+                    const char *offset) {
+    if (!get_bit(ins, 24))
+        append(text, size, "[%s]%s%s", REG(ins, 16), *offset ? ", " : "",
+               offset);
+    else if (*offset)
+        append(text, size, "[%s, %s]%s", REG(ins, 16), offset,
+               get_bit(ins, 21) ? "!" : "");
+    else
+        append(text, size, "[%s]%s", REG(ins, 16),
+               get_bit(ins, 21) ? "!" : "");
+}
+
+static void load_store(char *text, size_t size, uint32_t ins) {
+    char offset[ARM_DISASSEMBLY_SIZE] = "";
+    const char *sign = get_bit(ins, 23) ? "" : "-";
+
+    append(text, size, "%s%s%s%s %s, ", get_bit(ins, 20) ? "ldr" : "str",
+           get_bit(ins, 22) ? "b" : "",
+           (!get_bit(ins, 24) && get_bit(ins, 21)) ? "t" : "",
+           conditions[get_bits(ins, 31, 28)], REG(ins, 12));
+    if (get_bit(ins, 25)) {
+        append(offset, sizeof(offset), "%s", sign);
+        shifted_register(offset, sizeof(offset), ins);
+    } else if (get_bits(ins, 11, 0)) {
+        append(offset, sizeof(offset), "#%s%u", sign, get_bits(ins, 11, 0));
+    }
+    address(text, size, ins, offset);
+}
+
+static void load_store_half(char *text, size_t size, uint32_t ins) {
+    static const char *loads[] = { "", "h", "sb", "sh" };
+    static const char *stores[] = { "", "h", "d", "d" };
+    char offset[ARM_DISASSEMBLY_SIZE] = "";
+    const char *sign = get_bit(ins, 23) ? "" : "-";
+    uint8_t kind = get_bits(ins, 6, 5);
+    const char *name;
+
+    if (get_bit(ins, 20))
+        name = "ldr";
+    else
+        name = (kind == 2) ? "ldr" : "str";
+    append(text, size, "%s%s%s %s, ", name,
+           get_bit(ins, 20) ? loads[kind] : stores[kind],
+           conditions[get_bits(ins, 31, 28)], REG(ins, 12));
+    if (get_bit(ins, 22)) {
+        if (get_bits(ins, 11, 8) || get_bits(ins, 3, 0))
+            append(offset, sizeof(offset), "#%s%u", sign,
+                   (get_bits(ins, 11, 8) << 4) | get_bits(ins, 3, 0));
+    } else {
+        append(offset, sizeof(offset), "%s%s", sign, REG(ins, 0));
+    }
+    address(text, size, ins, offset);
+}
+
+static void register_list(char *text, size_t size, uint16_t list) {
+    int i, j, first = 1;
+
+    append(text, size, "{");
+    for (i=0; i<16; i++) {
+        if (!get_bit(list, i))
+            continue;
+        for (j=i; (j < 15) && get_bit(list, j+1); j++)
+            ;
+        append(text, size, "%s%s", first ? "" : ", ", registers[i]);
+        if (j > i + 1)
+            append(text, size, "-%s", registers[j]);
+        else if (j == i + 1)
+            append(text, size, ", %s", registers[j]);
+        first = 0;
+        i = j;
+    }
+    append(text, size, "}");
+}
+
+static void load_store_multiple(char *text, size_t size, uint32_t ins) {
+    static const char *modes[] = { "da", "ia", "db", "ib" };
+
+    append(text, size, "%s%s%s %s%s, ", get_bit(ins, 20) ? "ldm" : "stm",
+           modes[get_bits(ins, 24, 23)], conditions[get_bits(ins, 31, 28)],
+           REG(ins, 16), get_bit(ins, 21) ? "!" : "");
+    register_list(text, size, get_bits(ins, 15, 0));
+    if (get_bit(ins, 22))
+        append(text, size, "^");
+}
+
+static void miscellaneous(char *text, size_t size, uint32_t ins) {
+    const char *cond = conditions[get_bits(ins, 31, 28)];
+    const char *psr = get_bit(ins, 22) ? "spsr" : "cpsr";
+
+    if ((ins & 0x0FFFFFD0) == 0x012FFF10) {
+        append(text, size, "%s%s %s", get_bit(ins, 5) ? "blx" : "bx", cond,
+               REG(ins, 0));
+    } else if ((ins & 0x0FFF0FF0) == 0x016F0F10) {
+        append(text, size, "clz%s %s, %s", cond, REG(ins, 12), REG(ins, 0));
+    } else if ((ins & 0x0FF000F0) == 0x01200070) {
+        append(text, size, "bkpt 0x%04x",
+               (get_bits(ins, 19, 8) << 4) | get_bits(ins, 3, 0));
+    } else if ((ins & 0x0FBF0FFF) == 0x010F0000) {
+        append(text, size, "mrs%s %s, %s", cond, REG(ins, 12), psr);
+    } else if ((ins & 0x0DB0F000) == 0x0120F000) {
+        append(text, size, "msr%s %s_%s%s%s%s, ", cond, psr,
+               get_bit(ins, 19) ? "f" : "", get_bit(ins, 18) ? "s" : "",
+               get_bit(ins, 17) ? "x" : "", get_bit(ins, 16) ? "c" : "");
+        if (get_bit(ins, 25)) {
+            int rotation = 2 * get_bits(ins, 11, 8);
+            uint32_t value = get_bits(ins, 7, 0);
+
+            if (rotation)
+                value = (value >> rotation) | (value << (32 - rotation));
+            immediate(text, size, value);
+        } else {
+            append(text, size, "%s", REG(ins, 0));
+        }
+    } else {
+        append(text, size, ".word 0x%08x", ins);
+    }
+}
+
+static void multiply(char *text, size_t size, uint32_t ins) {
+    const char *cond = conditions[get_bits(ins, 31, 28)];
+    const char *s = get_bit(ins, 20) ? "s" : "";
+
+    if (get_bit(ins, 23))
+        append(text, size, "%s%s%s%s %s, %s, %s, %s",
+               get_bit(ins, 22) ? "s" : "u",
+               get_bit(ins, 21) ? "mlal" : "mull", s, cond, REG(ins, 12),
+               REG(ins, 16), REG(ins, 0), REG(ins, 8));
+    else if (get_bit(ins, 21))
+        append(text, size, "mla%s%s %s, %s, %s, %s", s, cond, REG(ins, 16),
+               REG(ins, 0), REG(ins, 8), REG(ins, 12));
+    else
+        append(text, size, "mul%s%s %s, %s, %s", s, cond, REG(ins, 16),
+               REG(ins, 0), REG(ins, 8));
+}
+
+static void coprocessor(char *text, size_t size, uint32_t ins) {
+    const char *cond = conditions[get_bits(ins, 31, 28)];
+    char offset[ARM_DISASSEMBLY_SIZE] = "";
+
+    if (get_bits(ins, 27, 25) == 6) {
+        append(text, size, "%s%s%s p%u, cr%u, ", get_bit(ins, 20) ? "ldc" :
+               "stc", get_bit(ins, 22) ? "l" : "", cond, get_bits(ins, 11, 8),
+               get_bits(ins, 15, 12));
+        if (get_bits(ins, 7, 0))
+            append(offset, sizeof(offset), "#%s%u",
+                   get_bit(ins, 23) ? "" : "-", 4 * get_bits(ins, 7, 0));
+        address(text, size, ins, offset);
+    } else if (get_bit(ins, 24)) {
+        append(text, size, "swi%s 0x%06x", cond, get_bits(ins, 23, 0));
+    } else if (get_bit(ins, 4)) {
+        append(text, size, "%s%s p%u, %u, %s, cr%u, cr%u, %u",
+               get_bit(ins, 20) ? "mrc" : "mcr", cond, get_bits(ins, 11, 8),
+               get_bits(ins, 23, 21), REG(ins, 12), get_bits(ins, 19, 16),
+               get_bits(ins, 3, 0), get_bits(ins, 7, 5));
+    } else {
+        append(text, size, "cdp%s p%u, %u, cr%u, cr%u, cr%u, %u", cond,
+               get_bits(ins, 11, 8), get_bits(ins, 23, 20),
+               get_bits(ins, 15, 12), get_bits(ins, 19, 16),
+               get_bits(ins, 3, 0), get_bits(ins, 7, 5));
+    }
+}
+
+void arm_disassemble(uint32_t address, uint32_t ins, char *text,
+                     size_t size) {
+    uint32_t offset = (get_bits(ins, 23, 0) << 8);
+
+    /* Branch offset: signed 24 bits words, from the instruction + 8 */
+    offset = (uint32_t) ((int32_t) offset >> 6);
+    *text = '\0';
+    if (get_bits(ins, 31, 28) == 0xF) {
+        if (get_bits(ins, 27, 25) == 5)
+            append(text, size, "blx 0x%x",
+                   address + 8 + offset + (get_bit(ins, 24) << 1));
+        else
+            append(text, size, ".word 0x%08x", ins);
+        return;
+    }
+    switch (get_bits(ins, 27, 25)) {
+      case 0:
+        if ((ins & 0x0F0000F0) == 0x00000090)
+            multiply(text, size, ins);
+        else if ((ins & 0x0FB00FF0) == 0x01000090)
+            append(text, size, "swp%s%s %s, %s, [%s]",
+                   get_bit(ins, 22) ? "b" : "", conditions[get_bits(ins, 31,
+                   28)], REG(ins, 12), REG(ins, 0), REG(ins, 16));
+        else if ((ins & 0x90) == 0x90)
+            load_store_half(text, size, ins);
+        else if ((get_bits(ins, 24, 23) == 2) && !get_bit(ins, 20))
+            miscellaneous(text, size, ins);
+        else
+            data_processing(text, size, ins);
+        break;
+      case 1:
+        if ((get_bits(ins, 24, 23) == 2) && !get_bit(ins, 20)) {
+            if (get_bit(ins, 21))
+                miscellaneous(text, size, ins);
+            else
+                append(text, size, ".word 0x%08x", ins);
+        } else {
+            data_processing(text, size, ins);
+        }
+        break;
+      case 3:
+        if (get_bit(ins, 4)) {
+            append(text, size, ".word 0x%08x", ins);
+            break;
+        }
+        /* Falls through */
+      case 2:
+        load_store(text, size, ins);
+        break;
+      case 4:
+        load_store_multiple(text, size, ins);
+        break;
+      case 5:
+        append(text, size, "b%s%s 0x%x", get_bit(ins, 24) ? "l" : "",
+               conditions[get_bits(ins, 31, 28)], address + 8 + offset);
+        break;
+      default:
+        coprocessor(text, size, ins);
+    }
+}
+
+arm_disassembly_cache arm_disassembly_cache_create() {
+    return calloc(1, sizeof(struct arm_disassembly_cache_data));
+}
+
+void arm_disassembly_cache_destroy(arm_disassembly_cache cache) {
+    free(cache);
+}
+
+const char *arm_disassemble_cached(arm_disassembly_cache cache,
+                                   uint32_t address, uint32_t ins) {
+    int i = (address >> 2) % CACHE_SIZE;
+
+    if (!cache->entries[i].valid || (cache->entries[i].address != address) ||
+        (cache->entries[i].ins != ins)) {
+        arm_disassemble(address, ins, cache->entries[i].text,
+                        ARM_DISASSEMBLY_SIZE);
+        cache->entries[i].address = address;
+        cache->entries[i].ins = ins;
+        cache->entries[i].valid = 1;
+    }
+    return cache->entries[i].text;
+}
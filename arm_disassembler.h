@@ -0,0 +1,42 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#ifndef __ARM_DISASSEMBLER_H__
+#define __ARM_DISASSEMBLER_H__
+#include <stdint.h>
+#include <stddef.h>
+
+/* Text of an ARMv5TE instruction (unified syntax), found at address (for
+ * the targets of branches). Unknown encodings are shown as .word. */
+#define ARM_DISASSEMBLY_SIZE 64
+void arm_disassemble(uint32_t address, uint32_t ins, char *text, size_t size);
+
+/* Disassembly of the instructions seen last at each address (modulo the
+ * size of the cache), a loop is disassembled only once. */
+typedef struct arm_disassembly_cache_data *arm_disassembly_cache;
+
+arm_disassembly_cache arm_disassembly_cache_create();
+void arm_disassembly_cache_destroy(arm_disassembly_cache cache);
+const char *arm_disassemble_cached(arm_disassembly_cache cache,
+                                   uint32_t address, uint32_t ins);
+
+#endif
@@ -24,6 +24,7 @@ Contact: Guillaume.Huard@imag.fr
 #include "arm_constants.h"
 #include "arm_core.h"
 #include "util.h"
+#include "trace.h"
 
 // Not supported below ARMv6, should read as 0
 #define CP15_reg1_EEbit 0
@@ -31,6 +32,7 @@ Contact: Guillaume.Huard@imag.fr
 #define Exception_bit_9 (CP15_reg1_EEbit << 9)
 
 void arm_exception(arm_core p, unsigned char exception) {
+    trace_exception(exception);
     /* We only support RESET initially */
     /* Semantics of reset interrupt (ARM manual A2-18) */
     uint32_t cpsr_value = arm_read_cpsr(p);
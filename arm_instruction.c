@@ -27,6 +27,7 @@ Contact: Guillaume.Huard@imag.fr
 #include "arm_branch_other.h"
 #include "arm_constants.h"
 #include "util.h"
+#include "trace.h"
 
 int condition(arm_core p, uint32_t ins) {
     uint8_t cond = get_bits(ins,31,28);
@@ -127,8 +128,13 @@ static int arm_execute_instruction(arm_core p) {
 
 int arm_step(arm_core p) {
     int result;
+    arm_take_pending_exceptions(p);
+    /* Triggers fire before the fetch, which is the next cycle */
+    trace_begin_instruction(arm_get_cycle_count(p) + 1,
+                            arm_get_fetch_address(p));
     result = arm_execute_instruction(p);
     if (result)
         arm_exception(p, result);
+    trace_end_instruction();
     return result;
 }
\ No newline at end of file
@@ -21,6 +21,7 @@ Contact: Guillaume.Huard@imag.fr
 	 38401 Saint Martin d'Hres
 */
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <pthread.h>
 #include <getopt.h>
 #include "csapp.h"
@@ -28,14 +29,32 @@ Contact: Guillaume.Huard@imag.fr
 #include "arm.h"
 #include "memory.h"
 #include "gdb_protocol.h"
+#include "event_loop.h"
+#include "connection.h"
 #include "trace.h"
+#include "trace_select.h"
 #include "debug.h"
 
+#define IRQ_BUFFER_SIZE 64
+/* Records buffered between the simulation and an asynchronous trace writer */
+#define TRACE_BUFFER_SIZE (1 << 16)
+
+/* gdb connections waiting to be served by the execution thread */
+struct session {
+    connection conn;
+    struct session *next;
+};
+
 struct shared_data {
     memory mem;
     arm_core arm;
+    event_loop loop;
     pthread_mutex_t lock;
+    pthread_cond_t new_session;
+    struct session *first, *last;
     in_port_t gdb_port, irq_port;
+    int persistent;
+    int keep_memory;
 };
 
 struct server_data {
@@ -62,50 +81,155 @@ static struct server_data create_server(in_port_t port) {
     result.port = ntohs(addr.sin_port);
 
     Listen(result.socket, 1);
+    /* Accepts are driven by the event loop, they should never block */
+    fcntl(result.socket, F_SETFL, fcntl(result.socket, F_GETFL) | O_NONBLOCK);
     return result;
 }
 
-static void *gdb_listener(void *arg) {
+/* Same as create_server, on a unix domain socket bound to path (replaced if
+ * it already exists) : no port is needed when gdb runs on the same host */
+static struct server_data create_unix_server(const char *path) {
+    struct sockaddr_un addr;
+    struct server_data result;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        exit(1);
+    }
+    result.socket = Socket(PF_UNIX, SOCK_STREAM, 0);
+    bzero(&addr, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    Bind(result.socket, (struct sockaddr *) &addr, sizeof(addr));
+    result.port = 0;
+
+    Listen(result.socket, 1);
+    fcntl(result.socket, F_SETFL, fcntl(result.socket, F_GETFL) | O_NONBLOCK);
+    return result;
+}
+
+static void add_session(struct shared_data *shared, connection conn) {
+    struct session *session;
+
+    session = malloc(sizeof(struct session));
+    if (session == NULL) {
+        connection_destroy(conn);
+        return;
+    }
+    session->conn = conn;
+    session->next = NULL;
+    pthread_mutex_lock(&shared->lock);
+    if (shared->last)
+        shared->last->next = session;
+    else
+        shared->first = session;
+    shared->last = session;
+    pthread_cond_signal(&shared->new_session);
+    pthread_mutex_unlock(&shared->lock);
+}
+
+static connection next_session(struct shared_data *shared) {
+    struct session *session;
+    connection conn;
+
+    pthread_mutex_lock(&shared->lock);
+    while (shared->first == NULL)
+        pthread_cond_wait(&shared->new_session, &shared->lock);
+    session = shared->first;
+    shared->first = session->next;
+    if (shared->first == NULL)
+        shared->last = NULL;
+    pthread_mutex_unlock(&shared->lock);
+    conn = session->conn;
+    free(session);
+    return conn;
+}
+
+/* Event loop handlers, all of them run in the main thread */
+static void gdb_input(event_loop loop, int fd, void *arg) {
+    connection conn = (connection) arg;
+
+    if (!connection_fill(conn)) {
+        event_loop_remove(loop, fd);
+        connection_end_of_input(conn);
+    }
+}
+
+static void gdb_accept(event_loop loop, int fd, void *arg) {
     struct shared_data *shared = (struct shared_data *) arg;
-    struct sockaddr_in peer;
-    int connection;
-    socklen_t peer_length;
-    struct server_data server;
-
-    server = create_server(shared->gdb_port);
-    fprintf(stderr, "Listening to gdb connection on port %d\n", server.port);
-    peer_length = sizeof(peer);
-    connection = Accept(server.socket, (struct sockaddr *) &peer, &peer_length);
-    gdb_scanner(shared->arm, shared->mem, connection, connection,
-                &shared->lock);
-    shutdown(connection, SHUT_RDWR);
-    close(server.socket);
+    connection conn;
+    int socket;
 
-    pthread_exit(NULL);
+    socket = accept(fd, NULL, NULL);
+    if (socket < 0)
+        return;
+    conn = connection_create(socket, socket);
+    if (conn == NULL) {
+        close(socket);
+        return;
+    }
+    debug("New gdb connection\n");
+    if (event_loop_add(loop, socket, gdb_input, conn) < 0) {
+        connection_destroy(conn);
+        return;
+    }
+    add_session(shared, conn);
 }
 
-static void *irq_listener(void *arg) {
+static void irq_input(event_loop loop, int fd, void *arg) {
     struct shared_data *shared = (struct shared_data *) arg;
-    struct sockaddr_in peer;
-    int connection;
-    socklen_t peer_length;
-    struct server_data server;
-    unsigned char irq;
-
-    server = create_server(shared->irq_port);
-    fprintf(stderr, "Listening to irq connections on port %d\n", server.port);
-    while (1) {
-        peer_length = sizeof(peer);
-        connection = Accept(server.socket, (struct sockaddr *) &peer,
-                            &peer_length);
-        while (Read(connection, &irq, 1) > 0) {
-            pthread_mutex_lock(&shared->lock);
-            arm_exception(shared->arm, irq);
-            pthread_mutex_unlock(&shared->lock);
-        }
-        shutdown(connection, SHUT_RDWR);
+    unsigned char irq[IRQ_BUFFER_SIZE];
+    ssize_t count;
+    int i;
+
+    while ((count = read(fd, irq, IRQ_BUFFER_SIZE)) > 0)
+        for (i=0; i<count; i++)
+            arm_post_exception(shared->arm, irq[i]);
+    if ((count == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK) &&
+                         (errno != EINTR))) {
+        event_loop_remove(loop, fd);
+        shutdown(fd, SHUT_RDWR);
+        close(fd);
     }
-    close(server.socket);
+}
+
+static void irq_accept(event_loop loop, int fd, void *arg) {
+    int socket;
+
+    socket = accept(fd, NULL, NULL);
+    if (socket < 0)
+        return;
+    fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+    if (event_loop_add(loop, socket, irq_input, arg) < 0)
+        close(socket);
+}
+
+/* Execution thread: the only one touching the core and the memory. It serves
+ * gdb sessions one after the other.
+ */
+static void *gdb_executor(void *arg) {
+    struct shared_data *shared = (struct shared_data *) arg;
+    connection conn;
+
+    do {
+        conn = next_session(shared);
+        gdb_scanner(shared->arm, shared->mem, conn);
+        connection_destroy(conn);
+        trace_flush();
+        if (shared->persistent) {
+            /* Get ready for the next session without restarting: same core,
+             * same memory, brought back to their initial state. The memory
+             * may be kept so that gdb can check it already holds the program
+             * (compare-sections) rather than loading it again */
+            arm_reset(shared->arm);
+            if (!shared->keep_memory)
+                memory_clear(shared->mem);
+            fprintf(stderr, "gdb session ended, simulator reset, waiting for "
+                    "the next one\n");
+        }
+    } while (shared->persistent);
+    event_loop_stop(shared->loop);
 
     pthread_exit(NULL);
 }
@@ -114,19 +238,74 @@ void usage(char *name) {
     fprintf(stderr, "Usage:\n"
         "%s [ --help ] [ --gdb-port port ] [ --irq-port port ] "
         "[ --trace-file file ] [ --trace-registers ] [ --trace-memory ] "
-        "[ --trace-state ] [ --trace-position ] [ --debug filename ]\n\n"
+        "[ --trace-state ] [ --trace-state-delta N ] [ --trace-position ] "
+        "[ --trace-instructions ] "
+        "[ --trace-binary ] "
+        "[ --trace-archive ] [ --trace-async block|drop|grow ] "
+        "[ --trace-index cycles ] [ --trace-hash cycles ] [ --trace-fold ] "
+        "[ --trace-filter spec ] "
+        "[ --trace-sample every=N|rate=R ] "
+        "[ --trace-start spec ] [ --trace-stop spec ] "
+        "[ --debug filename ] [ --persistent [ --keep-memory ] ] "
+        "[ --gdb-socket path | --stdio ]\n\n"
         "Start an ARMv5 instruction set simulator that acts as a gdb server "
         "and can receive interrupts. It is possible to specify on which ports "
         "the simulator listen to gdb client or irq sending program "
-        "connections. Trace options have the following behavior:\n"
+        "connections. gdb may rather connect to a unix domain socket (gdb "
+        "socket) or talk to the simulator through its standard input and "
+        "output (stdio, as in target remote | arm_simulator --stdio), the "
+        "simulator output then goes to the standard error and it exits at "
+        "the end of the session. In persistent mode, the simulator does not "
+        "exit at the end of a gdb session: it resets the processor, clears the "
+        "memory and waits for the next gdb connection on the same port. With "
+        "keep memory, the memory content is preserved from one session to the "
+        "next one. "
+        "Trace options have the following behavior:\n"
         "- trace file: file into which trace information is stored (default is"
         " stdout)\n"
         "- trace registers: outputs informations about each access to"
         " registers\n"
         "- trace memory: outputs informations about each access to memory\n"
         "- trace state: outputs the processor state after each instruction\n"
+        "- trace state delta: outputs the processor state after each "
+        "instruction as the registers which have changed, with all of them "
+        "every N instructions\n"
         "- trace position: for each traced access, outputs the file and line"
         " at which the access has been performed\n"
+        "- trace instructions: outputs each executed instruction, "
+        "disassembled, with the registers and memory it has written and the "
+        "flags it has changed\n"
+        "- trace binary: writes fixed size binary records instead of text, "
+        "trace_decode turns them back into text\n"
+        "- trace archive: writes a compressed archive of the register and "
+        "memory accesses, in which trace_query looks for accesses\n"
+        "- trace index: writes along the trace file (in trace_file.idx) the "
+        "position in the trace of every given number of cycles, trace_seek "
+        "uses it to extract a part of the trace (not in persistent mode)\n"
+        "- trace hash: writes into the trace file, instead of the text "
+        "trace, its hash every given number of cycles, trace_compare tells "
+        "where two traces begin to differ from these hashes\n"
+        "- trace fold: writes the loops of the instruction trace once, with "
+        "the number of iterations and the changes of values at each of "
+        "them, trace_unfold expands them back\n"
+        "- trace filter: only traces the accesses to the address ranges "
+        "(addresses=0x8000:0x80ff,...), registers (registers=r0-r3,sp,cpsr), "
+        "modes (modes=usr,svc) or of the kinds (kinds=read,write,fetch) "
+        "given, the option can be repeated\n"
+        "- trace sample: only traces one in every N of the memory accesses, "
+        "register accesses and instructions, or each of them with the "
+        "probability R, the numbers of events seen and traced are written "
+        "at the end of the trace (monitor trace sample spec from gdb)\n"
+        "- trace start, trace stop: starts or stops tracing each time the "
+        "instruction at an address is fetched (pc=address), once a cycle is "
+        "reached (cycle=count) or when an exception is taken "
+        "(exception=reset|undefined|swi|prefetch|data|irq|fiq), tracing is "
+        "off until a start trigger fires. Filters and triggers can also be "
+        "changed from gdb with monitor trace filter|start|stop spec, monitor "
+        "trace on|off|clear|status\n"
+        "- trace async: the trace is formatted and written by a background "
+        "thread, when it lags behind the simulation either waits for it "
+        "(block), loses trace records (drop) or buffers more of them (grow)\n"
         "The debug switch enable selective reporting of debug messages on a "
         "per source file basis\n"
         , name);
@@ -134,11 +313,15 @@ void usage(char *name) {
 
 int main(int argc, char *argv[]) {
     struct shared_data shared;
-    pthread_t gdb_thread;
-    pthread_t irq_thread;
+    struct server_data gdb_server, irq_server;
+    pthread_t executor_thread;
     void *result;
-    int opt;
+    int opt, use_stdio, output, async, fold;
+    char *gdb_socket;
     FILE *trace_file;
+    char *trace_name;
+    uint32_t index_interval, state_interval, hash_interval;
+    connection conn;
 
     struct option longopts[] = {
         { "gdb-port", required_argument, NULL, 'g' },
@@ -147,17 +330,43 @@ int main(int argc, char *argv[]) {
         { "trace-registers", no_argument, NULL, 'r' },
         { "trace-memory", no_argument, NULL, 'm' },
         { "trace-state", no_argument, NULL, 's' },
+        { "trace-state-delta", required_argument, NULL, 'S' },
         { "trace-position", no_argument, NULL, 'p' },
+        { "trace-instructions", no_argument, NULL, 'n' },
+        { "trace-binary", no_argument, NULL, 'b' },
+        { "trace-archive", no_argument, NULL, 'A' },
+        { "trace-async", required_argument, NULL, 'a' },
+        { "trace-index", required_argument, NULL, 'I' },
+        { "trace-hash", required_argument, NULL, 'H' },
+        { "trace-fold", no_argument, NULL, 'F' },
+        { "trace-filter", required_argument, NULL, 'f' },
+        { "trace-sample", required_argument, NULL, 'R' },
+        { "trace-start", required_argument, NULL, 'B' },
+        { "trace-stop", required_argument, NULL, 'E' },
         { "help", no_argument, NULL, 'h' },
         { "debug", required_argument, NULL, 'd' },
+        { "persistent", no_argument, NULL, 'P' },
+        { "keep-memory", no_argument, NULL, 'K' },
+        { "gdb-socket", required_argument, NULL, 'u' },
+        { "stdio", no_argument, NULL, 'o' },
         { NULL, 0, NULL, 0 }
     };
 
     shared.gdb_port = 0;
     shared.irq_port = 0;
-    trace_file = stdout;
-    while ((opt = getopt_long(argc, argv, "g:i:ht:rmspd:", longopts, NULL))
-           != -1) {
+    shared.persistent = 0;
+    shared.keep_memory = 0;
+    gdb_socket = NULL;
+    use_stdio = 0;
+    trace_file = NULL;
+    trace_name = NULL;
+    index_interval = 0;
+    hash_interval = 0;
+    fold = 0;
+    async = -1;
+    while ((opt = getopt_long(argc, argv,
+                              "g:i:ht:rmsS:pnbAa:I:H:Ff:R:B:E:d:PKu:o",
+                              longopts, NULL)) != -1) {
         switch(opt) {
           case 'g':
             shared.gdb_port = atoi(optarg);
@@ -169,6 +378,7 @@ int main(int argc, char *argv[]) {
             usage(argv[0]);
             exit(0);
           case 't':
+            trace_name = optarg;
             trace_file = fopen(optarg, "w");
             if (trace_file == NULL) {
                 perror("Trace file");
@@ -187,18 +397,145 @@ int main(int argc, char *argv[]) {
           case 'p':
             trace_add(POSITION);
             break;
+          case 'S':
+            state_interval = strtoul(optarg, NULL, 0);
+            if (state_interval == 0) {
+                fprintf(stderr, "The state delta interval should be "
+                        "positive\n");
+                usage(argv[0]);
+                exit(1);
+            }
+            trace_add(STATE);
+            trace_state_delta(state_interval);
+            break;
+          case 'n':
+            trace_add(INSTRUCTION);
+            break;
+          case 'b':
+            trace_add(BINARY);
+            break;
+          case 'A':
+            trace_add(ARCHIVE);
+            break;
+          case 'I':
+            index_interval = strtoul(optarg, NULL, 0);
+            break;
+          case 'H':
+            hash_interval = strtoul(optarg, NULL, 0);
+            break;
+          case 'F':
+            fold = 1;
+            break;
+          case 'f':
+            if (trace_select_filter(optarg) == -1) {
+                fprintf(stderr, "Invalid trace filter %s\n", optarg);
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+          case 'R':
+            if (trace_select_sampling(optarg) == -1) {
+                fprintf(stderr, "Invalid trace sampling %s\n", optarg);
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+          case 'B':
+          case 'E':
+            if (trace_select_trigger(opt == 'B', optarg) == -1) {
+                fprintf(stderr, "Invalid trace trigger %s\n", optarg);
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+          case 'a':
+            if (strcmp(optarg, "block") == 0) {
+                async = TRACE_BLOCK;
+            } else if (strcmp(optarg, "drop") == 0) {
+                async = TRACE_DROP;
+            } else if (strcmp(optarg, "grow") == 0) {
+                async = TRACE_GROW;
+            } else {
+                fprintf(stderr, "Unknown trace buffer policy %s\n", optarg);
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
           case 'd':
             add_debug_to(optarg);
             break;
+          case 'P':
+            shared.persistent = 1;
+            break;
+          case 'K':
+            shared.keep_memory = 1;
+            break;
+          case 'u':
+            gdb_socket = optarg;
+            break;
+          case 'o':
+            use_stdio = 1;
+            break;
           default:
             fprintf(stderr, "Unrecognized option %c\n", opt);
             usage(argv[0]);
             exit(1);
         }
     }
+    if (shared.keep_memory && !shared.persistent) {
+        fprintf(stderr, "--keep-memory only applies to --persistent\n");
+        usage(argv[0]);
+        exit(1);
+    }
+    output = -1;
+    if (use_stdio) {
+        /* The standard output carries the protocol, everything else printed
+         * by the simulator (traces, dynamic printf) goes to the standard
+         * error. A single session is served. */
+        output = dup(1);
+        dup2(2, 1);
+        shared.persistent = 0;
+    }
     gdb_init();
     arm_init();
-    set_trace_file(trace_file);
+    set_trace_file(trace_file ? trace_file : stdout);
+    if (hash_interval && (trace_start_hash(hash_interval) < 0)) {
+        fprintf(stderr, "Cannot hash the trace, it should be a text trace "
+                "without index nor background writer\n");
+        exit(1);
+    }
+    if (fold && (trace_start_fold() < 0)) {
+        fprintf(stderr, "Cannot fold the trace, it should be a text trace "
+                "without index, background writer nor hash\n");
+        exit(1);
+    }
+    if (index_interval && shared.persistent) {
+        /* Each session starts again from cycle 0, the index would go
+         * backwards */
+        fprintf(stderr, "Cannot index the trace of a persistent simulator\n");
+        exit(1);
+    }
+    if (index_interval) {
+        FILE *index_file = NULL;
+        char *index_name;
+
+        index_name = trace_name ? malloc(strlen(trace_name) + 5) : NULL;
+        if (index_name) {
+            sprintf(index_name, "%s.idx", trace_name);
+            index_file = fopen(index_name, "w");
+            free(index_name);
+        }
+        if ((index_file == NULL) ||
+            (trace_start_index(index_file, index_interval) < 0)) {
+            fprintf(stderr, "Cannot index the trace, it should go to a "
+                    "file and be neither an archive, hashed nor folded\n");
+            exit(1);
+        }
+    }
+    if ((async >= 0) && (trace_start_writer(async, TRACE_BUFFER_SIZE) < 0)) {
+        fprintf(stderr, "Cannot start the trace writer\n");
+        exit(1);
+    }
 
 #ifdef BIG_ENDIAN_SIMULATOR
     shared.mem = memory_create(0x20000, 1);
@@ -208,10 +545,55 @@ int main(int argc, char *argv[]) {
     shared.arm = arm_create(shared.mem);
 
     pthread_mutex_init(&shared.lock, NULL);
-    pthread_create(&gdb_thread, NULL, gdb_listener, &shared);
-    pthread_create(&irq_thread, NULL, irq_listener, &shared);
-    pthread_join(gdb_thread, &result);
+    pthread_cond_init(&shared.new_session, NULL);
+    shared.first = NULL;
+    shared.last = NULL;
+    shared.loop = event_loop_create();
+    if (shared.loop == NULL)
+        exit(1);
+    /* A gdb closing its connection should not kill the server */
+    signal(SIGPIPE, SIG_IGN);
+
+    gdb_server.socket = -1;
+    if (use_stdio) {
+        conn = connection_create(0, output);
+        if ((conn == NULL) ||
+            (event_loop_add(shared.loop, 0, gdb_input, conn) < 0)) {
+            fprintf(stderr, "Cannot use the standard input for gdb\n");
+            exit(1);
+        }
+        add_session(&shared, conn);
+    } else if (gdb_socket) {
+        gdb_server = create_unix_server(gdb_socket);
+        fprintf(stderr, "Listening to gdb connection on socket %s\n",
+                gdb_socket);
+    } else {
+        gdb_server = create_server(shared.gdb_port);
+        fprintf(stderr, "Listening to gdb connection on port %d\n",
+                gdb_server.port);
+    }
+    irq_server = create_server(shared.irq_port);
+    fprintf(stderr, "Listening to irq connections on port %d\n",
+            irq_server.port);
+    if (gdb_server.socket >= 0)
+        event_loop_add(shared.loop, gdb_server.socket, gdb_accept, &shared);
+    event_loop_add(shared.loop, irq_server.socket, irq_accept, &shared);
+
+    pthread_create(&executor_thread, NULL, gdb_executor, &shared);
+    event_loop_run(shared.loop);
+    pthread_join(executor_thread, &result);
+    if (gdb_server.socket >= 0)
+        close(gdb_server.socket);
+    if (gdb_socket)
+        unlink(gdb_socket);
+    close(irq_server.socket);
+    event_loop_destroy(shared.loop);
     arm_destroy(shared.arm);
     memory_destroy(shared.mem);
+    trace_write_samples();
+    trace_stop_writer();
+    trace_flush();
+    trace_stop_hash();
+    trace_stop_fold();
     return 0;
 }
@@ -0,0 +1,168 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "breakpoint.h"
+#include "address_map.h"
+#include "debug.h"
+
+struct breakpoint {
+    uint32_t address;
+    int count, command_count;
+    agent_expr *conditions;
+    agent_expr *commands;
+};
+
+struct breakpoint_table_data {
+    address_map addresses;
+    int count, capacity;
+    struct breakpoint *breakpoints;
+};
+
+breakpoint_table breakpoint_table_create(size_t memory_size) {
+    breakpoint_table table;
+
+    table = malloc(sizeof(struct breakpoint_table_data));
+    if (table) {
+        table->addresses = address_map_create(memory_size);
+        table->count = 0;
+        table->capacity = 0;
+        table->breakpoints = NULL;
+        if (table->addresses == NULL) {
+            free(table);
+            table = NULL;
+        }
+    }
+    return table;
+}
+
+static void free_expressions(agent_expr *expressions, int count) {
+    int i;
+
+    for (i=0; i<count; i++)
+        agent_expr_destroy(expressions[i]);
+    free(expressions);
+}
+
+static void free_breakpoint(struct breakpoint *breakpoint) {
+    free_expressions(breakpoint->conditions, breakpoint->count);
+    free_expressions(breakpoint->commands, breakpoint->command_count);
+}
+
+void breakpoint_table_destroy(breakpoint_table table) {
+    int i;
+
+    for (i=0; i<table->count; i++)
+        free_breakpoint(&table->breakpoints[i]);
+    free(table->breakpoints);
+    address_map_destroy(table->addresses);
+    free(table);
+}
+
+static struct breakpoint *find(breakpoint_table table, uint32_t address) {
+    int i;
+
+    for (i=0; i<table->count; i++)
+        if (table->breakpoints[i].address == address)
+            return &table->breakpoints[i];
+    return NULL;
+}
+
+int breakpoint_insert(breakpoint_table table, uint32_t address,
+                      agent_expr *conditions, int count,
+                      agent_expr *commands, int command_count) {
+    struct breakpoint *breakpoint, *breakpoints;
+    int capacity;
+
+    if (!address_map_test(table->addresses, address) &&
+        (address_map_set(table->addresses, address, 1) == -1))
+        return -1;
+    breakpoint = find(table, address);
+    if (breakpoint) {
+        free_breakpoint(breakpoint);
+    } else {
+        if (table->count == table->capacity) {
+            capacity = table->capacity ? table->capacity * 2 : 16;
+            breakpoints = realloc(table->breakpoints,
+                                  capacity * sizeof(struct breakpoint));
+            if (breakpoints == NULL) {
+                address_map_set(table->addresses, address, 0);
+                return -1;
+            }
+            table->breakpoints = breakpoints;
+            table->capacity = capacity;
+        }
+        breakpoint = &table->breakpoints[table->count++];
+        breakpoint->address = address;
+    }
+    breakpoint->conditions = conditions;
+    breakpoint->count = count;
+    breakpoint->commands = commands;
+    breakpoint->command_count = command_count;
+    debug("Breakpoint at %08x with %d conditions and %d commands\n", address,
+          count, command_count);
+    return 0;
+}
+
+int breakpoint_remove(breakpoint_table table, uint32_t address) {
+    struct breakpoint *breakpoint;
+
+    breakpoint = find(table, address);
+    if (breakpoint == NULL)
+        return -1;
+    free_breakpoint(breakpoint);
+    *breakpoint = table->breakpoints[--table->count];
+    address_map_set(table->addresses, address, 0);
+    return 0;
+}
+
+int breakpoint_check(breakpoint_table table, uint32_t address,
+                     agent_context context) {
+    struct breakpoint *breakpoint;
+    uint64_t value;
+    int i, active;
+
+    if (!address_map_test(table->addresses, address))
+        return 0;
+    breakpoint = find(table, address);
+    if (breakpoint == NULL)
+        return 0;
+    active = (breakpoint->count == 0);
+    for (i=0; (i<breakpoint->count) && !active; i++) {
+        if (agent_expr_eval(breakpoint->conditions[i], context, &value)
+            == -1) {
+            debug("Breakpoint condition at %08x cannot be evaluated\n",
+                  address);
+            return 1;
+        }
+        active = (value != 0);
+    }
+    if (!active)
+        return 0;
+    if (breakpoint->command_count == 0)
+        return 1;
+    for (i=0; i<breakpoint->command_count; i++)
+        if (agent_expr_eval(breakpoint->commands[i], context, NULL) == -1)
+            debug("Breakpoint command at %08x failed\n", address);
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#ifndef __BREAKPOINT_H__
+#define __BREAKPOINT_H__
+#include <stdint.h>
+#include <sys/types.h>
+#include "arm_core.h"
+#include "memory.h"
+#include "agent_expr.h"
+
+/* Breakpoints inserted by gdb (Z0/Z1 packets). They are kept by the
+ * simulator instead of being written into the memory, so that their
+ * conditions and commands can be evaluated without gdb. Checking whether an
+ * address holds a breakpoint is a lookup in a bitmap, cheap enough to be done
+ * before each instruction.
+ */
+typedef struct breakpoint_table_data *breakpoint_table;
+
+breakpoint_table breakpoint_table_create(size_t memory_size);
+void breakpoint_table_destroy(breakpoint_table table);
+
+/* Inserts a breakpoint at address, active when any of its count conditions
+ * is true (always when count is 0). When the breakpoint has commands (agent
+ * printf of dynamic printf), an active breakpoint runs them and lets the
+ * execution go on. The table takes ownership of the expressions. Inserting
+ * again at the same address replaces the conditions and commands.
+ * Returns 0 on success, -1 if address is outside of the memory.
+ */
+int breakpoint_insert(breakpoint_table table, uint32_t address,
+                      agent_expr *conditions, int count,
+                      agent_expr *commands, int command_count);
+/* Returns 0 on success, -1 if there is no breakpoint at address */
+int breakpoint_remove(breakpoint_table table, uint32_t address);
+
+/* Whether the execution should stop at address : there is an active
+ * breakpoint without commands. A condition that cannot be evaluated stops
+ * the execution, so that the user can look at it.
+ */
+int breakpoint_check(breakpoint_table table, uint32_t address,
+                     agent_context context);
+#endif
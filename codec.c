@@ -0,0 +1,295 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <pthread.h>
+#include "codec.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define CRC32_POLYNOMIAL 0x04c11db7
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/* Slicing by 8 tables : crc_table[k][i] is the crc of byte i followed by k
+ * zero bytes. Built on first use. */
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+/* Digit values, flagged with 0x10 so that 0 stands for an invalid digit */
+static const uint8_t hex_table[256] = {
+    ['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14,
+    ['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19,
+    ['a'] = 0x1a, ['b'] = 0x1b, ['c'] = 0x1c, ['d'] = 0x1d, ['e'] = 0x1e,
+    ['f'] = 0x1f,
+    ['A'] = 0x1a, ['B'] = 0x1b, ['C'] = 0x1c, ['D'] = 0x1d, ['E'] = 0x1e,
+    ['F'] = 0x1f
+};
+
+int codec_hex_value(char c) {
+    uint8_t value = hex_table[(uint8_t) c];
+
+    return value ? value & 0xf : -1;
+}
+
+#ifdef __SSE2__
+/* Digits of 16 nibbles : '0' + n, moved up to 'a' for nibbles above 9 */
+static inline __m128i hex_digits_sse2(__m128i n) {
+    __m128i above = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+
+    return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')),
+                        _mm_and_si128(above, _mm_set1_epi8('a' - '0' - 10)));
+}
+
+/* Values of 16 digits, non digits are flagged in invalid. Characters above
+ * 0x7f are negative for the signed comparisons, hence rejected. */
+static inline __m128i hex_values_sse2(__m128i c, __m128i *invalid) {
+    __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0'-1)),
+                                     _mm_cmplt_epi8(c, _mm_set1_epi8('9'+1)));
+    __m128i is_alpha = _mm_and_si128(
+                           _mm_cmpgt_epi8(lower, _mm_set1_epi8('a'-1)),
+                           _mm_cmplt_epi8(lower, _mm_set1_epi8('f'+1)));
+    __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i alpha = _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10));
+
+    *invalid = _mm_or_si128(*invalid,
+                   _mm_andnot_si128(_mm_or_si128(is_digit, is_alpha),
+                                    _mm_set1_epi8(-1)));
+    return _mm_or_si128(_mm_and_si128(is_digit, digit),
+                        _mm_and_si128(is_alpha, alpha));
+}
+
+/* Combines pairs of nibbles (high one first) into 16 bits lanes */
+static inline __m128i hex_pairs_sse2(__m128i n) {
+    return _mm_or_si128(
+               _mm_slli_epi16(_mm_and_si128(n, _mm_set1_epi16(0xff)), 4),
+               _mm_srli_epi16(n, 8));
+}
+#endif
+
+#ifdef __AVX2__
+static inline __m256i hex_digits_avx2(__m256i n) {
+    __m256i above = _mm256_cmpgt_epi8(n, _mm256_set1_epi8(9));
+
+    return _mm256_add_epi8(_mm256_add_epi8(n, _mm256_set1_epi8('0')),
+                  _mm256_and_si256(above, _mm256_set1_epi8('a' - '0' - 10)));
+}
+
+static inline __m256i hex_values_avx2(__m256i c, __m256i *invalid) {
+    __m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+    __m256i is_digit = _mm256_and_si256(
+                           _mm256_cmpgt_epi8(c, _mm256_set1_epi8('0'-1)),
+                           _mm256_cmpgt_epi8(_mm256_set1_epi8('9'+1), c));
+    __m256i is_alpha = _mm256_and_si256(
+                           _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a'-1)),
+                           _mm256_cmpgt_epi8(_mm256_set1_epi8('f'+1), lower));
+    __m256i digit = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+    __m256i alpha = _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10));
+
+    *invalid = _mm256_or_si256(*invalid,
+                   _mm256_andnot_si256(_mm256_or_si256(is_digit, is_alpha),
+                                       _mm256_set1_epi8(-1)));
+    return _mm256_or_si256(_mm256_and_si256(is_digit, digit),
+                           _mm256_and_si256(is_alpha, alpha));
+}
+
+static inline __m256i hex_pairs_avx2(__m256i n) {
+    return _mm256_or_si256(
+               _mm256_slli_epi16(_mm256_and_si256(n, _mm256_set1_epi16(0xff)),
+                                 4),
+               _mm256_srli_epi16(n, 8));
+}
+#endif
+
+size_t codec_hex_encode(char *destination, const uint8_t *source,
+                        size_t size) {
+    size_t i = 0;
+
+#ifdef __AVX2__
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (source + i));
+        __m256i mask = _mm256_set1_epi8(0x0f);
+        __m256i high = hex_digits_avx2(
+                           _mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+        __m256i low = hex_digits_avx2(_mm256_and_si256(v, mask));
+        /* Unpacking works within each 128 bits lane */
+        __m256i first = _mm256_unpacklo_epi8(high, low);
+        __m256i second = _mm256_unpackhi_epi8(high, low);
+
+        _mm256_storeu_si256((__m256i *) (destination + 2*i),
+                            _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i *) (destination + 2*i + 32),
+                            _mm256_permute2x128_si256(first, second, 0x31));
+    }
+#endif
+#ifdef __SSE2__
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (source + i));
+        __m128i mask = _mm_set1_epi8(0x0f);
+        __m128i high = hex_digits_sse2(
+                           _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+        __m128i low = hex_digits_sse2(_mm_and_si128(v, mask));
+
+        _mm_storeu_si128((__m128i *) (destination + 2*i),
+                         _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128((__m128i *) (destination + 2*i + 16),
+                         _mm_unpackhi_epi8(high, low));
+    }
+#endif
+    for (; i < size; i++) {
+        destination[2*i] = hex_digits[source[i] >> 4];
+        destination[2*i+1] = hex_digits[source[i] & 0xf];
+    }
+    return 2*size;
+}
+
+int codec_hex_decode(uint8_t *destination, const char *source, size_t size) {
+    uint8_t high, low;
+    size_t i = 0;
+
+#ifdef __AVX2__
+    {
+        __m256i invalid = _mm256_setzero_si256();
+
+        for (; i + 32 <= size; i += 32) {
+            __m256i first = hex_values_avx2(_mm256_loadu_si256(
+                                (const __m256i *) (source + 2*i)), &invalid);
+            __m256i second = hex_values_avx2(_mm256_loadu_si256(
+                                (const __m256i *) (source + 2*i + 32)),
+                                &invalid);
+            /* Packing works within each 128 bits lane, put them back in
+             * order */
+            __m256i bytes = _mm256_packus_epi16(hex_pairs_avx2(first),
+                                                hex_pairs_avx2(second));
+
+            _mm256_storeu_si256((__m256i *) (destination + i),
+                                _mm256_permute4x64_epi64(bytes, 0xd8));
+        }
+        if (_mm256_movemask_epi8(invalid))
+            return -1;
+    }
+#endif
+#ifdef __SSE2__
+    {
+        __m128i invalid = _mm_setzero_si128();
+
+        for (; i + 16 <= size; i += 16) {
+            __m128i first = hex_values_sse2(_mm_loadu_si128(
+                                (const __m128i *) (source + 2*i)), &invalid);
+            __m128i second = hex_values_sse2(_mm_loadu_si128(
+                                (const __m128i *) (source + 2*i + 16)),
+                                &invalid);
+
+            _mm_storeu_si128((__m128i *) (destination + i),
+                             _mm_packus_epi16(hex_pairs_sse2(first),
+                                              hex_pairs_sse2(second)));
+        }
+        if (_mm_movemask_epi8(invalid))
+            return -1;
+    }
+#endif
+    for (; i < size; i++) {
+        high = hex_table[(uint8_t) source[2*i]];
+        low = hex_table[(uint8_t) source[2*i+1]];
+        if (!high || !low)
+            return -1;
+        destination[i] = ((high & 0xf) << 4) | (low & 0xf);
+    }
+    return 0;
+}
+
+uint8_t codec_checksum(const char *data, size_t size) {
+    uint8_t check = 0;
+    size_t i = 0;
+
+#ifdef __AVX2__
+    {
+        /* Sums of absolute differences with 0 add bytes into 64 bits lanes */
+        __m256i sum = _mm256_setzero_si256();
+        uint64_t lanes[4];
+
+        for (; i + 32 <= size; i += 32)
+            sum = _mm256_add_epi64(sum, _mm256_sad_epu8(
+                      _mm256_loadu_si256((const __m256i *) (data + i)),
+                      _mm256_setzero_si256()));
+        _mm256_storeu_si256((__m256i *) lanes, sum);
+        check += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+#ifdef __SSE2__
+    {
+        __m128i sum = _mm_setzero_si128();
+        uint64_t lanes[2];
+
+        for (; i + 16 <= size; i += 16)
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(
+                      _mm_loadu_si128((const __m128i *) (data + i)),
+                      _mm_setzero_si128()));
+        _mm_storeu_si128((__m128i *) lanes, sum);
+        check += lanes[0] + lanes[1];
+    }
+#endif
+    for (; i < size; i++)
+        check += data[i];
+    return check;
+}
+
+static void crc_table_init() {
+    uint32_t crc;
+    int i, j, k;
+
+    for (i=0; i<256; i++) {
+        crc = (uint32_t) i << 24;
+        for (j=0; j<8; j++)
+            crc = (crc << 1) ^ ((crc & 0x80000000) ? CRC32_POLYNOMIAL : 0);
+        crc_table[0][i] = crc;
+    }
+    for (k=1; k<8; k++)
+        for (i=0; i<256; i++)
+            crc_table[k][i] = (crc_table[k-1][i] << 8) ^
+                              crc_table[0][crc_table[k-1][i] >> 24];
+}
+
+uint32_t codec_crc32(const uint8_t *data, size_t size, uint32_t crc) {
+    uint32_t next;
+
+    pthread_once(&crc_table_once, crc_table_init);
+    /* 8 bytes at a time : the first 4 are merged into the crc, the crc and
+     * the next 4 are then pushed through 8 and 4 bytes of zeros */
+    for (; size >= 8; size -= 8, data += 8) {
+        crc ^= ((uint32_t) data[0] << 24) | ((uint32_t) data[1] << 16) |
+               ((uint32_t) data[2] << 8) | data[3];
+        next = ((uint32_t) data[4] << 24) | ((uint32_t) data[5] << 16) |
+               ((uint32_t) data[6] << 8) | data[7];
+        crc = crc_table[7][crc >> 24] ^ crc_table[6][(crc >> 16) & 0xff] ^
+              crc_table[5][(crc >> 8) & 0xff] ^ crc_table[4][crc & 0xff] ^
+              crc_table[3][next >> 24] ^ crc_table[2][(next >> 16) & 0xff] ^
+              crc_table[1][(next >> 8) & 0xff] ^ crc_table[0][next & 0xff];
+    }
+    for (; size; size--, data++)
+        crc = (crc << 8) ^ crc_table[0][(crc >> 24) ^ *data];
+    return crc;
+}
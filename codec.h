@@ -0,0 +1,56 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#ifndef __CODEC_H__
+#define __CODEC_H__
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Hexadecimal encoding and checksum of gdb packet payloads. Each function
+ * processes the bulk of its data with SSE2 or AVX2 instructions when they are
+ * enabled at compile time (e.g. CFLAGS=-mavx2) and the rest with lookup
+ * tables.
+ */
+
+/* Value of the hexadecimal digit c (either case), -1 if c is not a digit */
+int codec_hex_value(char c);
+
+/* Writes the 2*size lowercase hexadecimal digits of the size bytes of source
+ * to destination (without terminating it). Returns the number of digits
+ * written.
+ */
+size_t codec_hex_encode(char *destination, const uint8_t *source, size_t size);
+
+/* Reads size bytes from the 2*size hexadecimal digits of source. Returns 0 on
+ * success and -1 if source contains something else than digits.
+ */
+int codec_hex_decode(uint8_t *destination, const char *source, size_t size);
+
+/* Sum modulo 256 of the size bytes of data, the checksum of gdb packets */
+uint8_t codec_checksum(const char *data, size_t size);
+
+/* CRC32 used by gdb for qCRC and compare-sections : polynomial 0x04c11db7,
+ * most significant bit first, no final xor. crc is the running value, gdb
+ * starts with 0xffffffff.
+ */
+uint32_t codec_crc32(const uint8_t *data, size_t size, uint32_t crc);
+#endif
@@ -0,0 +1,149 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "codec.h"
+
+#define MAX_SIZE 200
+
+void print_test(int result) {
+    if (result)
+        printf("Test succeded\n");
+    else
+        printf("TEST FAILED !!\n");
+}
+
+/* Straightforward versions to compare with */
+void reference_encode(char *destination, uint8_t *source, size_t size) {
+    size_t i;
+
+    for (i=0; i<size; i++)
+        sprintf(destination + 2*i, "%02x", source[i]);
+}
+
+uint8_t reference_checksum(char *data, size_t size) {
+    uint8_t check = 0;
+    size_t i;
+
+    for (i=0; i<size; i++)
+        check += data[i];
+    return check;
+}
+
+uint32_t reference_crc32(uint8_t *data, size_t size, uint32_t crc) {
+    size_t i;
+    int j;
+
+    for (i=0; i<size; i++) {
+        crc ^= (uint32_t) data[i] << 24;
+        for (j=0; j<8; j++)
+            crc = (crc << 1) ^ ((crc & 0x80000000) ? 0x04c11db7 : 0);
+    }
+    return crc;
+}
+
+int main() {
+    uint8_t bytes[MAX_SIZE], decoded[MAX_SIZE];
+    char encoded[2*MAX_SIZE+1], expected[2*MAX_SIZE+1];
+    size_t size, i;
+    int result;
+
+    srandom(42);
+    for (i=0; i<MAX_SIZE; i++)
+        bytes[i] = random();
+
+    /* Sizes around the vector widths exercise both the vectorised loops and
+     * the scalar remainder */
+    printf("Encoding blocks of all sizes up to %d bytes, ", MAX_SIZE);
+    result = 1;
+    for (size=0; size<=MAX_SIZE; size++) {
+        reference_encode(expected, bytes, size);
+        if ((codec_hex_encode(encoded, bytes, size) != 2*size) ||
+            (memcmp(encoded, expected, 2*size) != 0))
+            result = 0;
+    }
+    print_test(result);
+
+    printf("Decoding blocks of all sizes up to %d bytes, ", MAX_SIZE);
+    result = 1;
+    for (size=0; size<=MAX_SIZE; size++) {
+        codec_hex_encode(encoded, bytes, size);
+        if ((codec_hex_decode(decoded, encoded, size) != 0) ||
+            (memcmp(decoded, bytes, size) != 0))
+            result = 0;
+    }
+    print_test(result);
+
+    printf("Decoding upper case digits, ");
+    codec_hex_encode(encoded, bytes, MAX_SIZE);
+    for (i=0; i<2*MAX_SIZE; i++)
+        if ((encoded[i] >= 'a') && (encoded[i] <= 'f'))
+            encoded[i] += 'A' - 'a';
+    print_test((codec_hex_decode(decoded, encoded, MAX_SIZE) == 0) &&
+               (memcmp(decoded, bytes, MAX_SIZE) == 0));
+
+    printf("Rejecting an invalid digit at any position, ");
+    result = 1;
+    for (i=0; i<2*MAX_SIZE; i++) {
+        char invalid[] = { 'g', '/', ':', '@', 'G', '`', ' ', (char) 0xb0 };
+
+        codec_hex_encode(encoded, bytes, MAX_SIZE);
+        encoded[i] = invalid[i % sizeof(invalid)];
+        if (codec_hex_decode(decoded, encoded, MAX_SIZE) != -1)
+            result = 0;
+    }
+    print_test(result);
+
+    printf("Single digit values, ");
+    print_test((codec_hex_value('0') == 0) && (codec_hex_value('9') == 9) &&
+               (codec_hex_value('a') == 10) && (codec_hex_value('F') == 15) &&
+               (codec_hex_value('g') == -1) && (codec_hex_value('#') == -1));
+
+    printf("Checksums of all sizes up to %d bytes, ", MAX_SIZE);
+    result = 1;
+    for (size=0; size<=MAX_SIZE; size++)
+        if (codec_checksum((char *) bytes, size) !=
+            reference_checksum((char *) bytes, size))
+            result = 0;
+    print_test(result);
+
+    printf("Crc32 of the standard check string, ");
+    print_test(codec_crc32((uint8_t *) "123456789", 9, 0xffffffff) ==
+               0x0376e6e7);
+
+    printf("Crc32 of all sizes up to %d bytes, ", MAX_SIZE);
+    result = 1;
+    for (size=0; size<=MAX_SIZE; size++)
+        if (codec_crc32(bytes, size, 0xffffffff) !=
+            reference_crc32(bytes, size, 0xffffffff))
+            result = 0;
+    print_test(result);
+
+    printf("Crc32 computed in several parts, ");
+    print_test(codec_crc32(bytes + 37, MAX_SIZE - 37,
+                           codec_crc32(bytes, 37, 0xffffffff)) ==
+               reference_crc32(bytes, MAX_SIZE, 0xffffffff));
+
+    return 0;
+}
@@ -0,0 +1,187 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <sys/socket.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include "connection.h"
+#include "util.h"
+#include "debug.h"
+
+#define INITIAL_CAPACITY 4096
+
+struct connection_data {
+    int in, out;
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+    char *buffer;
+    size_t start, end, capacity;
+    int closed;
+    /* Copy of (start != end) || closed that can be read without the lock */
+    int has_input;
+};
+
+connection connection_create(int in, int out) {
+    connection c;
+
+    c = malloc(sizeof(struct connection_data));
+    if (c == NULL)
+        return NULL;
+    c->buffer = malloc(INITIAL_CAPACITY);
+    if (c->buffer == NULL) {
+        free(c);
+        return NULL;
+    }
+    c->in = in;
+    c->out = out;
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->available, NULL);
+    c->start = 0;
+    c->end = 0;
+    c->capacity = INITIAL_CAPACITY;
+    c->closed = 0;
+    c->has_input = 0;
+    /* The event loop must never block on a read */
+    fcntl(in, F_SETFL, fcntl(in, F_GETFL) | O_NONBLOCK);
+    return c;
+}
+
+void connection_destroy(connection c) {
+    close(c->in);
+    if (c->out != c->in)
+        close(c->out);
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->available);
+    free(c->buffer);
+    free(c);
+}
+
+/* Makes room for at least one more byte at the end of the buffer */
+static int connection_make_room(connection c) {
+    char *buffer;
+
+    if (c->end < c->capacity)
+        return 1;
+    if (c->start > 0) {
+        memmove(c->buffer, c->buffer + c->start, c->end - c->start);
+        c->end -= c->start;
+        c->start = 0;
+        return 1;
+    }
+    buffer = realloc(c->buffer, c->capacity * 2);
+    if (buffer == NULL)
+        return 0;
+    c->buffer = buffer;
+    c->capacity *= 2;
+    return 1;
+}
+
+int connection_fill(connection c) {
+    ssize_t count;
+    size_t before;
+    int open = 1;
+
+    pthread_mutex_lock(&c->lock);
+    before = c->end - c->start;
+    do {
+        if (!connection_make_room(c)) {
+            debug("Cannot grow connection buffer, delaying read\n");
+            break;
+        }
+        count = read(c->in, c->buffer + c->end, c->capacity - c->end);
+        if (count > 0)
+            c->end += count;
+        else if ((count == 0) ||
+                 ((errno != EAGAIN) && (errno != EWOULDBLOCK) &&
+                  (errno != EINTR)))
+            open = 0;
+    } while ((count > 0) || ((count < 0) && (errno == EINTR)));
+    if (c->end - c->start > before) {
+        __atomic_store_n(&c->has_input, 1, __ATOMIC_RELEASE);
+        pthread_cond_signal(&c->available);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return open;
+}
+
+void connection_end_of_input(connection c) {
+    pthread_mutex_lock(&c->lock);
+    c->closed = 1;
+    __atomic_store_n(&c->has_input, 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&c->available);
+    pthread_mutex_unlock(&c->lock);
+}
+
+size_t connection_read(connection c, char *buffer, size_t size) {
+    size_t count;
+
+    pthread_mutex_lock(&c->lock);
+    while ((c->start == c->end) && !c->closed)
+        pthread_cond_wait(&c->available, &c->lock);
+    count = min(size, c->end - c->start);
+    memcpy(buffer, c->buffer + c->start, count);
+    c->start += count;
+    if (c->start == c->end) {
+        c->start = 0;
+        c->end = 0;
+        __atomic_store_n(&c->has_input, c->closed, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return count;
+}
+
+int connection_has_input(connection c) {
+    return __atomic_load_n(&c->has_input, __ATOMIC_ACQUIRE);
+}
+
+int connection_write(connection c, const char *data, size_t size) {
+    struct pollfd ready;
+    ssize_t count;
+
+    while (size > 0) {
+        count = write(c->out, data, size);
+        if (count > 0) {
+            data += count;
+            size -= count;
+        } else if ((count < 0) && ((errno == EAGAIN) ||
+                                   (errno == EWOULDBLOCK))) {
+            /* The descriptor is shared with the non blocking input */
+            ready.fd = c->out;
+            ready.events = POLLOUT;
+            poll(&ready, 1, -1);
+        } else if ((count < 0) && (errno != EINTR)) {
+            debug("Write to connection failed: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void connection_shutdown(connection c) {
+    shutdown(c->out, SHUT_WR);
+}
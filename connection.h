@@ -0,0 +1,55 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#ifndef __CONNECTION_H__
+#define __CONNECTION_H__
+#include <sys/types.h>
+
+/* A connection buffers the data received on its input descriptor until it is
+ * consumed. Data is received by the event loop thread (connection_fill and
+ * connection_end_of_input) and consumed by another thread
+ * (connection_read), which is woken up as soon as some data is available.
+ * Writes are performed directly by the consumer thread.
+ */
+typedef struct connection_data *connection;
+
+connection connection_create(int in, int out);
+void connection_destroy(connection c);
+
+/* Event loop side: reads everything currently available, returns 0 when the
+ * input has been closed. In this case, connection_end_of_input should be
+ * called once the input descriptor is no longer watched.
+ */
+int connection_fill(connection c);
+void connection_end_of_input(connection c);
+
+/* Consumer side: connection_read blocks until some data is available and
+ * returns 0 at the end of the input.
+ */
+size_t connection_read(connection c, char *buffer, size_t size);
+/* Whether connection_read would return without blocking. It does not take
+ * the lock, so that it can be polled between two simulated instructions. */
+int connection_has_input(connection c);
+int connection_write(connection c, const char *data, size_t size);
+void connection_shutdown(connection c);
+
+#endif
@@ -0,0 +1,157 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "event_loop.h"
+#include "util.h"
+#include "debug.h"
+
+#define MAX_EVENTS 64
+
+struct registration {
+    event_handler_t handler;
+    void *arg;
+};
+
+struct event_loop_data {
+    int epoll;
+    int control;
+    volatile int running;
+    struct registration *registrations;
+    int size;
+};
+
+event_loop event_loop_create() {
+    event_loop loop;
+    struct epoll_event event;
+
+    loop = malloc(sizeof(struct event_loop_data));
+    if (loop == NULL)
+        return NULL;
+    loop->epoll = epoll_create1(EPOLL_CLOEXEC);
+    loop->control = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((loop->epoll < 0) || (loop->control < 0)) {
+        perror("Cannot create event loop");
+        free(loop);
+        return NULL;
+    }
+    loop->running = 0;
+    loop->registrations = NULL;
+    loop->size = 0;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = loop->control;
+    epoll_ctl(loop->epoll, EPOLL_CTL_ADD, loop->control, &event);
+    return loop;
+}
+
+void event_loop_destroy(event_loop loop) {
+    close(loop->control);
+    close(loop->epoll);
+    free(loop->registrations);
+    free(loop);
+}
+
+int event_loop_add(event_loop loop, int fd, event_handler_t handler,
+                   void *arg) {
+    struct epoll_event event;
+    struct registration *registrations;
+    int size;
+
+    if (fd >= loop->size) {
+        size = max(loop->size * 2, fd + 1);
+        registrations = realloc(loop->registrations,
+                                size * sizeof(struct registration));
+        if (registrations == NULL)
+            return -1;
+        memset(registrations + loop->size, 0,
+               (size - loop->size) * sizeof(struct registration));
+        loop->registrations = registrations;
+        loop->size = size;
+    }
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(loop->epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+        perror("Cannot watch file descriptor");
+        return -1;
+    }
+    loop->registrations[fd].handler = handler;
+    loop->registrations[fd].arg = arg;
+    debug("Watching file descriptor %d\n", fd);
+    return 0;
+}
+
+void event_loop_remove(event_loop loop, int fd) {
+    epoll_ctl(loop->epoll, EPOLL_CTL_DEL, fd, NULL);
+    if (fd < loop->size)
+        loop->registrations[fd].handler = NULL;
+    debug("No longer watching file descriptor %d\n", fd);
+}
+
+void event_loop_run(event_loop loop) {
+    struct epoll_event events[MAX_EVENTS];
+    struct registration *registration;
+    uint64_t count;
+    int i, n, fd;
+
+    loop->running = 1;
+    while (loop->running) {
+        n = epoll_wait(loop->epoll, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("Event loop");
+            break;
+        }
+        for (i=0; i<n; i++) {
+            fd = events[i].data.fd;
+            if (fd == loop->control) {
+                /* Only used to wake the loop up, the stop request itself is
+                 * in loop->running */
+                if (read(loop->control, &count, sizeof(count)) < 0)
+                    debug("Nothing to read from the control descriptor\n");
+                continue;
+            }
+            /* The handler might have been removed by a previous handler of
+             * the same batch */
+            registration = &loop->registrations[fd];
+            if (registration->handler)
+                registration->handler(loop, fd, registration->arg);
+        }
+    }
+}
+
+void event_loop_stop(event_loop loop) {
+    uint64_t one = 1;
+
+    loop->running = 0;
+    if (write(loop->control, &one, sizeof(one)) < 0)
+        perror("Cannot stop event loop");
+}
@@ -0,0 +1,43 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#ifndef __EVENT_LOOP_H__
+#define __EVENT_LOOP_H__
+
+/* Single threaded I/O multiplexing: each registered file descriptor gets its
+ * handler called whenever it is ready to be read. Handlers are always called
+ * from the thread running event_loop_run, which is also the only thread
+ * allowed to add or remove descriptors. Other threads can only stop the
+ * loop, which is done through an internal control descriptor.
+ */
+typedef struct event_loop_data *event_loop;
+typedef void (*event_handler_t)(event_loop loop, int fd, void *arg);
+
+event_loop event_loop_create();
+void event_loop_destroy(event_loop loop);
+int event_loop_add(event_loop loop, int fd, event_handler_t handler,
+                   void *arg);
+void event_loop_remove(event_loop loop, int fd);
+void event_loop_run(event_loop loop);
+void event_loop_stop(event_loop loop);
+
+#endif
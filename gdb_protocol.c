@@ -21,195 +21,824 @@ Contact: Guillaume.Huard@imag.fr
 	 38401 Saint Martin d'Hres
 */
 #include <stdio.h>
-#include <assert.h>
 #include "gdb_protocol.h"
+#include "codec.h"
+#include "breakpoint.h"
+#include "tracepoint.h"
 #include "debug.h"
 #include "csapp.h"
 #include "util.h"
 #include "arm_core.h"
 #include "arm_constants.h"
 #include "trace.h"
+#include "trace_select.h"
 
-#define MAX_PACKET_SIZE 1024
+/* Largest packet exchanged with gdb, advertised in qSupported. Memory
+ * transfers are cut to fit into it. */
+#define GDB_PACKET_SIZE 0x10000
+/* Reply buffers start small and grow on demand */
+#define INITIAL_PACKET_SIZE 1024
+/* Room for a stop notification : "%Stop:", the stop reply and checksum */
+#define NOTIFICATION_SIZE 256
+
+/* Register numbers used by gdb for the arm target */
+#define GDB_SP   13
+#define GDB_LR   14
+#define GDB_PC   15
+#define GDB_FPS  24
+#define GDB_CPSR 25
+
+/* Target description given to gdb : only the registers the simulator really
+ * has. The cpsr keeps its legacy number so that p/P requests stay valid. */
+static const char target_xml[] =
+    "<?xml version=\"1.0\"?>\n"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+    "<target version=\"1.0\">\n"
+    "  <architecture>arm</architecture>\n"
+    "  <feature name=\"org.gnu.gdb.arm.core\">\n"
+    "    <reg name=\"r0\" bitsize=\"32\" type=\"uint32\"/>\n"
+    "    <reg name=\"r1\" bitsize=\"32\" type=\"uint32\"/>\n"
+    "    <reg name=\"r2\" bitsize=\"32\" type=\"uint32\"/>\n"
+    "    <reg name=\"r3\" bitsize=\"32\" type=\"uint32\"/>\n"
+    "    <reg name=\"r4\" bitsize=\"32\" type=\"uint32\"/>\n"
+    "    <reg name=\"r5\" bitsize=\"32\" type=\"uint32\"/>\n"
+    "    <reg name=\"r6\" bitsize=\"32\" type=\"uint32\"/>\n"
+    "    <reg name=\"r7\" bitsize=\"32\" type=\"uint32\"/>\n"
+    "    <reg name=\"r8\" bitsize=\"32\" type=\"uint32\"/>\n"
+    "    <reg name=\"r9\" bitsize=\"32\" type=\"uint32\"/>\n"
+    "    <reg name=\"r10\" bitsize=\"32\" type=\"uint32\"/>\n"
+    "    <reg name=\"r11\" bitsize=\"32\" type=\"uint32\"/>\n"
+    "    <reg name=\"r12\" bitsize=\"32\" type=\"uint32\"/>\n"
+    "    <reg name=\"sp\" bitsize=\"32\" type=\"data_ptr\"/>\n"
+    "    <reg name=\"lr\" bitsize=\"32\"/>\n"
+    "    <reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>\n"
+    "    <reg name=\"cpsr\" bitsize=\"32\" regnum=\"25\"/>\n"
+    "  </feature>\n"
+    "</target>\n";
+
+/* The whole simulated memory is writable (programs are loaded by gdb into
+ * what the linker script calls rom), so it is described as a single ram
+ * region. The size is only known at run time. */
+static const char memory_map_format[] =
+    "<?xml version=\"1.0\"?>\n"
+    "<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\""
+    " \"http://sourceware.org/gdb/gdb-memory-map.dtd\">\n"
+    "<memory-map>\n"
+    "  <memory type=\"ram\" start=\"0x0\" length=\"0x%zx\"/>\n"
+    "</memory-map>\n";
+
+/* In non-stop mode, the target may run between requests */
+enum run_state { STOPPED, CONTINUING, RANGE_STEPPING };
 
 struct gdb_protocol_data {
     arm_core arm;
     memory mem;
     int target_exception;
-    int fd;
-    pthread_mutex_t *lock;
-    char packet[MAX_PACKET_SIZE];
+    /* Non-stop mode (QNonStop:1) : resume requests are acknowledged at once
+     * and the target runs while the following requests are handled, between
+     * two instructions. Stops are reported by %Stop notifications */
+    int non_stop;
+    enum run_state state;
+    uint32_t range_start, range_end;
+    /* Whether the last stop comes from a vCont;t request */
+    int interrupted;
+    char notification[NOTIFICATION_SIZE];
+    /* Whether the last execution stopped on a breakpoint */
+    int breakpoint_hit;
+    /* Breakpoints inserted by Z packets */
+    breakpoint_table breakpoints;
+    /* Tracepoints defined by QTDP packets */
+    tracepoint_set tracepoints;
+    /* Trace frame selected by QTFrame, -1 when looking at the live target.
+     * Register and memory requests are then answered from the frame. */
+    int trace_frame;
+    /* What agent expressions of breakpoints are evaluated against */
+    struct agent_context context;
+    connection conn;
+    /* Once QStartNoAckMode has been negotiated, no ack is exchanged */
+    int no_ack;
+    /* The ack of a request is sent along with the reply (in front of the
+     * packet, hence the extra byte), in a single write. Resume requests,
+     * whose reply only comes once the target stops, are acknowledged
+     * before it runs so that gdb does not retransmit them */
+    int ack_pending;
+    /* Once gdb has read target.xml, g/G only carry the registers it
+     * describes, otherwise the legacy layout (with fpa registers) is used */
+    int target_described;
+    char memory_map[sizeof(memory_map_format)+16];
+    /* End of the request being handled, binary data may contain '\0' */
+    char *request_end;
+    char *frame;
+    size_t capacity;
+    char *packet;
     int len;
     char *buffer;
+    /* Raw bytes read from the memory for m/x requests */
+    uint8_t *block;
+    size_t block_capacity;
 };
 
 typedef void (*gdb_handler_t)(gdb_protocol_data_t, char *);
 static gdb_handler_t handler[256];
 
 static void gdb_send_ack(gdb_protocol_data_t gdb) {
-    Rio_writen(gdb->fd, "+", 1);
+    if (!gdb->no_ack)
+        gdb->ack_pending = 1;
 }
 
-static void gdb_send_buffer(gdb_protocol_data_t gdb) {
-    unsigned char check=0;
-    int i;
+static void gdb_flush_ack(gdb_protocol_data_t gdb) {
+    if (gdb->ack_pending) {
+        connection_write(gdb->conn, "+", 1);
+        gdb->ack_pending = 0;
+    }
+}
+
+/* Makes sure the reply buffer can hold a payload of size bytes. Returns 0
+ * if it cannot be grown, the current buffer being kept. */
+static int gdb_reserve(gdb_protocol_data_t gdb, size_t size) {
+    size_t capacity;
+    char *frame;
+
+    /* Pending ack, '$', payload, '#', checksum and final '\0' */
+    size += 6;
+    if (size <= gdb->capacity)
+        return 1;
+    capacity = gdb->capacity;
+    while (capacity < size)
+        capacity *= 2;
+    frame = realloc(gdb->frame, capacity);
+    if (frame == NULL)
+        return 0;
+    gdb->frame = frame;
+    gdb->capacity = capacity;
+    gdb->packet = gdb->frame+1;
+    gdb->buffer = gdb->packet+1;
+    return 1;
+}
+
+/* Sends the size bytes of payload already in the buffer, which may contain
+ * binary data */
+static void gdb_send_payload(gdb_protocol_data_t gdb, size_t size) {
+    uint8_t check;
 
     gdb->packet[0] = '$';
-    i = 1;
-    while (gdb->packet[i] != '\0') {
-        check += gdb->packet[i];
-        i++;
-    }
-    gdb->packet[i++] = '#';
-    sprintf(gdb->packet+i, "%02x", check);
-    i += 2;
-    gdb->packet[i] = '\0';
-    gdb->len = i;
+    gdb->buffer[size] = '#';
+    check = codec_checksum(gdb->buffer, size);
+    codec_hex_encode(gdb->buffer + size + 1, &check, 1);
+    gdb->buffer[size+3] = '\0';
+    gdb->len = size + 4;
     gdb_transmit_packet(gdb);
 }
 
+static void gdb_send_buffer(gdb_protocol_data_t gdb) {
+    gdb_send_payload(gdb, strlen(gdb->buffer));
+}
+
 static void gdb_send_data(gdb_protocol_data_t gdb, char *data) {
+    if (!gdb_reserve(gdb, strlen(data)))
+        data = "E03";
     strcpy(gdb->buffer, data);
     gdb_send_buffer(gdb);
 }
 
-/* Read and write to/from a string of bytes (in hexadecimal) in local byte
+/* Escapes size bytes of binary data from source into destination, which
+ * must have room for twice that size. Returns the escaped size. */
+static size_t escape_binary(char *destination, const uint8_t *source,
+                            size_t size) {
+    char *position = destination;
+    uint8_t c;
+
+    while (size--) {
+        c = *source++;
+        if ((c == '#') || (c == '$') || (c == '}') || (c == '*')) {
+            *position++ = '}';
+            c ^= 0x20;
+        }
+        *position++ = c;
+    }
+    return position - destination;
+}
+
+/* Removes in place the escaping of the binary data from data to end.
+ * Returns the size of the unescaped data. */
+static size_t unescape_binary(char *data, char *end) {
+    char *position = data, *source = data;
+
+    while (source < end) {
+        if ((*source == '}') && (source + 1 < end)) {
+            source++;
+            *position++ = *source++ ^ 0x20;
+        } else {
+            *position++ = *source++;
+        }
+    }
+    return position - data;
+}
+
+/* Read and write to/from a string of bytes (in hexadecimal) in target byte
  * order */
 static uint32_t read_uint32(char *data) {
-    unsigned int i, step, value;
-    int target_big_endian;
-    union {
-        unsigned char bytes[4];
-        uint32_t integer;
-    } mem;
+    uint8_t bytes[4] = { 0 };
 
+    codec_hex_decode(bytes, data, 4);
     #ifdef BIG_ENDIAN_SIMULATOR
-        target_big_endian = 1;
+        return ((uint32_t) bytes[0] << 24) | ((uint32_t) bytes[1] << 16) |
+               ((uint32_t) bytes[2] << 8) | bytes[3];
     #else
-        target_big_endian = 0;
+        return ((uint32_t) bytes[3] << 24) | ((uint32_t) bytes[2] << 16) |
+               ((uint32_t) bytes[1] << 8) | bytes[0];
     #endif
-
-    if (is_big_endian() == target_big_endian) {
-        i = 0;
-        step = 1;
-    } else {
-        i = 3;
-        step = -1;
-    }
-
-    for (; (i<4) && (i>=0); i+=step) {
-        sscanf(data, "%02x", &value);
-        mem.bytes[i] = value;
-        data += 2;
-    }
-    return mem.integer;
 }
 
 static void write_uint32(char *data, uint32_t value) {
-    unsigned int i, step;
-    int target_big_endian;
-    union {
-        unsigned char bytes[4];
-        uint32_t integer;
-    } mem;
-
-    mem.integer = value;
+    uint8_t bytes[4];
+    int i;
+
+    for (i=0; i<4; i++) {
     #ifdef BIG_ENDIAN_SIMULATOR
-        target_big_endian = 1;
+        bytes[i] = value >> (24 - 8*i);
     #else
-        target_big_endian = 0;
+        bytes[i] = value >> (8*i);
     #endif
-
-    if (is_big_endian() == target_big_endian) {
-        i = 0;
-        step = 1;
-    } else {
-        i = 3;
-        step = -1;
     }
+    data += codec_hex_encode(data, bytes, 4);
+    *data = '\0';
+}
+
+/* Value of a register using gdb numbering, the pc is seen by gdb as the
+ * address of the next instruction to execute */
+static uint32_t read_gdb_register(gdb_protocol_data_t gdb, unsigned int reg) {
+    uint32_t value;
 
-    for (; (i<4) && (i>=0); i+=step) {
-        sprintf(data, "%02x", mem.bytes[i]);
-        data += 2;
+    trace_disable();
+    if (reg == GDB_CPSR) {
+        value = arm_read_cpsr(gdb->arm);
+    } else {
+        value = arm_read_register(gdb->arm, reg);
+        if (reg == GDB_PC)
+            value -= 4;
     }
-    *data = '\0';
+    trace_enable();
+    return value;
 }
 
-/* Handling of exception raised in target */
-void gdb_send_stop_reason(gdb_protocol_data_t gdb) {
-    switch (gdb->target_exception) {
+/* Writes the stop reply into position. Registers are sent along with it, so
+ * that gdb does not have to ask for them on most stops */
+static void format_stop_reason(gdb_protocol_data_t gdb, char *position) {
+    static const int expedited[] = { 0, 1, 2, 3, GDB_SP, GDB_LR, GDB_PC,
+                                     GDB_CPSR };
+    int signal, i;
+
+    switch (gdb->interrupted ? -1 : gdb->target_exception) {
+      case -1:
+        signal = 0;
+        break;
       case UNDEFINED_INSTRUCTION:
-        gdb_send_data(gdb, "S04");
+        signal = 0x04;
         break;
       case PREFETCH_ABORT:
       case DATA_ABORT:
-        gdb_send_data(gdb, "S10");
+        signal = 0x10;
         break;
       default:
-        gdb_send_data(gdb, "S05");
+        signal = 0x05;
     }
+    position += sprintf(position, "T%02x", signal);
+    for (i=0; i<sizeof(expedited)/sizeof(expedited[0]); i++) {
+        position += sprintf(position, "%02x:", expedited[i]);
+        write_uint32(position, read_gdb_register(gdb, expedited[i]));
+        position += 8;
+        *position++ = ';';
+    }
+    /* In non-stop mode, gdb wants to know which thread stopped */
+    if (gdb->non_stop)
+        position += sprintf(position, "thread:1;");
+    if (gdb->breakpoint_hit)
+        strcpy(position, "swbreak:;");
+    else
+        *position = '\0';
 }
 
-/* GDB Protocol commands handlers */
+/* Handling of exception raised in target */
+void gdb_send_stop_reason(gdb_protocol_data_t gdb) {
+    format_stop_reason(gdb, gdb->buffer);
+    gdb_send_buffer(gdb);
+}
 
-static void cont(gdb_protocol_data_t gdb, char *data) {
+/* Non-stop mode : the target has stopped on its own, gdb is told with a
+ * notification, which is neither acknowledged nor retransmitted */
+static void gdb_notify_stop(gdb_protocol_data_t gdb) {
+    size_t size;
+    uint8_t check;
+
+    gdb->state = STOPPED;
+    gdb_flush_ack(gdb);
+    strcpy(gdb->notification, "%Stop:");
+    format_stop_reason(gdb, gdb->notification + 6);
+    size = strlen(gdb->notification + 1);
+    check = codec_checksum(gdb->notification + 1, size);
+    gdb->notification[size+1] = '#';
+    codec_hex_encode(gdb->notification + size + 2, &check, 1);
+    debug("Sending notification: %s\n", gdb->notification);
+    connection_write(gdb->conn, gdb->notification, size + 4);
+}
+
+/* Execution control */
+
+/* Address of the next instruction to execute, as seen by gdb */
+static uint32_t read_pc(gdb_protocol_data_t gdb) {
+    uint32_t r15;
+
+    trace_disable();
+    r15 = arm_read_register(gdb->arm, 15) - 4;
+    trace_enable();
+    return r15;
+}
+
+static int at_breakpoint(gdb_protocol_data_t gdb) {
+    uint32_t instruction, pc;
+
+    /* We read in anticipation the next instruction to handle our special
+     * cases
+     */
+    pc = read_pc(gdb);
+    trace_disable();
+    (void) arm_read_word(gdb->arm, pc, &instruction);
+    trace_enable();
+    /* This is a breakpoint, we will not execute it because we don't
+     * know whether exceptions are properly implemented or not.
+     * At this point gdb should replace the offending instruction by
+     * the original one. This is hack but should perform better than
+     * other solution because of its few assumptions.
+     */
+    return (instruction & 0xFFF000F0) == 0xE7F000F0;
+}
+
+/* Whether the execution should stop before the next instruction: gdb's
+ * breakpoint instruction or a breakpoint of the table whose condition holds */
+static int should_stop(gdb_protocol_data_t gdb) {
+    uint32_t pc;
+    int stop;
+
+    if (at_breakpoint(gdb))
+        return 1;
+    pc = read_pc(gdb);
+    trace_disable();
+    stop = breakpoint_check(gdb->breakpoints, pc, &gdb->context);
+    trace_enable();
+    return stop;
+}
+
+static void execute_instruction(gdb_protocol_data_t gdb) {
+    uint32_t pc;
+
+    /* Tracepoints are hit when their instruction is about to execute */
+    if (tracepoint_running(gdb->tracepoints)) {
+        pc = read_pc(gdb);
+        trace_disable();
+        tracepoint_collect(gdb->tracepoints, pc, &gdb->context);
+        trace_enable();
+    }
+    gdb->breakpoint_hit = 0;
+    gdb->target_exception = arm_step(gdb->arm);
+    trace_arm_state(gdb->arm);
+}
+
+static void run(gdb_protocol_data_t gdb) {
     /* When the simulator doesn't implement breakpoints (as it is the case
      * here), gdb implements soft breakpoints by placing an architecturally
      * undefined instruction at breakpoint position. Thus we implement the
      * continue command as a loop that waits for this instruction.
+     * Breakpoints inserted with Z packets are checked along with it, except
+     * at the resume address : a breakpoint there has already been reported,
+     * it is stepped over.
      */
-    uint32_t instruction, r15;
-    int end = 0;
+    if (!at_breakpoint(gdb))
+        execute_instruction(gdb);
+    while (!should_stop(gdb))
+        execute_instruction(gdb);
+    gdb->breakpoint_hit = 1;
+}
 
-    while (!end) {
-        /* We read in anticipation the next instruction to handle our special
-         * cases
-         */
-        trace_disable();
-        r15 = arm_read_register(gdb->arm, 15) - 4;
-        (void) arm_read_word(gdb->arm, r15, &instruction);
-        trace_enable(); 
-        switch (instruction & 0xFFF000F0) {
-          case 0xE7F000F0:
-            /* This is a breakpoint, we will not execute it because we don't
-             * know whether exceptions are properly implemented or not.
-             * At this point gdb should replace the offending instruction by
-             * the original one. This is hack but should perform better than
-             * other solution because of its few assumptions.
-             */
-            end = 1;
-            break;
-          default:
-            gdb->target_exception = arm_step(gdb->arm);
-            trace_arm_state(gdb->arm);
+/* Steps at least once, then as long as the pc stays within [start, end) */
+static void run_range(gdb_protocol_data_t gdb, uint32_t start, uint32_t end) {
+    uint32_t pc;
+    int stop;
+
+    do {
+        execute_instruction(gdb);
+        pc = read_pc(gdb);
+        /* Evaluated once, conditions may be costly */
+        stop = should_stop(gdb);
+    } while ((pc >= start) && (pc < end) && !stop);
+    gdb->breakpoint_hit = stop;
+}
+
+/* Non-stop mode : resumes the target, which then runs from
+ * gdb_background_run. As in run and run_range, the first instruction is
+ * executed right away, a breakpoint at the resume address has already been
+ * reported. A single step is over at once. */
+static void resume_in_background(gdb_protocol_data_t gdb, enum run_state state,
+                                 int single_step) {
+    gdb->interrupted = 0;
+    if (single_step || (state == RANGE_STEPPING) || !at_breakpoint(gdb))
+        execute_instruction(gdb);
+    gdb->state = state;
+    gdb_send_data(gdb, "OK");
+    if (single_step)
+        gdb_notify_stop(gdb);
+}
+
+void gdb_background_run(gdb_protocol_data_t gdb) {
+    uint32_t pc;
+    int stop;
+
+    while ((gdb->state != STOPPED) && !connection_has_input(gdb->conn)) {
+        stop = should_stop(gdb);
+        if (gdb->state == RANGE_STEPPING) {
+            pc = read_pc(gdb);
+            if ((pc < gdb->range_start) || (pc >= gdb->range_end)) {
+                gdb->breakpoint_hit = stop;
+                gdb_notify_stop(gdb);
+                return;
+            }
+        }
+        if (stop) {
+            gdb->breakpoint_hit = 1;
+            gdb_notify_stop(gdb);
+            return;
         }
+        execute_instruction(gdb);
     }
+}
+
+/* GDB Protocol commands handlers */
 
+static void cont(gdb_protocol_data_t gdb, char *data) {
+    if (gdb->non_stop) {
+        resume_in_background(gdb, CONTINUING, 0);
+        return;
+    }
+    gdb_flush_ack(gdb);
+    run(gdb);
     gdb_send_stop_reason(gdb);
 }
 
 static void kill_request(gdb_protocol_data_t gdb, char *data) {
-    shutdown(gdb->fd, SHUT_WR);
+    gdb_flush_ack(gdb);
+    connection_shutdown(gdb->conn);
+}
+
+/* QTFrame:n, QTFrame:pc:addr, QTFrame:tdp:t, QTFrame:range:start:end and
+ * QTFrame:outside:start:end : searches start after the selected frame */
+static void select_trace_frame(gdb_protocol_data_t gdb, char *data) {
+    unsigned int start = 0, end = UINT32_MAX, number = 0;
+    int frame, count, tracepoint = 0, inside = 1, by_number = 0;
+    uint32_t address;
+
+    count = tracepoint_frame_count(gdb->tracepoints);
+    frame = gdb->trace_frame + 1;
+    if (strncmp(data, "pc:", 3) == 0) {
+        start = end = strtoul(data+3, NULL, 16);
+    } else if (strncmp(data, "tdp:", 4) == 0) {
+        number = strtoul(data+4, NULL, 16);
+        by_number = 1;
+    } else if (strncmp(data, "range:", 6) == 0) {
+        sscanf(data+6, "%x:%x", &start, &end);
+    } else if (strncmp(data, "outside:", 8) == 0) {
+        sscanf(data+8, "%x:%x", &start, &end);
+        inside = 0;
+    } else {
+        /* Frame number, -1 to get back to the live target */
+        frame = strtoul(data, NULL, 16);
+        if (frame == -1) {
+            gdb->trace_frame = -1;
+            gdb_send_data(gdb, "OK");
+            return;
+        }
+        if ((frame >= 0) && (frame < count))
+            count = frame + 1;
+    }
+    for (; frame < count; frame++) {
+        tracepoint_frame_info(gdb->tracepoints, frame, &tracepoint, &address);
+        if (by_number ? (tracepoint == number) :
+            (((address >= start) && (address <= end)) == inside))
+            break;
+    }
+    if ((frame >= 0) && (frame < count)) {
+        gdb->trace_frame = frame;
+        sprintf(gdb->buffer, "F%xT%x", frame, tracepoint);
+        gdb_send_buffer(gdb);
+    } else {
+        gdb->trace_frame = -1;
+        gdb_send_data(gdb, "F-1");
+    }
+}
+
+/* QT packets : definition and control of tracepoints */
+static void trace_set(gdb_protocol_data_t gdb, char *data) {
+    unsigned int number, address;
+    int status = 0;
+
+    if (strcmp(data, "init") == 0) {
+        tracepoint_clear(gdb->tracepoints);
+        gdb->trace_frame = -1;
+    } else if (strncmp(data, "DP:", 3) == 0) {
+        status = tracepoint_define(gdb->tracepoints, data+3);
+    } else if (strncmp(data, "DV:", 3) == 0) {
+        status = tracepoint_define_variable(gdb->tracepoints, data+3);
+    } else if (strcmp(data, "Start") == 0) {
+        gdb->trace_frame = -1;
+        tracepoint_start(gdb->tracepoints);
+    } else if (strcmp(data, "Stop") == 0) {
+        tracepoint_stop(gdb->tracepoints);
+    } else if (strncmp(data, "Frame:", 6) == 0) {
+        select_trace_frame(gdb, data+6);
+        return;
+    } else if (strncmp(data, "Enable:", 7) == 0) {
+        status = (sscanf(data+7, "%x:%x", &number, &address) != 2) ? -1 :
+                 tracepoint_enable(gdb->tracepoints, number, address, 1);
+    } else if (strncmp(data, "Disable:", 8) == 0) {
+        status = (sscanf(data+8, "%x:%x", &number, &address) != 2) ? -1 :
+                 tracepoint_enable(gdb->tracepoints, number, address, 0);
+    } else if (strncmp(data, "Buffer:size:", 12) == 0) {
+        tracepoint_set_buffer_size(gdb->tracepoints,
+                                   strtol(data+12, NULL, 16));
+    } else if (strncmp(data, "Buffer:circular:", 16) == 0) {
+        /* Frames are never overwritten, tracing stops when the buffer is
+         * full */
+        status = (strtol(data+16, NULL, 16) == 0) ? 0 : -1;
+    } else if ((strncmp(data, "DPsrc:", 6) != 0) &&
+               (strncmp(data, "ro", 2) != 0) &&
+               (strncmp(data, "Notes:", 6) != 0) &&
+               (strncmp(data, "Disconnected:", 13) != 0)) {
+        /* Unsupported request, giving an empty answer. Sources, notes and
+         * read only ranges are accepted and ignored, gdb reads read only
+         * sections from the executable itself */
+        gdb_send_data(gdb, "");
+        return;
+    }
+    gdb_send_data(gdb, (status == -1) ? "E01" : "OK");
+}
+
+static void general_set(gdb_protocol_data_t gdb, char *data) {
+    if (data[0] == 'T') {
+        trace_set(gdb, data+1);
+    } else if ((strcmp(data, "NonStop:0") == 0) ||
+               (strcmp(data, "NonStop:1") == 0)) {
+        gdb->non_stop = data[8] == '1';
+        /* Back to all-stop, the target is stopped */
+        gdb->state = STOPPED;
+        debug("Non-stop mode %s\n", gdb->non_stop ? "on" : "off");
+        gdb_send_data(gdb, "OK");
+    } else if (strcmp(data, "StartNoAckMode") == 0) {
+        /* This reply is still acknowledged, the following ones will not */
+        gdb->no_ack = 1;
+        debug("Entering no ack mode\n");
+        gdb_send_data(gdb, "OK");
+    } else {
+        /* Unsupported setting, giving an empty answer */
+        gdb_send_data(gdb, "");
+    }
+}
+
+/* Answers a qXfer read request for document, data being "offset,length".
+ * Binary data is escaped, the reply is prefixed by 'l' for the last part of
+ * the document and 'm' otherwise. */
+static void send_document(gdb_protocol_data_t gdb, const char *document,
+                          char *data) {
+    size_t size, offset, length;
+
+    size = strlen(document);
+    if (sscanf(data, "%zx,%zx", &offset, &length) != 2) {
+        gdb_send_data(gdb, "E01");
+        return;
+    }
+    if (offset > size)
+        offset = size;
+    if (length > size - offset)
+        length = size - offset;
+    if (length > GDB_PACKET_SIZE/2 - 1)
+        length = GDB_PACKET_SIZE/2 - 1;
+    if (!gdb_reserve(gdb, 2*length + 1)) {
+        gdb_send_data(gdb, "E03");
+        return;
+    }
+
+    gdb->buffer[0] = (offset + length < size) ? 'm' : 'l';
+    gdb_send_payload(gdb, 1 + escape_binary(gdb->buffer + 1,
+                     (const uint8_t *) document + offset, length));
+}
+
+/* qCRC:address,length, lets gdb check that the memory already holds a
+ * program (compare-sections) instead of loading it again */
+static void memory_crc(gdb_protocol_data_t gdb, char *data) {
+    unsigned int address, length, size;
+    uint8_t chunk[4096];
+    uint32_t crc = 0xffffffff;
+
+    if ((sscanf(data, "%x,%x", &address, &length) != 2) ||
+        (address > memory_get_size(gdb->mem)) ||
+        (length > memory_get_size(gdb->mem) - address)) {
+        gdb_send_data(gdb, "E01");
+        return;
+    }
+    while (length) {
+        size = min(length, sizeof(chunk));
+        memory_read_block(gdb->mem, address, size, chunk);
+        crc = codec_crc32(chunk, size, crc);
+        address += size;
+        length -= size;
+    }
+    sprintf(gdb->buffer, "C%08x", crc);
+    gdb_send_buffer(gdb);
+}
+
+/* qSearch:memory:address;length;pattern, the pattern being binary data */
+static void search_memory(gdb_protocol_data_t gdb, char *data) {
+    unsigned int address, length;
+    uint32_t found;
+    char *pattern;
+    size_t size;
+
+    pattern = index(data, ';');
+    if (pattern)
+        pattern = index(pattern+1, ';');
+    if ((sscanf(data, "%x;%x;", &address, &length) != 2) || !pattern) {
+        gdb_send_data(gdb, "E01");
+        return;
+    }
+    pattern++;
+    size = unescape_binary(pattern, gdb->request_end);
+    switch (memory_search(gdb->mem, address, length, (uint8_t *) pattern,
+                          size, &found)) {
+      case 1:
+        sprintf(gdb->buffer, "1,%x", found);
+        gdb_send_buffer(gdb);
+        break;
+      case 0:
+        gdb_send_data(gdb, "0");
+        break;
+      default:
+        gdb_send_data(gdb, "E01");
+    }
+}
+
+/* qT packets : state of tracing */
+static void trace_query(gdb_protocol_data_t gdb, char *data) {
+    unsigned int number, address;
+    uint64_t hits, size;
+    int64_t value;
+
+    if (strcmp(data, "Status") == 0) {
+        tracepoint_status(gdb->tracepoints, gdb->buffer);
+        gdb_send_buffer(gdb);
+    } else if (sscanf(data, "P:%x:%x", &number, &address) == 2) {
+        if (tracepoint_usage(gdb->tracepoints, number, address, &hits, &size)
+            == -1) {
+            gdb_send_data(gdb, "E01");
+            return;
+        }
+        sprintf(gdb->buffer, "V%llx:%llx", (unsigned long long) hits,
+                (unsigned long long) size);
+        gdb_send_buffer(gdb);
+    } else if (sscanf(data, "V:%x", &number) == 1) {
+        if (tracepoint_variable(gdb->tracepoints, number, &value) == -1) {
+            gdb_send_data(gdb, "U");
+            return;
+        }
+        sprintf(gdb->buffer, "V%llx", (unsigned long long) value);
+        gdb_send_buffer(gdb);
+    } else if ((strcmp(data, "fP") == 0) || (strcmp(data, "sP") == 0) ||
+               (strcmp(data, "fV") == 0) || (strcmp(data, "sV") == 0)) {
+        /* Tracepoints and variables are not uploaded to gdb, it defined
+         * them */
+        gdb_send_data(gdb, "l");
+    } else {
+        gdb_send_data(gdb, "");
+    }
+}
+
+/* qRcmd,command : monitor command, given in hexadecimal. Only "trace ..."
+ * is known (see trace_select.h), its output is sent back in hexadecimal */
+static void monitor(gdb_protocol_data_t gdb, char *data) {
+    char command[256], answer[1024];
+    size_t length;
+
+    length = strlen(data) / 2;
+    if ((length >= sizeof(command)) ||
+        (codec_hex_decode((uint8_t *) command, data, length) == -1)) {
+        gdb_send_data(gdb, "E01");
+        return;
+    }
+    command[length] = '\0';
+    if ((strncmp(command, "trace", 5) == 0) &&
+        ((command[5] == ' ') || (command[5] == '\0')))
+        trace_select_command(command + 5, answer, sizeof(answer));
+    else
+        sprintf(answer, "Unknown monitor command, try trace status\n");
+    if (answer[0] == '\0') {
+        gdb_send_data(gdb, "OK");
+        return;
+    }
+    length = strlen(answer);
+    if (!gdb_reserve(gdb, 2*length + 1)) {
+        gdb_send_data(gdb, "E03");
+        return;
+    }
+    gdb_send_payload(gdb, codec_hex_encode(gdb->buffer,
+                                           (const uint8_t *) answer, length));
 }
 
 static void query(gdb_protocol_data_t gdb, char *data) {
-    if (strcmp(data, "Offsets") == 0)
+    if (strncmp(data, "CRC:", 4) == 0)
+        memory_crc(gdb, data+4);
+    else if (strncmp(data, "Search:memory:", 14) == 0)
+        search_memory(gdb, data+14);
+    else if (strncmp(data, "Xfer:features:read:target.xml:", 30) == 0) {
+        gdb->target_described = 1;
+        send_document(gdb, target_xml, data+30);
+    } else if (strncmp(data, "Xfer:memory-map:read::", 22) == 0)
+        send_document(gdb, gdb->memory_map, data+22);
+    else if (strncmp(data, "Xfer:", 5) == 0)
+        /* Unknown object or annex */
+        gdb_send_data(gdb, "E00");
+    else if (gdb->non_stop && (strcmp(data, "fThreadInfo") == 0))
+        /* A single thread, gdb needs to know its id in non-stop mode */
+        gdb_send_data(gdb, "m1");
+    else if (gdb->non_stop && (strcmp(data, "sThreadInfo") == 0))
+        gdb_send_data(gdb, "l");
+    else if (gdb->non_stop && (strcmp(data, "C") == 0))
+        gdb_send_data(gdb, "QC1");
+    else if (strcmp(data, "Offsets") == 0)
         gdb_send_data(gdb, "Text=0;Data=0;Bss=0");
-    else if (strncmp(data, "Supported", 9) == 0)
-        gdb_send_data(gdb, "PacketSize=400");
-    else if (strcmp(data, "TStatus") == 0)
-        gdb_send_data(gdb, "T0;tnotrun:0");
+    else if (strncmp(data, "Supported", 9) == 0) {
+        sprintf(gdb->buffer, "PacketSize=%x;QStartNoAckMode+;swbreak+;"
+                "binary-upload+;qXfer:features:read+;qXfer:memory-map:read+;"
+                "ConditionalBreakpoints+;BreakpointCommands+;"
+                "ConditionalTracepoints+;TraceStateVariables+;tracenz+;"
+                "QTBuffer:size+;EnableDisableTracepoints+;"
+                "TracepointSource+",
+                GDB_PACKET_SIZE);
+        gdb_send_buffer(gdb);
+    }
+    else if (data[0] == 'T')
+        trace_query(gdb, data+1);
     else if (strcmp(data, "Symbol::") == 0)
         gdb_send_data(gdb, "");
+    else if (strncmp(data, "Rcmd,", 5) == 0)
+        monitor(gdb, data+5);
     else
         /* Unsupported query, giving an empty answer */
         gdb_send_data(gdb, "");
 }
 
+/* Registers of the selected trace frame, r0..r15 then cpsr, in registers.
+ * Returns 0 if they have not been collected : only the pc is known then
+ * (the address of the tracepoint) */
+static int read_frame_registers(gdb_protocol_data_t gdb, uint32_t *registers)
+{
+    int tracepoint;
+
+    if (tracepoint_frame_registers(gdb->tracepoints, gdb->trace_frame,
+                                   registers) == 0)
+        return 1;
+    tracepoint_frame_info(gdb->tracepoints, gdb->trace_frame, &tracepoint,
+                          &registers[GDB_PC]);
+    return 0;
+}
+
+static void read_frame_general_registers(gdb_protocol_data_t gdb) {
+    uint32_t registers[17];
+    char *position;
+    int i, collected;
+
+    collected = read_frame_registers(gdb, registers);
+    position = gdb->buffer;
+    for (i=0; i<17; i++) {
+        if ((i == 16) && !gdb->target_described) {
+            /* Floating point registers f0..f7 and fps */
+            memset(position, 'x', 8 * (8*3 + 1));
+            position += 8 * (8*3 + 1);
+        }
+        if (collected || (i == GDB_PC))
+            write_uint32(position, registers[i]);
+        else
+            memset(position, 'x', 8);
+        position += 8;
+    }
+    *position = '\0';
+    gdb_send_buffer(gdb);
+}
+
 static void read_general_registers(gdb_protocol_data_t gdb, char *data) {
     char *position;
     int i, j;
 
+    if (gdb->trace_frame >= 0) {
+        read_frame_general_registers(gdb);
+        return;
+    }
     trace_disable();
     position = gdb->buffer;
     /* General register r0..r14 */
@@ -220,75 +849,307 @@ static void read_general_registers(gdb_protocol_data_t gdb, char *data) {
     /* Special case, the pc is one instruction in advance (before fetch) */
     write_uint32(position, arm_read_register(gdb->arm, i) - 4);
     position += 8;
-    /* Floating point register f0..f7 */
-    /* Not implemented */
-    for (i=0; i<8; i++) {
-        for (j=0; j<3; j++) {
-            sprintf(position,"xxxxxxxx");
-            position += 8;
+    if (!gdb->target_described) {
+        /* Floating point register f0..f7 */
+        /* Not implemented */
+        for (i=0; i<8; i++) {
+            for (j=0; j<3; j++) {
+                sprintf(position,"xxxxxxxx");
+                position += 8;
+            }
         }
+        /* Status registers */
+        /* fps not implemented */
+        sprintf(position,"xxxxxxxx");
+        position += 8;
     }
-    /* Status registers */
-    /* fps not implemented */
-    sprintf(position,"xxxxxxxx");
-    position += 8;
     write_uint32(position, arm_read_cpsr(gdb->arm));
     trace_enable();
     gdb_send_buffer(gdb);
 }
 
-static void read_memory(gdb_protocol_data_t gdb, char *data) {
+/* Makes sure gdb->block can hold size bytes, returns 0 on failure */
+static int gdb_reserve_block(gdb_protocol_data_t gdb, size_t size) {
+    uint8_t *block;
+
+    if (size > gdb->block_capacity) {
+        block = realloc(gdb->block, size);
+        if (block == NULL)
+            return 0;
+        gdb->block = block;
+        gdb->block_capacity = size;
+    }
+    return 1;
+}
+
+/* Reads the memory block requested by m and x packets into gdb->block. The
+ * block is cut at the end of the memory and so that its encoding (at most
+ * twice as large) fits into a packet, gdb asks for the rest afterwards.
+ * Returns the size read or -1 if nothing can be read. */
+static long read_block(gdb_protocol_data_t gdb, char *data) {
     unsigned int address, size;
-    char *position;
-    uint8_t value;
+    size_t memory_size;
 
-    sscanf(data,"%x,%x", &address, &size);
-    position = gdb->buffer;
-    position[0] = '\0';
-    while (size-- && (memory_read_byte(gdb->mem, address++, &value) != -1)) {
-        sprintf(position, "%02x", value);
-        position += 2;
+    if (sscanf(data,"%x,%x", &address, &size) != 2)
+        return -1;
+    memory_size = memory_get_size(gdb->mem);
+    if (address >= memory_size)
+        return size ? -1 : 0;
+    if (size > memory_size - address)
+        size = memory_size - address;
+    if (size > GDB_PACKET_SIZE/2 - 1)
+        size = GDB_PACKET_SIZE/2 - 1;
+    if (!gdb_reserve_block(gdb, size) || !gdb_reserve(gdb, 2*size + 1))
+        return -1;
+    if (gdb->trace_frame >= 0) {
+        /* Only what the tracepoint collected is available */
+        size = tracepoint_frame_memory(gdb->tracepoints, gdb->trace_frame,
+                                       address, size, gdb->block);
+        return size ? (long) size : -1;
     }
-    gdb_send_buffer(gdb);
+    if (memory_read_block(gdb->mem, address, size, gdb->block) == -1)
+        return -1;
+    return size;
+}
+
+static void read_memory(gdb_protocol_data_t gdb, char *data) {
+    long size;
+
+    size = read_block(gdb, data);
+    if (size < 0) {
+        gdb_send_data(gdb, "E01");
+        return;
+    }
+    gdb_send_payload(gdb, codec_hex_encode(gdb->buffer, gdb->block, size));
+}
+
+static void read_memory_binary(gdb_protocol_data_t gdb, char *data) {
+    long size;
+
+    size = read_block(gdb, data);
+    if (size < 0) {
+        gdb_send_data(gdb, "E01");
+        return;
+    }
+    gdb->buffer[0] = 'b';
+    gdb_send_payload(gdb, 1 + escape_binary(gdb->buffer + 1, gdb->block,
+                                            size));
 }
 
 static void read_register(gdb_protocol_data_t gdb, char *data) {
+    uint32_t registers[17];
     unsigned int reg;
-    reg = atoi(data);
-    assert(reg < 16);
-    trace_disable();
-    write_uint32(gdb->buffer, arm_read_register(gdb->arm, reg) -
-                              ((reg == 15) ? 4 : 0));
-    trace_enable();
-    gdb_send_buffer(gdb);
+
+    sscanf(data, "%x", &reg);
+    if ((gdb->trace_frame >= 0) && ((reg <= GDB_PC) || (reg == GDB_CPSR))) {
+        if (read_frame_registers(gdb, registers) || (reg == GDB_PC)) {
+            write_uint32(gdb->buffer, registers[(reg == GDB_CPSR) ? 16 : reg]);
+            gdb_send_buffer(gdb);
+        } else {
+            gdb_send_data(gdb, "xxxxxxxx");
+        }
+    } else if ((reg <= GDB_PC) || (reg == GDB_CPSR)) {
+        write_uint32(gdb->buffer, read_gdb_register(gdb, reg));
+        gdb_send_buffer(gdb);
+    } else if (reg < GDB_FPS) {
+        /* Floating point register f0..f7, not implemented */
+        gdb_send_data(gdb, "xxxxxxxxxxxxxxxxxxxxxxxx");
+    } else if (reg == GDB_FPS) {
+        gdb_send_data(gdb, "xxxxxxxx");
+    } else {
+        gdb_send_data(gdb, "E01");
+    }
 }
 
 static void reason(gdb_protocol_data_t gdb, char *data) {
-    gdb_send_stop_reason(gdb);
+    /* In non-stop mode, a running target has nothing to report. Otherwise
+     * gdb then fetches the other stops with vStopped, there are none */
+    if (gdb->non_stop && (gdb->state != STOPPED))
+        gdb_send_data(gdb, "OK");
+    else
+        gdb_send_stop_reason(gdb);
 }
 
 static void set_thread(gdb_protocol_data_t gdb, char *data) {
     char type = *data;
     int value = atoi(data+1);
 
-    // No threads, so support standard selection for any or all threads
-    if (((type == 'c') || (type == 'g')) && (value < 1) && (value > -2))
+    // No threads, so support standard selection for any or all threads, or
+    // for the single one reported in non-stop mode
+    if (((type == 'c') || (type == 'g')) && (value < 2) && (value > -2))
+        gdb_send_data(gdb, "OK");
+    else
+        gdb_send_data(gdb, "E01");
+}
+
+static void thread_alive(gdb_protocol_data_t gdb, char *data) {
+    if (strtol(data, NULL, 16) == 1)
         gdb_send_data(gdb, "OK");
     else
         gdb_send_data(gdb, "E01");
 }
 
 static void step(gdb_protocol_data_t gdb, char *data) {
-    gdb->target_exception = arm_step(gdb->arm);
-    trace_arm_state(gdb->arm);
+    if (gdb->non_stop) {
+        resume_in_background(gdb, STOPPED, 1);
+        return;
+    }
+    gdb_flush_ack(gdb);
+    execute_instruction(gdb);
     gdb_send_stop_reason(gdb);
 }
 
+/* There is a single thread, so the first action always applies to it, thread
+ * ids and signals are ignored */
+static void resume(gdb_protocol_data_t gdb, char *data) {
+    unsigned int start, end;
+
+    switch (*data) {
+      case 'c':
+      case 'C':
+        cont(gdb, data+1);
+        break;
+      case 's':
+      case 'S':
+        step(gdb, data+1);
+        break;
+      case 'r':
+        if (sscanf(data+1, "%x,%x", &start, &end) == 2) {
+            debug("Range stepping in [%08x, %08x)\n", start, end);
+            if (gdb->non_stop) {
+                gdb->range_start = start;
+                gdb->range_end = end;
+                resume_in_background(gdb, RANGE_STEPPING, 0);
+                break;
+            }
+            gdb_flush_ack(gdb);
+            run_range(gdb, start, end);
+            gdb_send_stop_reason(gdb);
+        } else {
+            gdb_send_data(gdb, "E01");
+        }
+        break;
+      case 't':
+        /* Stops a running target, gdb is told with a notification */
+        gdb_send_data(gdb, "OK");
+        if (gdb->state != STOPPED) {
+            gdb->interrupted = 1;
+            gdb->breakpoint_hit = 0;
+            gdb_notify_stop(gdb);
+        }
+        break;
+      default:
+        gdb_send_data(gdb, "E01");
+    }
+}
+
+/* Parses the agent expressions "Xlen,bytecode" following each other from
+ * *position and appends them to the count ones of list. Returns -1 if one
+ * of them is invalid. */
+static int parse_expressions(const char **position, agent_expr **list,
+                             int *count) {
+    agent_expr *grown;
+
+    while (**position == 'X') {
+        grown = realloc(*list, (*count+1) * sizeof(agent_expr));
+        if (grown == NULL)
+            return -1;
+        *list = grown;
+        (*list)[*count] = agent_expr_create(*position, position);
+        if ((*list)[*count] == NULL)
+            return -1;
+        (*count)++;
+    }
+    return 0;
+}
+
+static void free_expressions(agent_expr *list, int count) {
+    while (count--)
+        agent_expr_destroy(list[count]);
+    free(list);
+}
+
+/* Z0/Z1,address,kind[;Xlen,bytecode...][;cmds:persist,Xlen,bytecode...] :
+ * software and hardware breakpoints are the same for the simulator.
+ * Conditions are agent expressions, the execution stops when any of them is
+ * true. Commands (dynamic printf) are run instead of stopping, whether they
+ * persist once gdb disconnects does not matter, the server stops then. */
+static void insert_breakpoint(gdb_protocol_data_t gdb, char *data) {
+    unsigned int type, address, kind;
+    agent_expr *conditions = NULL, *commands = NULL;
+    int count = 0, command_count = 0, status = 0;
+    const char *position;
+
+    if ((sscanf(data, "%x,%x,%x", &type, &address, &kind) != 3) ||
+        (type > 1)) {
+        /* Watchpoints are not supported */
+        gdb_send_data(gdb, "");
+        return;
+    }
+    position = index(data, ';');
+    while (position && (*position == ';') && (status == 0)) {
+        position++;
+        if (strncmp(position, "cmds:", 5) == 0) {
+            /* Persistence flag, then the commands */
+            position = index(position, ',');
+            if (position == NULL) {
+                status = -1;
+            } else {
+                position++;
+                status = parse_expressions(&position, &commands,
+                                           &command_count);
+            }
+        } else {
+            status = parse_expressions(&position, &conditions, &count);
+        }
+    }
+    if ((status == -1) || (position && *position) ||
+        (breakpoint_insert(gdb->breakpoints, address, conditions, count,
+                           commands, command_count) == -1)) {
+        free_expressions(conditions, count);
+        free_expressions(commands, command_count);
+        gdb_send_data(gdb, "E01");
+        return;
+    }
+    gdb_send_data(gdb, "OK");
+}
+
+static void remove_breakpoint(gdb_protocol_data_t gdb, char *data) {
+    unsigned int type, address, kind;
+
+    if ((sscanf(data, "%x,%x,%x", &type, &address, &kind) != 3) ||
+        (type > 1)) {
+        gdb_send_data(gdb, "");
+        return;
+    }
+    /* Removing a breakpoint that does not exist is not an error for gdb */
+    breakpoint_remove(gdb->breakpoints, address);
+    gdb_send_data(gdb, "OK");
+}
+
+static void multiletter(gdb_protocol_data_t gdb, char *data) {
+    if (strcmp(data, "Cont?") == 0)
+        gdb_send_data(gdb, "vCont;c;C;s;S;r;t");
+    else if (strncmp(data, "Cont;", 5) == 0)
+        resume(gdb, data+5);
+    else if (strcmp(data, "Stopped") == 0)
+        /* The single thread stop has been reported in the notification */
+        gdb_send_data(gdb, "OK");
+    else
+        /* Unsupported request, giving an empty answer */
+        gdb_send_data(gdb, "");
+}
+
 static void write_general_registers(gdb_protocol_data_t gdb, char *data) {
     uint32_t value;
     char *position;
-    int i, j;
+    int i;
 
+    if (gdb->trace_frame >= 0) {
+        /* Trace frames are read only */
+        gdb_send_data(gdb, "E01");
+        return;
+    }
     trace_disable();
     position = data;
     /* General register r0..r15 */
@@ -300,24 +1161,10 @@ static void write_general_registers(gdb_protocol_data_t gdb, char *data) {
             debug_raw("\n");
         position += 8;
     }
-    /* Floating point register f0..f7 */
-    /* Not implemented */
-    for (i=0; i<8; i++) {
-        //printf("f%02d = ", i);
-        for (j=0; j<3; j++) {
-            value = read_uint32(position);
-            //printf("%08x", value);
-            position += 8;
-        }
-        //printf("   ");
-        //if (i % 2 == 1)
-            //printf("\n");
-    }
-    /* Status registers */
-    /* fps not implemented */
-    value = read_uint32(position);
-    //printf("fps = %08x   ", value);
-    position += 8;
+    /* Floating point registers f0..f7 and fps, only in the legacy layout */
+    /* Not implemented, skipped */
+    if (!gdb->target_described)
+        position += 8 * (8*3 + 1);
     value = read_uint32(position);
     arm_write_cpsr(gdb->arm, value);
     debug("cpsr = %08x\n", value);
@@ -326,26 +1173,58 @@ static void write_general_registers(gdb_protocol_data_t gdb, char *data) {
     gdb_send_data(gdb, "OK");
 }
 
+static void write_memory(gdb_protocol_data_t gdb, char *data) {
+    unsigned int address, size, i;
+    char *content;
+
+    if (gdb->trace_frame >= 0) {
+        gdb_send_data(gdb, "E01");
+        return;
+    }
+    content = index(data, ':');
+    if ((sscanf(data,"%x,%x", &address, &size) != 2) || (content == NULL) ||
+        (strlen(content+1) != 2*size) || !gdb_reserve_block(gdb, size) ||
+        (codec_hex_decode(gdb->block, content+1, size) == -1)) {
+        gdb_send_data(gdb, "E01");
+        return;
+    }
+    debug("Writing %d bytes at address %08x\n", size, address);
+    for (i=0; i<size; i++) {
+        if (memory_write_byte(gdb->mem, address+i, gdb->block[i]) == -1) {
+            gdb_send_data(gdb, "E02");
+            return;
+        }
+    }
+    gdb_send_data(gdb, "OK");
+}
+
 static void write_memory_binary(gdb_protocol_data_t gdb, char *data) {
     unsigned int address, size, i, write_ok;
     char *content;
     uint8_t value;
 
-    sscanf(data,"%x,%x", &address, &size);
-    content = index(data, ':') + 1;
+    if (gdb->trace_frame >= 0) {
+        gdb_send_data(gdb, "E01");
+        return;
+    }
+    content = index(data, ':');
+    if ((sscanf(data,"%x,%x", &address, &size) != 2) || !content) {
+        gdb_send_data(gdb, "E01");
+        return;
+    }
+    content++;
+    /* The data ends with the packet, not after size bytes */
+    if (unescape_binary(content, gdb->request_end) != size) {
+        gdb_send_data(gdb, "E01");
+        return;
+    }
     debug("Writing %d bytes at address %08x : ", size, address);
     write_ok = address < memory_get_size(gdb->mem);
     for (i=0; (i<size) && write_ok; i++) {
-        if (*content == 0x7d) {
-            content++;
-            value = *content ^ (char) 0x20;
-        } else {
-            value = *content;
-        }
+        value = content[i];
         write_ok = memory_write_byte(gdb->mem, address++, value) == 0;
         if (i<32)
             debug_raw("%02x", value);
-        content++;
     }
     debug_raw("...\n");
     if (write_ok)
@@ -357,12 +1236,23 @@ static void write_memory_binary(gdb_protocol_data_t gdb, char *data) {
 static void write_register(gdb_protocol_data_t gdb, char *data) {
     unsigned int reg, value;
 
+    if (gdb->trace_frame >= 0) {
+        gdb_send_data(gdb, "E01");
+        return;
+    }
     sscanf(data,"%x", &reg);
     data = index(data, '=') + 1;
     value = read_uint32(data);
-    assert(reg < 16);
+    if (reg > GDB_CPSR) {
+        gdb_send_data(gdb, "E01");
+        return;
+    }
     trace_disable();
-    arm_write_register(gdb->arm, reg, value);
+    if (reg == GDB_CPSR)
+        arm_write_cpsr(gdb->arm, value);
+    else if (reg <= GDB_PC)
+        arm_write_register(gdb->arm, reg, value);
+    /* Floating point registers are not implemented */
     trace_enable();
     debug("Writing %d to register %d\n", value, reg);
     gdb_send_data(gdb, "OK");
@@ -370,8 +1260,7 @@ static void write_register(gdb_protocol_data_t gdb, char *data) {
 
 /* End of GDB Protocol commands handlers */
 
-gdb_protocol_data_t gdb_init_data(arm_core arm, memory mem, int fd,
-                                  pthread_mutex_t *lock) {
+gdb_protocol_data_t gdb_init_data(arm_core arm, memory mem, connection conn) {
     gdb_protocol_data_t gdb;
 
     gdb = malloc(sizeof(struct gdb_protocol_data));
@@ -379,14 +1268,57 @@ gdb_protocol_data_t gdb_init_data(arm_core arm, memory mem, int fd,
         gdb->arm = arm;
         gdb->mem = mem;
         gdb->target_exception = 0;
-        gdb->fd = fd;
-        gdb->lock = lock;
+        gdb->non_stop = 0;
+        gdb->state = STOPPED;
+        gdb->interrupted = 0;
+        gdb->breakpoint_hit = 0;
+        gdb->conn = conn;
+        gdb->no_ack = 0;
+        gdb->ack_pending = 0;
+        gdb->target_described = 0;
+        snprintf(gdb->memory_map, sizeof(gdb->memory_map), memory_map_format,
+                 memory_get_size(mem));
         gdb->len = 0;
+        gdb->capacity = INITIAL_PACKET_SIZE;
+        gdb->frame = malloc(gdb->capacity);
+        if (gdb->frame == NULL) {
+            free(gdb);
+            return NULL;
+        }
+        gdb->packet = gdb->frame+1;
         gdb->buffer = gdb->packet+1;
+        gdb->block = NULL;
+        gdb->block_capacity = 0;
+        gdb->breakpoints = breakpoint_table_create(memory_get_size(mem));
+        gdb->tracepoints = tracepoint_set_create(memory_get_size(mem));
+        if ((gdb->breakpoints == NULL) || (gdb->tracepoints == NULL)) {
+            if (gdb->breakpoints)
+                breakpoint_table_destroy(gdb->breakpoints);
+            if (gdb->tracepoints)
+                tracepoint_set_destroy(gdb->tracepoints);
+            free(gdb->frame);
+            free(gdb);
+            return NULL;
+        }
+        gdb->trace_frame = -1;
+        memset(&gdb->context, 0, sizeof(gdb->context));
+        gdb->context.arm = arm;
+        gdb->context.mem = mem;
+        gdb->context.output = stdout;
+        /* Trace state variables can be used by breakpoint conditions too */
+        tracepoint_bind_variables(gdb->tracepoints, &gdb->context);
     }
     return gdb;
 }
 
+void gdb_destroy_data(gdb_protocol_data_t gdb) {
+    breakpoint_table_destroy(gdb->breakpoints);
+    tracepoint_set_destroy(gdb->tracepoints);
+    free(gdb->frame);
+    free(gdb->block);
+    free(gdb);
+}
+
 void gdb_init() {
     int i;
 
@@ -398,52 +1330,52 @@ void gdb_init() {
     handler['q'] = query;
     handler['g'] = read_general_registers;
     handler['m'] = read_memory;
+    handler['x'] = read_memory_binary;
     handler['p'] = read_register;
     handler['?'] = reason;
     handler['H'] = set_thread;
     handler['s'] = step;
+    handler['T'] = thread_alive;
     handler['G'] = write_general_registers;
+    handler['M'] = write_memory;
     handler['X'] = write_memory_binary;
+    handler['Z'] = insert_breakpoint;
+    handler['z'] = remove_breakpoint;
     handler['P'] = write_register;
+    handler['Q'] = general_set;
+    handler['v'] = multiletter;
 }
 
 void gdb_require_retransmission(gdb_protocol_data_t gdb) {
-    Rio_writen(gdb->fd, "-", 1);
+    /* Without acks, there is no way to ask for a retransmission, the
+     * offending packet is just dropped */
+    if (!gdb->no_ack)
+        connection_write(gdb->conn, "-", 1);
 }
 
 void gdb_packet_analysis(gdb_protocol_data_t gdb, char *packet, int length) {
-    int i;
-    unsigned char check=0;
-    unsigned int given;
     unsigned char index;
 
-    for (i=1; i<length-3; i++)
-        check += packet[i];
-    sscanf(packet+i+1, "%x", &given);
-    debug("Received packet : ");
-    debug_raw_binary(packet, min(16, strlen(packet)));
-    if (check == given) {
-        debug_raw(", checksum ok\n");
-        gdb_send_ack(gdb);
-    } else {
-        debug_raw(", checksum failed, expected %02x got %02x\n", given, check);
-        debug("Requiring retransmission\n");
-        gdb_require_retransmission(gdb);
-        return;
-    }
-    packet[i] = '\0';
-    index = packet[1];
+    gdb_send_ack(gdb);
+    index = packet[0];
+    gdb->request_end = packet + length;
     if (handler[index]) {
-        pthread_mutex_lock(gdb->lock);
-        handler[index](gdb, packet+2);
-        pthread_mutex_unlock(gdb->lock);
+        handler[index](gdb, packet+1);
     } else {
         debug("Unsupported request, sending empty answer\n");
         gdb_send_data(gdb, "");
     }
+    /* For requests without reply */
+    gdb_flush_ack(gdb);
 }
 
 void gdb_transmit_packet(gdb_protocol_data_t gdb) {
     debug("Transmitting packet: %s\n", gdb->packet);
-    Rio_writen(gdb->fd, gdb->packet, gdb->len);
+    if (gdb->ack_pending) {
+        gdb->frame[0] = '+';
+        connection_write(gdb->conn, gdb->frame, gdb->len+1);
+        gdb->ack_pending = 0;
+    } else {
+        connection_write(gdb->conn, gdb->packet, gdb->len);
+    }
 }
@@ -22,16 +22,21 @@ Contact: Guillaume.Huard@imag.fr
 */
 #ifndef __GDB_PROTOCOL_H__
 #define __GDB_PROTOCOL_H__
-#include <pthread.h>
 #include "arm.h"
+#include "connection.h"
 
 typedef struct gdb_protocol_data *gdb_protocol_data_t;
 
 void gdb_init();
-gdb_protocol_data_t gdb_init_data(arm_core arm, memory mem, int fd,
-                                  pthread_mutex_t *lock);
+gdb_protocol_data_t gdb_init_data(arm_core arm, memory mem, connection conn);
+void gdb_destroy_data(gdb_protocol_data_t gdb);
+/* packet is the payload of a frame whose checksum has already been checked,
+ * without the framing characters and terminated by a '\0' */
 void gdb_packet_analysis(gdb_protocol_data_t gdb, char *packet, int length);
 void gdb_transmit_packet(gdb_protocol_data_t gdb);
 void gdb_require_retransmission(gdb_protocol_data_t gdb);
+/* Non-stop mode : lets the target run until it stops or some input arrives
+ * from gdb. To be called before waiting for input. */
+void gdb_background_run(gdb_protocol_data_t gdb);
 
 #endif
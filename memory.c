@@ -21,9 +21,13 @@ Contact: Guillaume.Huard@imag.fr
 	 38401 Saint Martin d'H�res
 */
 #include <stdlib.h>
+#include <string.h>
 #include "memory.h"
 #include "util.h"
 #include <stdio.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 struct memory_data {
     size_t size;
@@ -32,7 +36,7 @@ struct memory_data {
 };
 
 memory memory_create(size_t size, int is_big_endian) {
-    memory mem = malloc(sizeof(memory));
+    memory mem = malloc(sizeof(struct memory_data));
 
     // size = nb octet
     mem->size = size;
@@ -46,11 +50,19 @@ memory memory_create(size_t size, int is_big_endian) {
     // exemple taille de 8 == [[11 22 33 44],[11 22 33 44]]
     // si size%4 != 0 ajout de 1 indice
     int oneMore = size%4 > 0 ? 1 : 0;
-    mem->data = malloc(sizeof(uint32_t) * (size/4 + oneMore));
+    mem->data = calloc(size/4 + oneMore, sizeof(uint32_t));
 
     return mem;
 }
 
+/* Brings the memory back to its initial state (all zeroes), used to reuse the
+ * same simulated memory from one gdb session to the next one.
+ */
+void memory_clear(memory mem) {
+    int oneMore = mem->size%4 > 0 ? 1 : 0;
+    memset(mem->data, 0, sizeof(uint32_t) * (mem->size/4 + oneMore));
+}
+
 size_t memory_get_size(memory mem) {
     return mem->size;
 }
@@ -161,6 +173,105 @@ int memory_write_word(memory mem, uint32_t address, uint32_t value) {
     return SUCCESS;
 }
 
+int memory_read_block(memory mem, uint32_t address, size_t size,
+                      uint8_t *buffer) {
+    size_t i;
+
+    if (address > mem->size || size > mem->size - address) {
+        return FAILURE;
+    }
+
+    if (is_big_endian()) {
+        for (i=0; i<size; i++) {
+            memory_read_byte(mem, address+i, &buffer[i]);
+        }
+    } else {
+        // Byte i of each word holds the byte at address%4 == i : on a little
+        // endian host the storage is already in address order
+        memcpy(buffer, (uint8_t *) mem->data + address, size);
+    }
+
+    return SUCCESS;
+}
+
+// Position of the first occurrence of pattern in data, NULL if none.
+// Candidates are the positions where both the first and the last byte of the
+// pattern match, 16 positions are checked at once with SSE2.
+static const uint8_t *find_pattern(const uint8_t *data, size_t size,
+                                   const uint8_t *pattern,
+                                   size_t pattern_size) {
+    const uint8_t *position, *end;
+    size_t i = 0;
+
+    if (pattern_size == 0) {
+        return data;
+    }
+    if (pattern_size > size) {
+        return NULL;
+    }
+
+#ifdef __SSE2__
+    __m128i first = _mm_set1_epi8(pattern[0]);
+    __m128i last = _mm_set1_epi8(pattern[pattern_size-1]);
+    for (; i + 16 <= size - pattern_size + 1; i += 16) {
+        __m128i starts = _mm_loadu_si128((const __m128i *) (data + i));
+        __m128i ends = _mm_loadu_si128(
+                           (const __m128i *) (data + i + pattern_size - 1));
+        unsigned mask = _mm_movemask_epi8(
+                            _mm_and_si128(_mm_cmpeq_epi8(starts, first),
+                                          _mm_cmpeq_epi8(ends, last)));
+        while (mask) {
+            position = data + i + __builtin_ctz(mask);
+            if (memcmp(position, pattern, pattern_size) == 0) {
+                return position;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    end = data + size - pattern_size + 1;
+    position = data + i;
+    while ((position = memchr(position, pattern[0], end - position))) {
+        if (memcmp(position, pattern, pattern_size) == 0) {
+            return position;
+        }
+        position++;
+    }
+    return NULL;
+}
+
+int memory_search(memory mem, uint32_t address, size_t size,
+                  const uint8_t *pattern, size_t pattern_size,
+                  uint32_t *found) {
+    const uint8_t *data, *position;
+    uint8_t *copy = NULL;
+
+    if (address >= mem->size) {
+        return FAILURE;
+    }
+    size = min(size, mem->size - address);
+
+    if (is_big_endian()) {
+        // Storage is not in address order, search a copy
+        copy = malloc(size);
+        if (copy == NULL) {
+            return FAILURE;
+        }
+        memory_read_block(mem, address, size, copy);
+        data = copy;
+    } else {
+        data = (uint8_t *) mem->data + address;
+    }
+
+    position = find_pattern(data, size, pattern, pattern_size);
+    if (position) {
+        *found = address + (position - data);
+    }
+    free(copy);
+    return position != NULL;
+}
+
 /*
 data = [
 [0 - 3]
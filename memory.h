@@ -32,6 +32,7 @@ typedef struct memory_data *memory;
 
 memory memory_create(size_t size, int is_big_endian);
 size_t memory_get_size(memory mem);
+void memory_clear(memory mem);
 void memory_destroy(memory mem);
 
 /* All these functions perform a read/write access to a byte/half/word data at
@@ -47,4 +48,19 @@ int memory_write_byte(memory mem, uint32_t address, uint8_t value);
 int memory_write_half(memory mem, uint32_t address, uint16_t value);
 int memory_write_word(memory mem, uint32_t address, uint32_t value);
 
+/* Copies size bytes starting at address into buffer, in increasing address
+ * order (as a debugger sees them). Fails if the range goes past the end of
+ * mem.
+ */
+int memory_read_block(memory mem, uint32_t address, size_t size,
+                      uint8_t *buffer);
+
+/* Looks for the first occurrence of the pattern of pattern_size bytes within
+ * the size bytes starting at address (cut at the end of mem). Returns 1 and
+ * sets found to its address if there is one, 0 otherwise, -1 on failure.
+ */
+int memory_search(memory mem, uint32_t address, size_t size,
+                  const uint8_t *pattern, size_t pattern_size,
+                  uint32_t *found);
+
 #endif
@@ -120,5 +120,45 @@ int main() {
     memory_write_half(m[1-is_big_endian()], 0, half_value);
     print_test(compare_with_sim(&half_value, m[1-is_big_endian()], 2, 1));
 
+    printf("Writing a word, then reading it back as a block of bytes, "
+           "the bytes should come in address order :\n");
+    for (i=0; i<2; i++) {
+        uint8_t block[4];
+
+        printf("- block read in a %s endian memory, ", endianess[i]);
+        memory_write_word(m[i], 0, word_value);
+        print_test((memory_read_block(m[i], 0, 4, block) == 0) &&
+                   compare_with_sim(block, m[i], 4, 0));
+    }
+    printf("- block read past the end of the memory, ");
+    print_test(memory_read_block(m[0], 2, 4, position) == -1);
+
+    printf("Searching patterns in a larger memory :\n");
+    {
+        uint8_t pattern[] = { 0xde, 0xad, 0xbe, 0xef };
+        uint32_t found;
+        memory large = memory_create(1000, 1);
+
+        // Partial matches before the real one, some of them on the first
+        // and last bytes only
+        memory_write_byte(large, 100, 0xde);
+        memory_write_byte(large, 103, 0xef);
+        for (i=0; i<4; i++) {
+            memory_write_byte(large, 200+i, pattern[i]);
+            memory_write_byte(large, 996+i, pattern[i]);
+        }
+        printf("- first occurrence, ");
+        print_test((memory_search(large, 0, 1000, pattern, 4, &found) == 1) &&
+                   (found == 200));
+        printf("- occurrence ending at the end of the memory, ");
+        print_test((memory_search(large, 201, 2000, pattern, 4, &found) == 1)
+                   && (found == 996));
+        printf("- occurrence not fully within the range, ");
+        print_test(memory_search(large, 201, 798, pattern, 4, &found) == 0);
+        printf("- range outside of the memory, ");
+        print_test(memory_search(large, 1000, 4, pattern, 4, &found) == -1);
+        memory_destroy(large);
+    }
+
     return 0;
 }
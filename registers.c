@@ -81,12 +81,16 @@ registers registers_create() {
     registers r = malloc(sizeof(registers));
     if(r == NULL) return NULL;
 
-    r->data=calloc(sizeof(uint32_t), 38);
+    r->data=calloc(sizeof(uint32_t), REGISTERS_STORAGE);
     if(r->data == NULL) return NULL;
 
     return r;
 }
 
+void registers_reset(registers r) {
+    memset(r->data, 0, sizeof(uint32_t) * REGISTERS_STORAGE);
+}
+
 void registers_destroy(registers r) {
     free(r->data);
     free(r);
@@ -150,3 +154,7 @@ void write_spsr(registers r, uint32_t value) {
         r->data[rg] |= value;
     }
 }
+
+void registers_copy(registers r, uint32_t *values) {
+    memcpy(values, r->data, sizeof(uint32_t) * REGISTERS_STORAGE);
+}
@@ -44,12 +44,15 @@ Contact: Guillaume.Huard@imag.fr
 #define SPSR_UND 35
 #define SPSR_IRQ 36
 #define SPSR_FIQ 37
+/* Physical registers, indexed as above after r0-r15 and the cpsr */
+#define REGISTERS_STORAGE 38
 
 
 
 typedef struct registers_data *registers;
 
 registers registers_create();
+void registers_reset(registers r);
 void registers_destroy(registers r);
 
 uint8_t get_mode(registers r);
@@ -64,5 +67,7 @@ void write_register(registers r, uint8_t reg, uint32_t value);
 void write_usr_register(registers r, uint8_t reg, uint32_t value);
 void write_cpsr(registers r, uint32_t value);
 void write_spsr(registers r, uint32_t value);
+/* Copies all the physical registers into values */
+void registers_copy(registers r, uint32_t *values);
 
 #endif
@@ -23,8 +23,8 @@ Contact: Guillaume.Huard@imag.fr
 #ifndef __SCANNER_H__
 #define __SCANNER_H__
 #include "arm_core.h"
+#include "connection.h"
 
-void gdb_scanner(arm_core p, memory mem, int in, int out,
-                 pthread_mutex_t *lock);
+void gdb_scanner(arm_core p, memory mem, connection conn);
 
 #endif
@@ -20,9 +20,27 @@ Contact: Guillaume.Huard@imag.fr
 	 700 avenue centrale, domaine universitaire
 	 38401 Saint Martin d'Hres
 */
+#define _GNU_SOURCE
+#include <stdio.h>
 #include <string.h>
 #include "trace.h"
+#include "trace_format.h"
+#include "trace_writer.h"
+#include "trace_archive.h"
+#include "trace_index.h"
 #include "arm_constants.h"
+#include "arm_disassembler.h"
+#include "registers.h"
+#include "trace_select.h"
+#include "trace_hash.h"
+#include "trace_fold.h"
+
+/* Binary traces are accumulated in this buffer and written by large blocks */
+#define BINARY_BUFFER_SIZE (1 << 20)
+/* Distinct source files named in locations of binary traces */
+#define MAX_FILES 256
+/* Longest content (file name, piece of state) pushed at once */
+#define CONTENT_RECORDS 32
 
 static FILE *output;
 /* "Randomly" chosen last address, if the first memory access is 4 bytes after
@@ -36,20 +54,164 @@ static int location_line_stack[128];
 static int location_stack_top = -1;
 static int trace_flags = 0;
 
-#ifdef ARM_TRACE_FORMAT
-static char *trace_memory_seq[] = { "N", "S" };
-static char *trace_memory_cause[] = { "_", "O" };
-static char *trace_memory_type[] = { "W", "R" };
-static char *trace_register_type[] = { "W", "R" };
-#else
-static char *trace_memory_seq[] = { "", "" };
-static char *trace_memory_cause[] = { "", ", fetch" };
-static char *trace_memory_type[] = { "write", "read" };
-static char *trace_register_type[] = { "write", "read" };
-#endif
+/* State of the binary writer */
+static struct trace_record binary_buffer[BINARY_BUFFER_SIZE /
+                                         sizeof(struct trace_record)];
+static size_t binary_count = 0;
+static int header_written = 0;
+/* Records in the stream, to tell the offset of the next one */
+static long records_written = 0;
+static uint32_t last_cycle = 0;
+/* Last location written, file numbers are indexes in files */
+static char *files[MAX_FILES];
+static int file_count = 0;
+static int last_file = TRACE_NO_FILE;
+static int last_line = -1;
+/* Processor states are printed through this stream, which turns its output
+ * into text records */
+static FILE *state_output = NULL;
+/* Delta states are formatted by their own buffered stream, their registers
+ * being read without any traced access */
+static FILE *delta_output = NULL;
+static char delta_buffer[CONTENT_RECORDS * sizeof(struct trace_record)];
+/* Full state every state_interval states, none if 0 */
+static uint32_t state_interval = 0;
+static uint32_t state_count = 0;
+static uint32_t last_state[REGISTERS_STORAGE];
+/* When set, records are formatted and written by a background thread, even
+ * for text traces */
+static trace_writer writer = NULL;
+/* Archive built from the binary buffer when not using a writer */
+static trace_archive archive = NULL;
+/* Index of the trace file, filled by the writer for text traces it writes */
+static trace_index side_index = NULL;
+static FILE *index_file = NULL;
+/* Instruction started by the last opcode fetch and its effects so far */
+static struct trace_instruction instruction;
+static int in_instruction = 0;
+static uint32_t last_cpsr = 0;
+static arm_disassembly_cache disassembly = NULL;
+/* When hashing, the text goes to the hash stream and the checkpoints to
+ * hash_list */
+static trace_hash hash = NULL;
+static FILE *hash_list = NULL;
+/* When folding, the text goes to the fold stream and is folded into
+ * folded */
+static trace_fold fold = NULL;
+static FILE *folded = NULL;
+
+#define RECORDS (BINARY | ARCHIVE)
+
+/* A new record stream does not know about previously defined files */
+static void restart_records() {
+    if (archive) {
+        trace_archive_close(archive);
+        archive = NULL;
+    }
+    header_written = 0;
+    records_written = 0;
+    last_cycle = 0;
+    file_count = 0;
+    last_file = TRACE_NO_FILE;
+    last_line = -1;
+    state_count = 0;
+}
 
 void set_trace_file(FILE *f) {
+    if (output)
+        trace_write_samples();
+    trace_flush();
+    if (side_index) {
+        /* It describes the previous trace file */
+        trace_index_close(side_index);
+        side_index = NULL;
+        index_file = NULL;
+    }
+    trace_stop_hash();
+    trace_stop_fold();
     output = f;
+    restart_records();
+}
+
+int trace_start_index(FILE *f, uint32_t interval) {
+    if ((trace_flags & ARCHIVE) || writer || hash || fold)
+        return -1;
+    side_index = trace_index_create(f, interval,
+                                    (trace_flags & BINARY) != 0);
+    if (side_index == NULL)
+        return -1;
+    index_file = f;
+    return 0;
+}
+
+/* Whether the access about to be traced needs an index entry, in which
+ * case index_access adds it with the offset of the access in the trace */
+static int index_due(uint32_t cycle) {
+    return side_index && trace_index_due(side_index, cycle);
+}
+
+static void index_access(uint32_t cycle, long offset) {
+    struct trace_index_entry entry;
+
+    entry.cycle = cycle;
+    entry.offset = offset;
+    entry.previous_cycle = last_cycle;
+    entry.file = last_file;
+    entry.line = last_line;
+    trace_index_add(side_index, &entry);
+}
+
+/* Just before the "Cycle " of a text access, where hashed traces are
+ * checkpointed */
+static void hash_access(uint32_t cycle) {
+    if (hash)
+        trace_hash_cycle(hash, cycle);
+}
+
+int trace_start_hash(uint32_t interval) {
+    if ((trace_flags & RECORDS) || writer || side_index || hash || fold ||
+        (output == NULL))
+        return -1;
+    hash = trace_hash_create(output, interval);
+    if (hash == NULL)
+        return -1;
+    hash_list = output;
+    output = trace_hash_stream(hash);
+    return 0;
+}
+
+void trace_stop_hash() {
+    if (hash) {
+        trace_hash_close(hash);
+        hash = NULL;
+        output = hash_list;
+    }
+}
+
+int trace_start_fold() {
+    if ((trace_flags & RECORDS) || writer || side_index || hash || fold ||
+        (output == NULL))
+        return -1;
+    fold = trace_fold_create(output);
+    if (fold == NULL)
+        return -1;
+    folded = output;
+    output = trace_fold_stream(fold);
+    return 0;
+}
+
+void trace_stop_fold() {
+    if (fold) {
+        trace_fold_close(fold);
+        fold = NULL;
+        output = folded;
+    }
+}
+
+/* Offset of the next record of a binary trace, after its header */
+static long record_offset() {
+    return sizeof(TRACE_MAGIC) - 1 + sizeof(uint32_t) +
+           records_written * sizeof(struct trace_record);
 }
 
 void trace_start_location(char *file, int line) {
@@ -71,57 +233,490 @@ uint8_t trace_end_location() {
 static void trace_print_location() {
     if (enabled && (trace_flags & POSITION)) {
         if (location_stack_top >= 0) {
-            fprintf(output, "%s, %d: ", location_file_stack[location_stack_top],
-                    location_line_stack[location_stack_top]);
+            trace_format_location(output,
+                                  location_file_stack[location_stack_top],
+                                  location_line_stack[location_stack_top]);
         }
     }
 }
 #endif
 
+static void write_buffer() {
+    if (trace_flags & ARCHIVE) {
+        if (archive == NULL) {
+            archive = trace_archive_create(output, !header_written);
+            header_written = 1;
+        }
+        if (archive)
+            trace_archive_add(archive, binary_buffer, binary_count);
+    } else {
+        if (!header_written) {
+            uint32_t byte_order = TRACE_BYTE_ORDER;
+
+            fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC)-1, output);
+            fwrite(&byte_order, sizeof(byte_order), 1, output);
+            header_written = 1;
+        }
+        fwrite(binary_buffer, sizeof(struct trace_record), binary_count,
+               output);
+    }
+    binary_count = 0;
+}
+
+void trace_flush() {
+    if (writer) {
+        trace_writer_flush(writer);
+        return;
+    }
+    if (!(trace_flags & RECORDS) || (output == NULL))
+        return;
+    write_buffer();
+    if (archive)
+        trace_archive_flush(archive);
+    fflush(output);
+    if (index_file)
+        fflush(index_file);
+}
+
+int trace_start_writer(enum trace_full_policy policy, size_t capacity) {
+    if (hash || fold)
+        return -1;
+    /* The writer starts its own stream, header included */
+    if (binary_count > 0)
+        trace_flush();
+    writer = trace_writer_create(output,
+                                 (trace_flags & ARCHIVE) ? TRACE_ARCHIVE :
+                                 (trace_flags & BINARY) ? TRACE_BINARY :
+                                 TRACE_TEXT, capacity, policy,
+                                 (trace_flags & RECORDS) ? NULL :
+                                 side_index);
+    if (writer == NULL)
+        return -1;
+    restart_records();
+    return 0;
+}
+
+void trace_stop_writer() {
+    if (writer) {
+        trace_writer_destroy(writer);
+        writer = NULL;
+        /* The stream goes on synchronously, after the writer's header */
+        header_written = 1;
+    }
+}
+
+/* Hands records over to the writer or to the binary buffer. Returns -1 if
+ * they have been dropped, in which case the cycle count and the location
+ * they carry are not taken as written. */
+static int emit(const struct trace_record *records, size_t count,
+                int reliable) {
+    if (writer) {
+        if (trace_writer_push(writer, records, count, reliable) == -1)
+            return -1;
+        records_written += count;
+        return 0;
+    }
+    records_written += count;
+    if (binary_count + count > sizeof(binary_buffer)/sizeof(binary_buffer[0]))
+        write_buffer();
+    memcpy(binary_buffer + binary_count, records,
+           count * sizeof(struct trace_record));
+    binary_count += count;
+    return 0;
+}
+
+/* Emits a record followed by size bytes of content (at most CONTENT_RECORDS
+ * records worth of it) */
+static int binary_content(uint8_t kind, uint16_t id, uint32_t size,
+                          const char *content, int reliable) {
+    struct trace_record records[CONTENT_RECORDS + 1];
+
+    if (size > CONTENT_RECORDS * sizeof(struct trace_record))
+        size = CONTENT_RECORDS * sizeof(struct trace_record);
+    memset(records, 0, sizeof(records));
+    records[0].kind = kind;
+    records[0].id = id;
+    records[0].address = size;
+    memcpy(records + 1, content, size);
+    return emit(records, 1 + (size + sizeof(struct trace_record) - 1) /
+                         sizeof(struct trace_record), reliable);
+}
+
+/* Emits a location record if the location of the next access has changed */
+static void binary_location() {
+    int file, line, i;
+
+    if (!(trace_flags & POSITION))
+        return;
+    file = TRACE_NO_FILE;
+    line = 0;
+    if (location_stack_top >= 0) {
+        line = location_line_stack[location_stack_top];
+        for (i=0; (i<file_count) &&
+                  (files[i] != location_file_stack[location_stack_top]); i++)
+            ;
+        if ((i == file_count) && (file_count < MAX_FILES)) {
+            files[file_count++] = location_file_stack[location_stack_top];
+            binary_content(TRACE_RECORD_FILE, i, strlen(files[i]), files[i],
+                           1);
+            if (side_index && (trace_flags & BINARY))
+                trace_index_file(side_index, i, files[i]);
+        }
+        if (i < file_count)
+            file = i;
+    }
+    if ((file != last_file) || (line != last_line)) {
+        struct trace_record record = { TRACE_RECORD_LOCATION, 0, file, 0,
+                                       line, 0 };
+
+        if (emit(&record, 1, 0) == 0) {
+            last_file = file;
+            last_line = line;
+        }
+    }
+}
+
+static void instruction_memory(uint32_t cycle, uint8_t type, uint8_t size,
+                               uint8_t cause, uint32_t address,
+                               uint32_t value) {
+    int i;
+
+    if (cause == OPCODE_FETCH) {
+        instruction.cycle = cycle;
+        instruction.address = address;
+        instruction.opcode = value;
+        instruction.truncated = 0;
+        instruction.register_count = 0;
+        instruction.store_count = 0;
+        instruction.cpsr_written = 0;
+        instruction.cpsr_before = last_cpsr;
+        in_instruction = 1;
+        return;
+    }
+    if (!in_instruction || (type != WRITE))
+        return;
+    for (i=0; (i<instruction.store_count) &&
+              ((instruction.stores[i].address != address) ||
+               (instruction.stores[i].size != size)); i++)
+        ;
+    if (i == instruction.store_count) {
+        if (i == TRACE_MAX_EFFECTS) {
+            instruction.truncated = 1;
+            return;
+        }
+        instruction.store_count++;
+        instruction.stores[i].address = address;
+        instruction.stores[i].size = size;
+    }
+    instruction.stores[i].value = value;
+}
+
+/* Registers of a mode other than the user one keep it */
+static uint16_t effect_id(uint8_t reg, uint8_t mode) {
+    if ((mode != USR) && (mode != SYS) &&
+        ((reg == 13) || (reg == 14) || (reg == SPSR) ||
+         ((mode == FIQ) && (reg >= 8) && (reg < 15))))
+        return reg | (mode << 8);
+    return reg;
+}
+
+static void instruction_register(uint8_t type, uint8_t reg, uint8_t mode,
+                                 uint32_t value) {
+    uint16_t id;
+    int i;
+
+    if (reg == CPSR) {
+        if (in_instruction) {
+            if (type == WRITE) {
+                instruction.cpsr_written = 1;
+                instruction.cpsr_after = value;
+            } else if (!instruction.cpsr_written) {
+                instruction.cpsr_before = value;
+            }
+        }
+        last_cpsr = value;
+        return;
+    }
+    if (!in_instruction || (type != WRITE))
+        return;
+    id = effect_id(reg, mode);
+    for (i=0; (i<instruction.register_count) &&
+              (instruction.registers[i].id != id); i++)
+        ;
+    if (i == instruction.register_count) {
+        if (i == TRACE_MAX_EFFECTS) {
+            instruction.truncated = 1;
+            return;
+        }
+        instruction.register_count++;
+        instruction.registers[i].id = id;
+    }
+    instruction.registers[i].value = value;
+}
+
+void trace_begin_instruction(uint32_t cycle, uint32_t address) {
+    if (enabled && trace_select_used())
+        trace_select_fetch(cycle, address);
+}
+
+void trace_end_instruction() {
+    struct trace_record records[2 * TRACE_MAX_EFFECTS + 2], *record;
+    int i;
+
+    if (!enabled || !(trace_flags & INSTRUCTION) || !in_instruction)
+        return;
+    in_instruction = 0;
+    if (trace_select_used() &&
+        (!trace_select_active() ||
+         !trace_select_instruction(instruction.address) ||
+         !trace_select_sample(TRACE_SAMPLE_INSTRUCTIONS)))
+        return;
+    /* The pc written by the fetch is not an effect, unless changed later */
+    for (i=0; (i<instruction.register_count) &&
+              (instruction.registers[i].id != 15); i++)
+        ;
+    if ((i < instruction.register_count) &&
+        (instruction.registers[i].value == instruction.address + 4)) {
+        instruction.register_count--;
+        memmove(instruction.registers + i, instruction.registers + i + 1,
+                (instruction.register_count - i) *
+                sizeof(instruction.registers[0]));
+    }
+    if (instruction.cpsr_written &&
+        (instruction.cpsr_after == instruction.cpsr_before))
+        instruction.cpsr_written = 0;
+    if ((trace_flags & RECORDS) || writer) {
+        if ((trace_flags & BINARY) && index_due(instruction.cycle))
+            index_access(instruction.cycle, record_offset());
+        memset(records, 0, sizeof(records));
+        record = records + 1;
+        for (i=0; i<instruction.register_count; i++, record++) {
+            record->kind = TRACE_RECORD_WRITTEN;
+            record->id = instruction.registers[i].id;
+            record->value = instruction.registers[i].value;
+        }
+        for (i=0; i<instruction.store_count; i++, record++) {
+            record->kind = TRACE_RECORD_STORED;
+            record->flags = instruction.stores[i].size << TRACE_SIZE_SHIFT;
+            record->address = instruction.stores[i].address;
+            record->value = instruction.stores[i].value;
+        }
+        if (instruction.cpsr_written) {
+            record->kind = TRACE_RECORD_CPSR;
+            record->address = instruction.cpsr_before;
+            record->value = instruction.cpsr_after;
+            record++;
+        }
+        records[0].kind = TRACE_RECORD_INSTRUCTION;
+        records[0].flags = instruction.truncated ? TRACE_FLAG_TRUNCATED : 0;
+        records[0].id = record - records - 1;
+        records[0].cycle_delta = instruction.cycle - last_cycle;
+        records[0].address = instruction.address;
+        records[0].value = instruction.opcode;
+        if (emit(records, record - records, 0) == 0)
+            last_cycle = instruction.cycle;
+        return;
+    }
+    if (disassembly == NULL) {
+        disassembly = arm_disassembly_cache_create();
+        if (disassembly == NULL)
+            return;
+    }
+    if (index_due(instruction.cycle))
+        index_access(instruction.cycle, ftell(output));
+    hash_access(instruction.cycle);
+    trace_format_instruction(output, disassembly, &instruction);
+}
+
 void trace_memory(uint32_t cycle, uint8_t type, uint8_t size,
                     uint8_t cause, uint32_t address, uint32_t value) {
-    if (enabled && (trace_flags & MEMORY)) {
+    int selected = 1;
+
+    if (!enabled)
+        return;
+    if (trace_select_used()) {
+        if (!trace_select_active())
+            return;
+        selected = trace_select_memory((cause == OPCODE_FETCH) ?
+                                       TRACE_KIND_FETCH :
+                                       (type == WRITE) ? TRACE_KIND_WRITE :
+                                       TRACE_KIND_READ, address) &&
+                   (!(trace_flags & MEMORY) ||
+                    trace_select_sample(TRACE_SAMPLE_MEMORY));
+    }
+    if (trace_flags & INSTRUCTION)
+        instruction_memory(cycle, type, size, cause, address, value);
+    if (selected && (trace_flags & MEMORY)) {
         uint8_t seq;
 
         seq = (address == last_address+4) ? 1 : 0;
         last_address = address;
-#ifdef ARM_TRACE_FORMAT
-        fprintf(output, "M%s%s%d%s__ %08X %08X\n", trace_memory_seq[seq],
-                trace_memory_type[type], size, trace_memory_cause[cause],
-                address, value);
-#else
+        if ((trace_flags & RECORDS) || writer) {
+            struct trace_record record;
+
+            if ((trace_flags & BINARY) && index_due(cycle))
+                index_access(cycle, record_offset());
+            binary_location();
+            record.kind = TRACE_RECORD_MEMORY;
+            record.flags = (size << TRACE_SIZE_SHIFT) |
+                           (seq ? TRACE_FLAG_SEQ : 0) |
+                           (cause ? TRACE_FLAG_CAUSE : 0) | type;
+            record.id = 0;
+            record.cycle_delta = cycle - last_cycle;
+            record.address = address;
+            record.value = value;
+            if (emit(&record, 1, 0) == 0)
+                last_cycle = cycle;
+            return;
+        }
+        if (index_due(cycle))
+            index_access(cycle, ftell(output));
+#ifndef ARM_TRACE_FORMAT
         trace_print_location();
-        fprintf(output,
-                "Cycle %d, Mem %s%s (%d bytes%s) addr: %08X, val: %08X\n",
-                cycle, trace_memory_seq[seq], trace_memory_type[type], size,
-                trace_memory_cause[cause], address, value);
 #endif
+        hash_access(cycle);
+        trace_format_memory(output, cycle, seq, type, size, cause, address,
+                            value);
     }
 }
 
 void trace_register(uint32_t cycle, uint8_t type, uint8_t reg,
                       uint8_t mode, uint32_t value) {
-    if (enabled && (trace_flags & REGISTERS)) {
-        char mode_name[5] = "";
-        if (arm_get_mode_name(mode)) {
-            strcpy(mode_name, "_");
-            strcat(mode_name, arm_get_mode_name(mode));
-        }
-#ifdef ARM_TRACE_FORMAT
-        fprintf(output, "R%s %s%s %08X\n",
-                trace_register_type[type], arm_get_register_name(reg),
-                mode_name, value);
-#else
+    int selected = 1;
+
+    /* Even when disabled, the mode may change */
+    if (reg == CPSR)
+        trace_select_mode(value & 0x1F);
+    if (!enabled)
+        return;
+    if (trace_select_used()) {
+        if (!trace_select_active())
+            return;
+        selected = trace_select_register((type == WRITE) ? TRACE_KIND_WRITE :
+                                         TRACE_KIND_READ, reg, mode) &&
+                   (!(trace_flags & REGISTERS) ||
+                    trace_select_sample(TRACE_SAMPLE_REGISTERS));
+    }
+    if (trace_flags & INSTRUCTION)
+        instruction_register(type, reg, mode, value);
+    if (selected && (trace_flags & REGISTERS)) {
+        if ((trace_flags & RECORDS) || writer) {
+            struct trace_record record;
+
+            if ((trace_flags & BINARY) && index_due(cycle))
+                index_access(cycle, record_offset());
+            binary_location();
+            record.kind = TRACE_RECORD_REGISTER;
+            record.flags = type;
+            record.id = reg | (mode << 8);
+            record.cycle_delta = cycle - last_cycle;
+            record.address = 0;
+            record.value = value;
+            if (emit(&record, 1, 0) == 0)
+                last_cycle = cycle;
+            return;
+        }
+        if (index_due(cycle))
+            index_access(cycle, ftell(output));
+#ifndef ARM_TRACE_FORMAT
         trace_print_location();
-        fprintf(output, "Cycle %d, Register %s, %s%s, val: %08X\n",
-                cycle, trace_register_type[type], arm_get_register_name(reg),
-                mode_name, value);
 #endif
+        hash_access(cycle);
+        trace_format_register(output, cycle, type, reg, mode, value);
     }
 }
 
+static ssize_t write_state(void *cookie, const char *data, size_t size) {
+    size_t chunk, left = size;
+
+    while (left > 0) {
+        chunk = CONTENT_RECORDS * sizeof(struct trace_record);
+        if (chunk > left)
+            chunk = left;
+        binary_content(TRACE_RECORD_TEXT, chunk, chunk, data, 0);
+        data += chunk;
+        left -= chunk;
+    }
+    return size;
+}
+
+static void print_state_delta(arm_core p, FILE *out) {
+    uint32_t state[REGISTERS_STORAGE];
+
+    arm_get_state(p, state);
+    trace_format_state(out, state, state_count ? last_state : NULL);
+    state_count = (state_count + 1) % state_interval;
+    memcpy(last_state, state, sizeof(state));
+}
+
+void trace_state_delta(uint32_t interval) {
+    state_interval = interval;
+    state_count = 0;
+}
+
+void trace_write_samples() {
+    uint64_t seen[TRACE_SAMPLE_STREAMS], sampled[TRACE_SAMPLE_STREAMS];
+    char line[256];
+    int size;
+
+    if (trace_select_samples(seen, sampled) == -1)
+        return;
+    size = sprintf(line, "Samples: %llu of %llu memory accesses, %llu of "
+                   "%llu register accesses, %llu of %llu instructions\n",
+                   (unsigned long long) sampled[TRACE_SAMPLE_MEMORY],
+                   (unsigned long long) seen[TRACE_SAMPLE_MEMORY],
+                   (unsigned long long) sampled[TRACE_SAMPLE_REGISTERS],
+                   (unsigned long long) seen[TRACE_SAMPLE_REGISTERS],
+                   (unsigned long long) sampled[TRACE_SAMPLE_INSTRUCTIONS],
+                   (unsigned long long) seen[TRACE_SAMPLE_INSTRUCTIONS]);
+    if ((trace_flags & RECORDS) || writer)
+        binary_content(TRACE_RECORD_TEXT, size, size, line, 1);
+    else
+        fputs(line, output);
+}
+
+void trace_exception(uint8_t exception) {
+    if (enabled && trace_select_used())
+        trace_select_exception(exception);
+}
+
 void trace_arm_state(arm_core p) {
-    if (enabled && (trace_flags & STATE)) {
+    if (enabled && (trace_flags & STATE) &&
+        (!trace_select_used() || trace_select_active())) {
+        if (state_interval && ((trace_flags & RECORDS) || writer)) {
+            if (delta_output == NULL) {
+                cookie_io_functions_t functions = { NULL, write_state, NULL,
+                                                    NULL };
+
+                delta_output = fopencookie(NULL, "w", functions);
+                if (delta_output == NULL)
+                    return;
+                setvbuf(delta_output, delta_buffer, _IOFBF,
+                        sizeof(delta_buffer));
+            }
+            print_state_delta(p, delta_output);
+            fflush(delta_output);
+            return;
+        }
+        if (state_interval) {
+            print_state_delta(p, output);
+            return;
+        }
+        if ((trace_flags & RECORDS) || writer) {
+            /* Unbuffered, so that the text keeps its place among the
+             * accesses made while printing the state */
+            if (state_output == NULL) {
+                cookie_io_functions_t functions = { NULL, write_state, NULL,
+                                                    NULL };
+
+                state_output = fopencookie(NULL, "w", functions);
+                if (state_output == NULL)
+                    return;
+                setvbuf(state_output, NULL, _IONBF, 0);
+            }
+            arm_print_state(p, state_output);
+            return;
+        }
         arm_print_state(p, output);
     }
 }
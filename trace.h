@@ -25,6 +25,7 @@ Contact: Guillaume.Huard@imag.fr
 #include <stdio.h>
 #include <stdint.h>
 #include "arm_core.h"
+#include "trace_writer.h"
 
 #define CPSR 16
 #define SPSR 17
@@ -39,6 +40,13 @@ Contact: Guillaume.Huard@imag.fr
 #define REGISTERS 2
 #define STATE     4
 #define POSITION  8
+/* Fixed size binary records (see trace_format.h) instead of text */
+#define BINARY    16
+/* Compressed archive of the accesses (see trace_archive.h) instead of text */
+#define ARCHIVE   32
+/* One line (or record) per executed instruction with its disassembly and
+ * net effects (see trace_format.h) */
+#define INSTRUCTION 64
 
 void set_trace_file(FILE *f);
 void trace_start_location(char *file, int line);
@@ -48,8 +56,50 @@ void trace_memory(uint32_t cycle, uint8_t type, uint8_t size,
 void trace_register(uint32_t cycle, uint8_t type, uint8_t reg,
                     uint8_t mode, uint32_t value);
 void trace_arm_state(arm_core p);
+/* From now on, processor states are traced as the registers which have
+ * changed since the previous one, with all of them every interval states
+ * (and at the start of each trace file) */
+void trace_state_delta(uint32_t interval);
+/* Start of the instruction at address, fetched at the given cycle. The
+ * triggers (see trace_select.h) are checked here, before any access of the
+ * instruction, the read of the pc by the fetch included */
+void trace_begin_instruction(uint32_t cycle, uint32_t address);
+/* Ends the instruction started by the last opcode fetch, traced with the
+ * accesses made since then */
+void trace_end_instruction();
+/* Writes the number of events seen and sampled (see trace_select.h) since
+ * the previous count, to rescale statistics made from the trace. It is done
+ * when the trace file changes and should be done at its end. */
+void trace_write_samples();
+/* Taking of an exception, which may trigger tracing (see trace_select.h) */
+void trace_exception(uint8_t exception);
 void trace_disable();
 void trace_enable();
 void trace_add(int flags);
+/* Writes the binary records still buffered, or waits for the writer. The
+ * events of an archive are written as a chunk, except by the writer that
+ * keeps them until its chunk is full or it is stopped. */
+void trace_flush();
+/* From now on, the trace is formatted and written by a background thread
+ * (see trace_writer.h), the trace file and flags should be set before. */
+int trace_start_writer(enum trace_full_policy policy, size_t capacity);
+void trace_stop_writer();
+/* Writes into f an index of the trace (see trace_index.h) with an entry
+ * every interval cycles. It should be started after the trace file is set
+ * and before the writer. Archives are not indexed. */
+int trace_start_index(FILE *f, uint32_t interval);
+/* From now on, the text trace is only hashed and the hash list (see
+ * trace_hash.h) is written into the trace file instead. It should be
+ * started after the trace file is set, for text traces without index nor
+ * writer. Setting another trace file stops it. */
+int trace_start_hash(uint32_t interval);
+/* Writes the last checkpoint, the trace goes to the trace file again */
+void trace_stop_hash();
+/* From now on, the loops of the instruction lines of the text trace are
+ * folded (see trace_fold.h) before it goes to the trace file. Same
+ * conditions as for hashing, the trace cannot be both folded and hashed. */
+int trace_start_fold();
+/* Writes the loop being folded, the trace goes to the trace file again */
+void trace_stop_fold();
 
 #endif
@@ -0,0 +1,438 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "trace_archive.h"
+
+enum { CYCLES, TYPES, REGISTERS, ADDRESSES, VALUES, COLUMNS };
+
+/* Chunk header: count, cycle range, address range, registers, column sizes */
+#define HEADER_WORDS (6 + COLUMNS)
+/* Register values are deltas to the previous value of the same register, in
+ * the same mode (ids of register records are below this bound) */
+#define REGISTER_IDS 0x2000
+
+/* Event types as small numbers: type, cause and sequential flags, size and
+ * whether it is a register access, so that a run fits in two bytes */
+#define TYPE_REGISTER 0x40
+
+static uint32_t pack_type(const struct trace_event *event) {
+    return (event->flags & 7) | ((event->flags >> TRACE_SIZE_SHIFT) << 3) |
+           ((event->kind == TRACE_RECORD_REGISTER) ? TYPE_REGISTER : 0);
+}
+
+static void unpack_type(uint32_t type, struct trace_event *event) {
+    event->kind = (type & TYPE_REGISTER) ? TRACE_RECORD_REGISTER :
+                                           TRACE_RECORD_MEMORY;
+    event->flags = (type & 7) | (((type >> 3) & 7) << TRACE_SIZE_SHIFT);
+}
+
+struct column {
+    uint8_t *data;
+    size_t size, allocated;
+};
+
+/* Run being accumulated in a run length encoded column */
+struct run {
+    uint32_t value, length;
+};
+
+struct trace_archive_data {
+    FILE *out;
+    /* Absolute cycle of the last record */
+    uint32_t cycle;
+    /* Content records following a file or text record, still to skip */
+    size_t skip;
+    struct trace_event events[TRACE_ARCHIVE_CHUNK];
+    size_t count;
+    struct column columns[COLUMNS];
+    uint32_t registers[REGISTER_IDS];
+};
+
+static int put_byte(struct column *c, uint8_t byte) {
+    uint8_t *data;
+
+    if (c->size == c->allocated) {
+        data = realloc(c->data, c->allocated ? 2 * c->allocated : 1024);
+        if (data == NULL)
+            return -1;
+        c->data = data;
+        c->allocated = c->allocated ? 2 * c->allocated : 1024;
+    }
+    c->data[c->size++] = byte;
+    return 0;
+}
+
+/* 7 bits per byte, least significant first, the upper bit tells whether
+ * another byte follows */
+static int put_varint(struct column *c, uint32_t value) {
+    while (value >= 0x80) {
+        if (put_byte(c, (value & 0x7F) | 0x80) == -1)
+            return -1;
+        value >>= 7;
+    }
+    return put_byte(c, value);
+}
+
+/* Small negative deltas as small unsigned numbers */
+static uint32_t zigzag(uint32_t delta) {
+    return (delta << 1) ^ (uint32_t) ((int32_t) delta >> 31);
+}
+
+static uint32_t unzigzag(uint32_t value) {
+    return (value >> 1) ^ -(value & 1);
+}
+
+static int put_run(struct column *c, struct run *run, uint32_t value) {
+    int result = 0;
+
+    if ((run->length > 0) && (run->value != value)) {
+        result = put_varint(c, run->value) | put_varint(c, run->length);
+        run->length = 0;
+    }
+    run->value = value;
+    run->length++;
+    return result;
+}
+
+static int end_run(struct column *c, struct run *run) {
+    if (run->length == 0)
+        return 0;
+    return put_varint(c, run->value) | put_varint(c, run->length);
+}
+
+static void put_word(uint8_t *bytes, uint32_t value) {
+    bytes[0] = value;
+    bytes[1] = value >> 8;
+    bytes[2] = value >> 16;
+    bytes[3] = value >> 24;
+}
+
+static uint32_t get_word(const uint8_t *bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+           ((uint32_t) bytes[3] << 24);
+}
+
+trace_archive trace_archive_create(FILE *out, int header) {
+    trace_archive archive;
+
+    archive = calloc(1, sizeof(struct trace_archive_data));
+    if (archive == NULL)
+        return NULL;
+    archive->out = out;
+    if (header)
+        fwrite(TRACE_ARCHIVE_MAGIC, 1, sizeof(TRACE_ARCHIVE_MAGIC)-1, out);
+    return archive;
+}
+
+int trace_archive_flush(trace_archive archive) {
+    uint8_t header[4 * HEADER_WORDS];
+    uint32_t cycle = 0, address = 0, value = 0, *previous;
+    uint32_t cycle_min, cycle_max, address_min, address_max, registers;
+    struct run types = { 0, 0 }, ids = { 0, 0 };
+    struct column *columns = archive->columns;
+    struct trace_event *event;
+    int i, result = 0;
+
+    if (archive->count == 0)
+        return 0;
+    for (i=0; i<COLUMNS; i++)
+        columns[i].size = 0;
+    cycle_min = address_min = 0xFFFFFFFF;
+    cycle_max = address_max = 0;
+    registers = 0;
+    memset(archive->registers, 0, sizeof(archive->registers));
+    for (event = archive->events; event < archive->events + archive->count;
+         event++) {
+        cycle_min = (event->cycle < cycle_min) ? event->cycle : cycle_min;
+        cycle_max = (event->cycle > cycle_max) ? event->cycle : cycle_max;
+        result |= put_varint(&columns[CYCLES], event->cycle - cycle);
+        cycle = event->cycle;
+        result |= put_run(&columns[TYPES], &types, pack_type(event));
+        if (event->kind == TRACE_RECORD_MEMORY) {
+            if (event->address < address_min)
+                address_min = event->address;
+            if (event->address > address_max)
+                address_max = event->address;
+            result |= put_varint(&columns[ADDRESSES],
+                                 zigzag(event->address - address));
+            address = event->address;
+            previous = &value;
+        } else {
+            if ((event->id & 0xFF) < 32)
+                registers |= 1 << (event->id & 0xFF);
+            result |= put_run(&columns[REGISTERS], &ids, event->id);
+            previous = &archive->registers[event->id % REGISTER_IDS];
+        }
+        result |= put_varint(&columns[VALUES],
+                             zigzag(event->value - *previous));
+        *previous = event->value;
+    }
+    result |= end_run(&columns[TYPES], &types);
+    result |= end_run(&columns[REGISTERS], &ids);
+    if (result)
+        return -1;
+
+    put_word(header, archive->count);
+    put_word(header + 4, cycle_min);
+    put_word(header + 8, cycle_max);
+    put_word(header + 12, address_min);
+    put_word(header + 16, address_max);
+    put_word(header + 20, registers);
+    for (i=0; i<COLUMNS; i++)
+        put_word(header + 24 + 4*i, columns[i].size);
+    if (fwrite(header, sizeof(header), 1, archive->out) != 1)
+        return -1;
+    for (i=0; i<COLUMNS; i++)
+        if (columns[i].size &&
+            (fwrite(columns[i].data, columns[i].size, 1, archive->out) != 1))
+            return -1;
+    archive->count = 0;
+    return 0;
+}
+
+int trace_archive_add(trace_archive archive,
+                      const struct trace_record *records, size_t count) {
+    const struct trace_record *record;
+    struct trace_event *event;
+    size_t size;
+
+    for (record = records; record < records + count; record++) {
+        if (archive->skip) {
+            archive->skip--;
+            continue;
+        }
+        archive->cycle += record->cycle_delta;
+        switch (record->kind) {
+          case TRACE_RECORD_MEMORY:
+          case TRACE_RECORD_REGISTER:
+            event = &archive->events[archive->count++];
+            event->cycle = archive->cycle;
+            event->kind = record->kind;
+            event->flags = record->flags;
+            event->id = record->id;
+            event->address = record->address;
+            event->value = record->value;
+            if ((archive->count == TRACE_ARCHIVE_CHUNK) &&
+                (trace_archive_flush(archive) == -1))
+                return -1;
+            break;
+          case TRACE_RECORD_FILE:
+          case TRACE_RECORD_TEXT:
+            size = (record->kind == TRACE_RECORD_FILE) ? record->address :
+                                                          record->id;
+            archive->skip = (size + sizeof(*record) - 1) / sizeof(*record);
+            break;
+          case TRACE_RECORD_LOCATION:
+          case TRACE_RECORD_INSTRUCTION:
+          case TRACE_RECORD_WRITTEN:
+          case TRACE_RECORD_STORED:
+          case TRACE_RECORD_CPSR:
+            break;
+          default:
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int trace_archive_close(trace_archive archive) {
+    int i, result;
+
+    result = trace_archive_flush(archive);
+    fflush(archive->out);
+    for (i=0; i<COLUMNS; i++)
+        free(archive->columns[i].data);
+    free(archive);
+    return result;
+}
+
+/* Reading side: position in a column of the chunk being decoded */
+struct cursor {
+    const uint8_t *data, *end;
+    int error;
+};
+
+static uint32_t get_varint(struct cursor *c) {
+    uint32_t value = 0;
+    int shift = 0;
+
+    while ((c->data < c->end) && (shift < 35)) {
+        value |= (uint32_t) (*c->data & 0x7F) << shift;
+        if (!(*c->data++ & 0x80))
+            return value;
+        shift += 7;
+    }
+    c->error = 1;
+    return 0;
+}
+
+static uint32_t get_run(struct cursor *c, struct run *run) {
+    if (run->length == 0) {
+        run->value = get_varint(c);
+        run->length = get_varint(c);
+        if (run->length == 0)
+            c->error = 1;
+    }
+    run->length--;
+    return run->value;
+}
+
+static int chunk_may_match(const struct trace_filter *filter,
+                           const uint8_t *header) {
+    if ((get_word(header + 4) > filter->cycle_max) ||
+        (get_word(header + 8) < filter->cycle_min))
+        return 0;
+    if (filter->has_addresses &&
+        ((get_word(header + 12) > filter->address_max) ||
+         (get_word(header + 16) < filter->address_min)))
+        return 0;
+    if ((filter->reg >= 0) && (filter->reg < 32) &&
+        !(get_word(header + 20) & (1 << filter->reg)))
+        return 0;
+    return 1;
+}
+
+static int event_matches(const struct trace_filter *filter,
+                         const struct trace_event *event) {
+    if ((event->cycle < filter->cycle_min) ||
+        (event->cycle > filter->cycle_max))
+        return 0;
+    if (filter->has_addresses &&
+        ((event->kind != TRACE_RECORD_MEMORY) ||
+         (event->address < filter->address_min) ||
+         (event->address > filter->address_max)))
+        return 0;
+    if ((filter->reg >= 0) &&
+        ((event->kind != TRACE_RECORD_REGISTER) ||
+         ((event->id & 0xFF) != filter->reg)))
+        return 0;
+    return 1;
+}
+
+static int decode_chunk(const uint8_t *header, const uint8_t *data,
+                        const struct trace_filter *filter,
+                        void (*found)(const struct trace_event *, void *),
+                        void *arg, struct trace_query_stats *stats,
+                        uint32_t *registers) {
+    struct cursor columns[COLUMNS];
+    uint32_t value = 0, *previous;
+    struct run types = { 0, 0 }, ids = { 0, 0 };
+    struct trace_event event = { 0, 0, 0, 0, 0, 0 };
+    uint32_t count, i;
+    int c, error;
+
+    for (i=0; i<COLUMNS; i++) {
+        columns[i].data = data;
+        data += get_word(header + 24 + 4*i);
+        columns[i].end = data;
+        columns[i].error = 0;
+    }
+    memset(registers, 0, REGISTER_IDS * sizeof(uint32_t));
+    count = get_word(header);
+    for (i=0; i<count; i++) {
+        event.cycle += get_varint(&columns[CYCLES]);
+        unpack_type(get_run(&columns[TYPES], &types), &event);
+        if (event.kind == TRACE_RECORD_MEMORY) {
+            event.id = 0;
+            event.address += unzigzag(get_varint(&columns[ADDRESSES]));
+            previous = &value;
+        } else {
+            event.id = get_run(&columns[REGISTERS], &ids);
+            previous = &registers[event.id % REGISTER_IDS];
+        }
+        event.value = *previous + unzigzag(get_varint(&columns[VALUES]));
+        *previous = event.value;
+        for (error = 0, c = 0; c < COLUMNS; c++)
+            error |= columns[c].error;
+        if (error)
+            return -1;
+        if (event_matches(filter, &event)) {
+            /* Register events carry no address */
+            struct trace_event selected = event;
+
+            if (selected.kind != TRACE_RECORD_MEMORY)
+                selected.address = 0;
+            stats->events++;
+            found(&selected, arg);
+        }
+    }
+    return 0;
+}
+
+int trace_archive_query(FILE *in, const struct trace_filter *filter,
+                        void (*found)(const struct trace_event *, void *),
+                        void *data, struct trace_query_stats *stats) {
+    char magic[sizeof(TRACE_ARCHIVE_MAGIC)-1];
+    uint8_t header[4 * HEADER_WORDS];
+    uint8_t *content = NULL, *larger;
+    uint32_t *registers;
+    size_t size, allocated = 0;
+    int i, result = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    if ((fread(magic, sizeof(magic), 1, in) != 1) ||
+        (memcmp(magic, TRACE_ARCHIVE_MAGIC, sizeof(magic)) != 0)) {
+        fprintf(stderr, "Not a trace archive\n");
+        return -1;
+    }
+    registers = malloc(REGISTER_IDS * sizeof(uint32_t));
+    if (registers == NULL)
+        return -1;
+    while ((result == 0) && (fread(header, sizeof(header), 1, in) == 1)) {
+        for (size = 0, i = 0; i < COLUMNS; i++)
+            size += get_word(header + 24 + 4*i);
+        if (!chunk_may_match(filter, header) &&
+            (fseek(in, size, SEEK_CUR) == 0)) {
+            stats->chunks_skipped++;
+            continue;
+        }
+        if (size > allocated) {
+            larger = realloc(content, size);
+            if (larger == NULL) {
+                result = -1;
+                break;
+            }
+            content = larger;
+            allocated = size;
+        }
+        if (size && (fread(content, size, 1, in) != 1)) {
+            fprintf(stderr, "Truncated trace archive\n");
+            result = -1;
+            break;
+        }
+        if (!chunk_may_match(filter, header)) {
+            /* Not seekable input */
+            stats->chunks_skipped++;
+            continue;
+        }
+        stats->chunks_read++;
+        result = decode_chunk(header, content, filter, found, data, stats,
+                              registers);
+        if (result == -1)
+            fprintf(stderr, "Corrupted trace archive chunk\n");
+    }
+    free(content);
+    free(registers);
+    return result;
+}
@@ -0,0 +1,86 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#ifndef __TRACE_ARCHIVE_H__
+#define __TRACE_ARCHIVE_H__
+#include <stdio.h>
+#include <stdint.h>
+#include "trace_format.h"
+
+/* Compact archive of the memory and register accesses of a trace
+ * (instructions, locations and processor states are not kept). Accesses are
+ * grouped in chunks of TRACE_ARCHIVE_CHUNK events, stored column by column:
+ * cycles as deltas, event types and register numbers as runs, addresses and
+ * values as deltas to the previous ones, all of them as varints. Each chunk starts with the
+ * range of its cycles and memory addresses and the set of its registers, so
+ * that queries skip the chunks that cannot match without decoding them.
+ *
+ * The archive starts with TRACE_ARCHIVE_MAGIC, all integers are written
+ * little endian, whatever the host.
+ */
+#define TRACE_ARCHIVE_MAGIC "ARMTRARC"
+#define TRACE_ARCHIVE_CHUNK 4096
+
+typedef struct trace_archive_data *trace_archive;
+
+/* Building, from the records of a binary trace (see trace_format.h). Chunks
+ * are independent, without header they are appended to an existing archive.
+ */
+trace_archive trace_archive_create(FILE *out, int header);
+int trace_archive_add(trace_archive archive,
+                      const struct trace_record *records, size_t count);
+/* Writes the events not yet in a chunk */
+int trace_archive_flush(trace_archive archive);
+/* Flushes the archive, out is left open */
+int trace_archive_close(trace_archive archive);
+
+/* An access, with its absolute cycle number, kind and flags as in records */
+struct trace_event {
+    uint32_t cycle;
+    uint8_t kind;
+    uint8_t flags;
+    uint16_t id;
+    uint32_t address;
+    uint32_t value;
+};
+
+/* Selected events are within both ranges (bounds included). The address
+ * range only selects memory accesses, a register (other than -1) only
+ * accesses to this register, in any mode. */
+struct trace_filter {
+    uint32_t cycle_min, cycle_max;
+    int has_addresses;
+    uint32_t address_min, address_max;
+    int reg;
+};
+
+struct trace_query_stats {
+    unsigned long chunks_read, chunks_skipped, events;
+};
+
+/* Calls found for each selected event of the archive read from in, in trace
+ * order. Returns -1 if in is not a valid archive. */
+int trace_archive_query(FILE *in, const struct trace_filter *filter,
+                        void (*found)(const struct trace_event *, void *),
+                        void *data, struct trace_query_stats *stats);
+
+#endif
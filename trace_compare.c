@@ -0,0 +1,166 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "trace_hash.h"
+
+#define DEFAULT_INTERVAL 1000
+
+void usage(char *name) {
+    fprintf(stderr, "Usage:\n"
+        "%s [ --interval cycles ] reference trace\n"
+        "%s --hash [ --interval cycles ] text_trace\n\n"
+        "Compares two traces, given either as text traces or as the hash "
+        "lists written by the --trace-hash option of the simulator, and "
+        "tells the first interval of cycles in which they differ. Text "
+        "traces are hashed with the interval of the other list (%d cycles by "
+        "default). With --hash, writes on the standard output the hash list "
+        "of a text trace, to be kept as the reference.\n", name, name,
+        DEFAULT_INTERVAL);
+}
+
+/* Interval of the hash list name, 0 if it is a text trace */
+static uint32_t list_interval(char *name) {
+    char magic[sizeof(TRACE_HASH_MAGIC)];
+    uint32_t interval;
+    FILE *in;
+
+    in = fopen(name, "r");
+    if (in == NULL)
+        return 0;
+    if ((fscanf(in, "%13s %u", magic, &interval) != 2) ||
+        (strcmp(magic, TRACE_HASH_MAGIC) != 0))
+        interval = 0;
+    fclose(in);
+    return interval;
+}
+
+static long load(char *name, uint32_t *interval,
+                 struct trace_hash_checkpoint **checkpoints) {
+    FILE *in;
+    long count;
+
+    in = fopen(name, "r");
+    if (in == NULL) {
+        perror(name);
+        exit(2);
+    }
+    count = trace_hash_load(in, interval, checkpoints);
+    fclose(in);
+    if (count == -1) {
+        fprintf(stderr, "Cannot read the trace or hash list %s\n", name);
+        exit(2);
+    }
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    struct trace_hash_checkpoint *reference, *trace;
+    uint32_t interval = DEFAULT_INTERVAL, trace_interval, first;
+    long reference_count, trace_count, i;
+    int opt, hash = 0;
+    FILE *in;
+
+    struct option longopts[] = {
+        { "interval", required_argument, NULL, 'i' },
+        { "hash", no_argument, NULL, 'H' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "i:Hh", longopts, NULL)) != -1) {
+        switch (opt) {
+          case 'i':
+            interval = strtoul(optarg, NULL, 0);
+            if (interval == 0) {
+                fprintf(stderr, "Invalid interval %s\n", optarg);
+                exit(2);
+            }
+            break;
+          case 'H':
+            hash = 1;
+            break;
+          case 'h':
+            usage(argv[0]);
+            exit(0);
+          default:
+            usage(argv[0]);
+            exit(2);
+        }
+    }
+    if (optind != argc - (hash ? 1 : 2)) {
+        usage(argv[0]);
+        exit(2);
+    }
+    if (hash) {
+        in = fopen(argv[optind], "r");
+        if (in == NULL) {
+            perror(argv[optind]);
+            exit(2);
+        }
+        if (trace_hash_text(in, stdout, interval) == -1) {
+            fprintf(stderr, "Cannot hash %s\n", argv[optind]);
+            exit(2);
+        }
+        fclose(in);
+        return 0;
+    }
+
+    /* Text traces are hashed like the lists they are compared to */
+    if (list_interval(argv[optind+1]))
+        interval = list_interval(argv[optind+1]);
+    if (list_interval(argv[optind]))
+        interval = list_interval(argv[optind]);
+    reference_count = load(argv[optind], &interval, &reference);
+    trace_interval = interval;
+    trace_count = load(argv[optind+1], &trace_interval, &trace);
+    if (trace_interval != interval) {
+        fprintf(stderr, "The hash lists have different intervals (%u and "
+                "%u cycles)\n", interval, trace_interval);
+        exit(2);
+    }
+    for (i=0; (i<reference_count) && (i<trace_count) &&
+              (reference[i].cycle == trace[i].cycle) &&
+              (reference[i].hash == trace[i].hash); i++)
+        ;
+    if ((i == reference_count) && (i == trace_count)) {
+        printf("Traces are identical (%ld intervals of %u cycles)\n", i,
+               interval);
+        return 0;
+    }
+    if (i == reference_count)
+        first = trace[i].cycle;
+    else if (i == trace_count)
+        first = reference[i].cycle;
+    else
+        first = (reference[i].cycle < trace[i].cycle) ? reference[i].cycle :
+                                                        trace[i].cycle;
+    printf("Traces differ from the interval of cycles %u:%u, trace it with "
+           "--trace-start cycle=%u --trace-stop cycle=%u\n", first,
+           first + interval - 1, first, first + interval);
+    free(reference);
+    free(trace);
+    return 1;
+}
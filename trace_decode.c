@@ -0,0 +1,51 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "trace_format.h"
+
+/* Regenerates the text trace from a binary trace written with the
+ * --trace-binary option of the simulator */
+int main(int argc, char *argv[]) {
+    FILE *input = stdin;
+    int result;
+
+    if ((argc > 2) || ((argc == 2) && (argv[1][0] == '-'))) {
+        fprintf(stderr, "Usage :"
+                "%s [ binary trace file ]\n\n"
+                "Writes on the standard output the text form of a binary "
+                "trace, read from the standard input by default.\n", argv[0]);
+        exit(1);
+    }
+    if (argc == 2) {
+        input = fopen(argv[1], "r");
+        if (input == NULL) {
+            perror(argv[1]);
+            exit(1);
+        }
+    }
+    result = trace_decode(input, stdout);
+    if (input != stdin)
+        fclose(input);
+    return result ? 1 : 0;
+}
@@ -0,0 +1,449 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "trace_fold.h"
+
+/* Longer lines are never folded */
+#define MAX_LINE 512
+#define MAX_FIELDS 64
+#define HEX_DIGITS "0123456789ABCDEF"
+/* Three iterations of the longest loop */
+#define HISTORY (3 * TRACE_FOLD_MAX_BODY)
+
+/* An instruction line : its text after the cycle, and its fields */
+struct line {
+    uint32_t cycle, address;
+    int size, fields;
+    struct {
+        uint16_t offset;
+        uint8_t width;
+        uint32_t value;
+    } field[MAX_FIELDS];
+    char text[MAX_LINE];
+};
+
+/* Last consecutive instruction lines */
+struct history {
+    struct line *lines;
+    int first, count;
+};
+
+struct trace_fold_data {
+    FILE *out, *stream;
+    /* Line being received */
+    char *partial;
+    size_t partial_size, partial_capacity;
+    struct history history;
+    /* Newest lines of the history not written yet */
+    int pending;
+    /* Loop being folded if body is not 0, position in its current
+     * iteration and changes of the fields of its lines */
+    int body, position;
+    uint32_t iterations, cycles;
+    int fields[TRACE_FOLD_MAX_BODY];
+    int32_t deltas[TRACE_FOLD_MAX_BODY][MAX_FIELDS];
+};
+
+static uint32_t field_mask(int width) {
+    return (width == 8) ? 0xFFFFFFFF : (1U << (4 * width)) - 1;
+}
+
+static int add_field(struct line *line, const char *start, int width) {
+    uint32_t value = 0;
+    int i;
+
+    if ((width == 0) || (width > 8) || (line->fields == MAX_FIELDS))
+        return -1;
+    for (i=0; i<width; i++)
+        value = (value << 4) | (strchr(HEX_DIGITS, start[i]) - HEX_DIGITS);
+    line->field[line->fields].offset = start - line->text;
+    line->field[line->fields].width = width;
+    line->field[line->fields++].value = value;
+    return 0;
+}
+
+/* Parses the size characters of text, without end of line, returns -1 if
+ * it is not an instruction line which can be folded */
+static int parse_line(struct line *line, const char *text, size_t size) {
+    const char *equal;
+    char *end;
+
+    if (strncmp(text, "Cycle ", 6) != 0)
+        return -1;
+    line->cycle = strtoul(text + 6, &end, 10);
+    if ((end == text + 6) || (strncmp(end, ", Instruction ", 14) != 0))
+        return -1;
+    line->address = strtoul(end + 14, NULL, 16);
+    line->size = size - (end - text);
+    if (line->size >= MAX_LINE)
+        return -1;
+    memcpy(line->text, end, line->size);
+    line->text[line->size] = '\0';
+    line->fields = 0;
+    for (equal=strchr(line->text, '='); equal; equal=strchr(equal + 1, '=')) {
+        /* Address of a store */
+        if ((equal - line->text >= 10) && (equal[-1] == ']') &&
+            (equal[-10] == '[') && (strspn(equal - 9, HEX_DIGITS) == 8) &&
+            (add_field(line, equal - 9, 8) == -1))
+            return -1;
+        if (add_field(line, equal + 1, strspn(equal + 1, HEX_DIGITS)) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+static void write_line(FILE *out, const struct line *line) {
+    fprintf(out, "Cycle %d%s\n", line->cycle, line->text);
+}
+
+/* Line of the given age, 0 for the newest */
+static struct line *recent(struct history *history, int age) {
+    return history->lines + (history->first + history->count - 1 - age) %
+                            HISTORY;
+}
+
+/* Slot of the next line, counted once it is set, the oldest line is
+ * dropped if needed */
+static struct line *next_line(struct history *history) {
+    if (history->count == HISTORY) {
+        history->first = (history->first + 1) % HISTORY;
+        history->count--;
+    }
+    return history->lines + (history->first + history->count) % HISTORY;
+}
+
+/* Whether b is the instruction of a with the same effects, but for the
+ * values of the fields */
+static int same_instruction(const struct line *a, const struct line *b) {
+    int i, from = 0;
+
+    if ((a->address != b->address) || (a->size != b->size) ||
+        (a->fields != b->fields))
+        return 0;
+    for (i=0; i<a->fields; i++) {
+        if ((a->field[i].offset != b->field[i].offset) ||
+            (a->field[i].width != b->field[i].width) ||
+            memcmp(a->text + from, b->text + from, a->field[i].offset - from))
+            return 0;
+        from = a->field[i].offset + a->field[i].width;
+    }
+    return memcmp(a->text + from, b->text + from, a->size - from) == 0;
+}
+
+/* Changes of the fields from a to b, signed within the width of each */
+static void field_deltas(const struct line *a, const struct line *b,
+                         int32_t *deltas) {
+    uint32_t delta, mask;
+    int i;
+
+    for (i=0; i<a->fields; i++) {
+        mask = field_mask(a->field[i].width);
+        delta = (b->field[i].value - a->field[i].value) & mask;
+        if (delta & ~(mask >> 1))
+            delta |= ~mask;
+        deltas[i] = delta;
+    }
+}
+
+/* Whether b follows a as the next iteration of a loop */
+static int follows(const struct line *a, const struct line *b,
+                   uint32_t cycles, const int32_t *deltas) {
+    int32_t changes[MAX_FIELDS];
+
+    if (!same_instruction(a, b) || (b->cycle - a->cycle != cycles))
+        return 0;
+    field_deltas(a, b, changes);
+    return memcmp(changes, deltas, a->fields * sizeof(int32_t)) == 0;
+}
+
+/* Whether the last three iterations of body lines make a loop, its
+ * changes are then set */
+static int repeated(trace_fold fold, int body) {
+    struct history *history = &fold->history;
+    struct line *first, *second, *third;
+    uint32_t cycles;
+    int j;
+
+    cycles = recent(history, 0)->cycle - recent(history, body)->cycle;
+    for (j=0; j<body; j++) {
+        third = recent(history, body - 1 - j);
+        second = recent(history, 2 * body - 1 - j);
+        first = recent(history, 3 * body - 1 - j);
+        if (!same_instruction(first, second) ||
+            (second->cycle - first->cycle != cycles))
+            return 0;
+        field_deltas(first, second, fold->deltas[j]);
+        fold->fields[j] = first->fields;
+        if (!follows(second, third, cycles, fold->deltas[j]))
+            return 0;
+    }
+    fold->cycles = cycles;
+    return 1;
+}
+
+static void write_pending(trace_fold fold, int keep) {
+    while (fold->pending > keep)
+        write_line(fold->out, recent(&fold->history, --fold->pending));
+}
+
+static void write_loop(trace_fold fold) {
+    const char *separator = ", changes";
+    int i, j;
+
+    fprintf(fold->out, "Loop: %u more times the last %d instructions, every "
+            "%u cycles", fold->iterations, fold->body, fold->cycles);
+    for (j=0; j<fold->body; j++)
+        for (i=0; i<fold->fields[j]; i++)
+            if (fold->deltas[j][i]) {
+                fprintf(fold->out, "%s %d.%d:%+d", separator, j, i,
+                        fold->deltas[j][i]);
+                separator = "";
+            }
+    fputc('\n', fold->out);
+    fold->body = 0;
+}
+
+/* Writes everything held, before a line which cannot be folded */
+static void flush_fold(trace_fold fold) {
+    if (fold->body)
+        write_loop(fold);
+    write_pending(fold, 0);
+}
+
+static void fold_line(trace_fold fold, const char *text, size_t size) {
+    struct history *history = &fold->history;
+    struct line *line;
+    int body;
+
+    line = next_line(history);
+    if (parse_line(line, text, size) == -1) {
+        flush_fold(fold);
+        history->count = 0;
+        fwrite(text, 1, size, fold->out);
+        fputc('\n', fold->out);
+        return;
+    }
+    history->count++;
+    fold->pending++;
+    if (fold->body) {
+        if (follows(recent(history, fold->body), line, fold->cycles,
+                    fold->deltas[fold->position])) {
+            if (++fold->position == fold->body) {
+                fold->iterations++;
+                fold->position = 0;
+                fold->pending = 0;
+            }
+            return;
+        }
+        /* The lines of the unfinished iteration are left pending */
+        write_loop(fold);
+    }
+    for (body=1; (body <= TRACE_FOLD_MAX_BODY) &&
+                 (2 * body <= fold->pending) &&
+                 (3 * body <= history->count); body++)
+        if (repeated(fold, body)) {
+            write_pending(fold, 2 * body);
+            fold->pending = 0;
+            fold->body = body;
+            fold->position = 0;
+            fold->iterations = 2;
+            return;
+        }
+    write_pending(fold, 2 * TRACE_FOLD_MAX_BODY);
+}
+
+static ssize_t write_fold(void *cookie, const char *data, size_t size) {
+    trace_fold fold = cookie;
+    size_t left = size, length;
+    const char *end;
+    char *grown;
+
+    while (left > 0) {
+        end = memchr(data, '\n', left);
+        length = end ? end - data : left;
+        if (fold->partial_size + length + 1 > fold->partial_capacity) {
+            grown = realloc(fold->partial, 2 * (fold->partial_size + length +
+                                                1));
+            if (grown == NULL)
+                return -1;
+            fold->partial = grown;
+            fold->partial_capacity = 2 * (fold->partial_size + length + 1);
+        }
+        memcpy(fold->partial + fold->partial_size, data, length);
+        fold->partial_size += length;
+        fold->partial[fold->partial_size] = '\0';
+        if (end == NULL)
+            break;
+        fold_line(fold, fold->partial, fold->partial_size);
+        fold->partial_size = 0;
+        data += length + 1;
+        left -= length + 1;
+    }
+    return size;
+}
+
+trace_fold trace_fold_create(FILE *out) {
+    cookie_io_functions_t functions = { NULL, write_fold, NULL, NULL };
+    trace_fold fold;
+
+    fold = malloc(sizeof(struct trace_fold_data));
+    if (fold == NULL)
+        return NULL;
+    fold->history.lines = malloc(HISTORY * sizeof(struct line));
+    fold->stream = NULL;
+    if (fold->history.lines)
+        fold->stream = fopencookie(fold, "w", functions);
+    if (fold->stream == NULL) {
+        free(fold->history.lines);
+        free(fold);
+        return NULL;
+    }
+    fold->out = out;
+    fold->partial = NULL;
+    fold->partial_size = 0;
+    fold->partial_capacity = 0;
+    fold->history.first = 0;
+    fold->history.count = 0;
+    fold->pending = 0;
+    fold->body = 0;
+    return fold;
+}
+
+FILE *trace_fold_stream(trace_fold fold) {
+    return fold->stream;
+}
+
+void trace_fold_close(trace_fold fold) {
+    fclose(fold->stream);
+    flush_fold(fold);
+    /* Text after the last end of line */
+    if (fold->partial_size)
+        fwrite(fold->partial, 1, fold->partial_size, fold->out);
+    fflush(fold->out);
+    free(fold->partial);
+    free(fold->history.lines);
+    free(fold);
+}
+
+int trace_fold_text(FILE *in, FILE *out) {
+    char buffer[4096];
+    trace_fold fold;
+    size_t size;
+
+    fold = trace_fold_create(out);
+    if (fold == NULL)
+        return -1;
+    while ((size = fread(buffer, 1, sizeof(buffer), in)) > 0)
+        fwrite(buffer, 1, size, fold->stream);
+    trace_fold_close(fold);
+    return 0;
+}
+
+/* Writes the iterations of the loop line text from the last lines of
+ * history */
+static int expand(struct history *history, const char *text, FILE *out) {
+    int32_t deltas[TRACE_FOLD_MAX_BODY][MAX_FIELDS];
+    uint32_t iterations, cycles, i;
+    int body, j, field, consumed;
+    struct line *line;
+    char digits[9];
+    long delta;
+
+    if ((sscanf(text, "Loop: %u more times the last %d instructions, every "
+                "%u cycles%n", &iterations, &body, &cycles, &consumed) != 3)
+        || (body <= 0) || (body > TRACE_FOLD_MAX_BODY) ||
+        (body > history->count))
+        return -1;
+    memset(deltas, 0, sizeof(deltas));
+    text += consumed;
+    if (strncmp(text, ", changes", 9) == 0)
+        text += 9;
+    while (sscanf(text, " %d.%d:%ld%n", &j, &field, &delta, &consumed) == 3) {
+        if ((j < 0) || (j >= body) || (field < 0) ||
+            (field >= recent(history, body - 1 - j)->fields))
+            return -1;
+        deltas[j][field] = delta;
+        text += consumed;
+    }
+    if ((*text != '\n') && (*text != '\0'))
+        return -1;
+    for (i=0; i<iterations; i++)
+        for (j=0; j<body; j++) {
+            line = next_line(history);
+            *line = *recent(history, body - 1);
+            line->cycle += cycles;
+            for (field=0; field<line->fields; field++)
+                if (deltas[j][field]) {
+                    line->field[field].value = (line->field[field].value +
+                                                deltas[j][field]) &
+                        field_mask(line->field[field].width);
+                    sprintf(digits, "%0*X", line->field[field].width,
+                            line->field[field].value);
+                    memcpy(line->text + line->field[field].offset, digits,
+                           line->field[field].width);
+                }
+            history->count++;
+            write_line(out, line);
+        }
+    return 0;
+}
+
+int trace_unfold(FILE *in, FILE *out) {
+    struct history history;
+    struct line *line;
+    char *text = NULL;
+    size_t capacity = 0;
+    ssize_t size;
+    int result = 0;
+
+    history.lines = malloc(HISTORY * sizeof(struct line));
+    if (history.lines == NULL)
+        return -1;
+    history.first = 0;
+    history.count = 0;
+    while ((size = getline(&text, &capacity, in)) != -1) {
+        if (strncmp(text, "Loop: ", 6) == 0) {
+            if (expand(&history, text, out) == -1) {
+                fprintf(stderr, "Invalid loop %s", text);
+                result = -1;
+                break;
+            }
+            continue;
+        }
+        fputs(text, out);
+        if ((size > 0) && (text[size-1] == '\n'))
+            text[--size] = '\0';
+        line = next_line(&history);
+        if (parse_line(line, text, size) == -1)
+            history.count = 0;
+        else
+            history.count++;
+    }
+    free(text);
+    free(history.lines);
+    return result;
+}
@@ -0,0 +1,57 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#ifndef __TRACE_FOLD_H__
+#define __TRACE_FOLD_H__
+#include <stdio.h>
+
+/* Folding of the loops of an instruction trace. When consecutive
+ * instruction lines (see trace_format_instruction) repeat the same
+ * instructions at least three times, with effects on the same registers
+ * whose values change by the same amounts at each iteration, only the first
+ * iteration is kept and the others are replaced by :
+ * Loop: count more times the last size instructions, every cycles cycles, changes line.field:+delta ...
+ * where line is the position of an instruction in the iteration and field
+ * one of the fields of its line, the hexadecimal numbers following an '='
+ * and the addresses of stores, both numbered from 0. Only the fields which
+ * change are given. Other lines are left as they are.
+ */
+#define TRACE_FOLD_MAX_BODY 64
+
+typedef struct trace_fold_data *trace_fold;
+
+/* Folded text goes to out */
+trace_fold trace_fold_create(FILE *out);
+/* Stream into which the text to fold is written */
+FILE *trace_fold_stream(trace_fold fold);
+/* Writes the loop being folded and the lines still held */
+void trace_fold_close(trace_fold fold);
+
+/* Writes into out the folded form of the text trace in. Returns -1 on
+ * error. */
+int trace_fold_text(FILE *in, FILE *out);
+/* Writes into out the text trace folded in in, with its loops expanded.
+ * Returns -1 if a loop line is invalid (an error message is then printed
+ * on stderr). */
+int trace_unfold(FILE *in, FILE *out);
+
+#endif
@@ -0,0 +1,451 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <string.h>
+#include <stdlib.h>
+#include "trace_format.h"
+#include "trace.h"
+#include "arm_constants.h"
+#include "util.h"
+#include "registers.h"
+
+#ifdef ARM_TRACE_FORMAT
+static char *trace_memory_seq[] = { "N", "S" };
+static char *trace_memory_cause[] = { "_", "O" };
+static char *trace_memory_type[] = { "W", "R" };
+static char *trace_register_type[] = { "W", "R" };
+#else
+static char *trace_memory_seq[] = { "", "" };
+static char *trace_memory_cause[] = { "", ", fetch" };
+static char *trace_memory_type[] = { "write", "read" };
+static char *trace_register_type[] = { "write", "read" };
+#endif
+
+void trace_format_location(FILE *out, const char *file, int line) {
+#ifndef ARM_TRACE_FORMAT
+    fprintf(out, "%s, %d: ", file, line);
+#endif
+}
+
+void trace_format_memory(FILE *out, uint32_t cycle, uint8_t seq, uint8_t type,
+                         uint8_t size, uint8_t cause, uint32_t address,
+                         uint32_t value) {
+#ifdef ARM_TRACE_FORMAT
+    fprintf(out, "M%s%s%d%s__ %08X %08X\n", trace_memory_seq[seq],
+            trace_memory_type[type], size, trace_memory_cause[cause],
+            address, value);
+#else
+    fprintf(out, "Cycle %d, Mem %s%s (%d bytes%s) addr: %08X, val: %08X\n",
+            cycle, trace_memory_seq[seq], trace_memory_type[type], size,
+            trace_memory_cause[cause], address, value);
+#endif
+}
+
+void trace_format_register(FILE *out, uint32_t cycle, uint8_t type,
+                           uint8_t reg, uint8_t mode, uint32_t value) {
+    char mode_name[5] = "";
+
+    if (arm_get_mode_name(mode)) {
+        strcpy(mode_name, "_");
+        strcat(mode_name, arm_get_mode_name(mode));
+    }
+#ifdef ARM_TRACE_FORMAT
+    fprintf(out, "R%s %s%s %08X\n", trace_register_type[type],
+            arm_get_register_name(reg), mode_name, value);
+#else
+    fprintf(out, "Cycle %d, Register %s, %s%s, val: %08X\n", cycle,
+            trace_register_type[type], arm_get_register_name(reg), mode_name,
+            value);
+#endif
+}
+
+/* Name of a register written by an instruction, only banked registers
+ * come with a mode */
+static void effect_register(FILE *out, uint16_t id) {
+    uint8_t reg = id & 0xFF, mode = id >> 8;
+
+    fputs(arm_get_register_name(reg), out);
+    if (mode && arm_get_mode_name(mode))
+        fprintf(out, "_%s", arm_get_mode_name(mode));
+}
+
+static void flags(FILE *out, uint32_t cpsr) {
+    fprintf(out, "%c%c%c%c", get_bit(cpsr, N) ? 'N' : 'n',
+            get_bit(cpsr, Z) ? 'Z' : 'z', get_bit(cpsr, C) ? 'C' : 'c',
+            get_bit(cpsr, V) ? 'V' : 'v');
+}
+
+/* Effects are aligned after the disassembly */
+#define DISASSEMBLY_WIDTH 28
+
+void trace_format_instruction(FILE *out, arm_disassembly_cache cache,
+                              const struct trace_instruction *instruction) {
+    const char *text;
+    int i;
+
+    text = arm_disassemble_cached(cache, instruction->address,
+                                  instruction->opcode);
+#ifdef ARM_TRACE_FORMAT
+    fprintf(out, "I %08X %08X %s", instruction->address, instruction->opcode,
+            text);
+#else
+    fprintf(out, "Cycle %d, Instruction %08X: %08X %s", instruction->cycle,
+            instruction->address, instruction->opcode, text);
+#endif
+    if (instruction->register_count || instruction->store_count ||
+        (instruction->cpsr_written &&
+         (instruction->cpsr_before != instruction->cpsr_after)) ||
+        instruction->truncated)
+        for (i=strlen(text); i<DISASSEMBLY_WIDTH; i++)
+            fputc(' ', out);
+    for (i=0; i<instruction->register_count; i++) {
+        fputc(' ', out);
+        effect_register(out, instruction->registers[i].id);
+        fprintf(out, "=%08X", instruction->registers[i].value);
+    }
+    for (i=0; i<instruction->store_count; i++)
+        fprintf(out, " [%08X]=%0*X", instruction->stores[i].address,
+                2 * instruction->stores[i].size,
+                instruction->stores[i].value);
+    if (instruction->cpsr_written &&
+        (instruction->cpsr_before != instruction->cpsr_after)) {
+        fputc(' ', out);
+        flags(out, instruction->cpsr_before);
+        fputs("->", out);
+        flags(out, instruction->cpsr_after);
+        if ((instruction->cpsr_before ^ instruction->cpsr_after) & 0x0FFFFFFF)
+            fprintf(out, " CPSR=%08X", instruction->cpsr_after);
+    }
+    if (instruction->truncated)
+        fputs(" ...", out);
+    fputc('\n', out);
+}
+
+/* Name of a physical register, banked ones are named after their mode */
+static void state_register(FILE *out, int index) {
+    static const uint8_t modes[] = { SVC, ABT, UND, IRQ, FIQ };
+    uint8_t reg;
+
+    if (index < R8_FIQ) {
+        fputs(arm_get_register_name(index), out);
+        return;
+    }
+    if (index < R13_SVC) {
+        fprintf(out, "%s_FIQ", arm_get_register_name(index - R8_FIQ + 8));
+        return;
+    }
+    reg = (index < R14_SVC) ? 13 : (index < SPSR_SVC) ? 14 : SPSR;
+    fprintf(out, "%s_%s", arm_get_register_name(reg),
+            arm_get_mode_name(modes[(index - R13_SVC) % 5]));
+}
+
+void trace_format_state(FILE *out, const uint32_t *state,
+                        const uint32_t *previous) {
+    int i, changed = 0;
+
+    for (i=0; i<REGISTERS_STORAGE; i++) {
+        /* No spsr in user mode */
+        if ((i == SPSR) || (previous && (state[i] == previous[i])))
+            continue;
+        if (!changed)
+            fputs(previous ? "Changed:" : "State:", out);
+        changed = 1;
+        fputc(' ', out);
+        state_register(out, i);
+        fprintf(out, "=%08X", state[i]);
+        if (previous && (i == CPSR) &&
+            ((state[i] ^ previous[i]) & 0xF0000000)) {
+            fputs(" (", out);
+            flags(out, previous[i]);
+            fputs("->", out);
+            flags(out, state[i]);
+            fputc(')', out);
+        }
+    }
+    if (changed)
+        fputc('\n', out);
+}
+
+struct trace_decoder_data {
+    FILE *out;
+    uint32_t cycle;
+    /* Current location, file names indexed by their number */
+    int file, line, file_count;
+    char **files;
+    /* File or text record whose content is being received */
+    struct trace_record pending;
+    size_t size, received;
+    char *content;
+    trace_index index;
+    /* Instruction waiting for effect records */
+    struct trace_instruction instruction;
+    int effects;
+    arm_disassembly_cache cache;
+};
+
+trace_decoder trace_decoder_create(FILE *out) {
+    trace_decoder decoder;
+
+    decoder = calloc(1, sizeof(struct trace_decoder_data));
+    if (decoder) {
+        decoder->out = out;
+        decoder->file = TRACE_NO_FILE;
+    }
+    return decoder;
+}
+
+void trace_decoder_destroy(trace_decoder decoder) {
+    int i;
+
+    for (i=0; i<decoder->file_count; i++)
+        free(decoder->files[i]);
+    free(decoder->files);
+    free(decoder->content);
+    if (decoder->cache)
+        arm_disassembly_cache_destroy(decoder->cache);
+    free(decoder);
+}
+
+int trace_decoder_define_file(trace_decoder decoder, int id,
+                              const char *name) {
+    char **files;
+
+    if (id >= decoder->file_count) {
+        files = realloc(decoder->files, (id+1) * sizeof(char *));
+        if (files == NULL)
+            return -1;
+        memset(files + decoder->file_count, 0,
+               (id + 1 - decoder->file_count) * sizeof(char *));
+        decoder->files = files;
+        decoder->file_count = id + 1;
+    }
+    free(decoder->files[id]);
+    decoder->files[id] = strdup(name);
+    return decoder->files[id] ? 0 : -1;
+}
+
+/* Called once the content of a file or text record has been received */
+static int content_received(trace_decoder decoder) {
+    decoder->content[decoder->size] = '\0';
+    if (decoder->pending.kind == TRACE_RECORD_TEXT) {
+        fwrite(decoder->content, 1, decoder->size, decoder->out);
+        return 0;
+    }
+    return trace_decoder_define_file(decoder, decoder->pending.id,
+                                     decoder->content);
+}
+
+void trace_decoder_set_index(trace_decoder decoder, trace_index index) {
+    decoder->index = index;
+}
+
+void trace_decoder_resume(trace_decoder decoder, uint32_t previous_cycle,
+                          int file, int line) {
+    decoder->cycle = previous_cycle;
+    decoder->file = file;
+    decoder->line = line;
+}
+
+uint32_t trace_decoder_cycle(trace_decoder decoder) {
+    return decoder->cycle;
+}
+
+/* Text traces are indexed on the first access of each interval */
+static void index_access(trace_decoder decoder, uint32_t previous_cycle) {
+    struct trace_index_entry entry;
+
+    if (decoder->index && trace_index_due(decoder->index, decoder->cycle)) {
+        entry.cycle = decoder->cycle;
+        entry.offset = ftell(decoder->out);
+        entry.previous_cycle = previous_cycle;
+        entry.file = TRACE_NO_FILE;
+        entry.line = 0;
+        trace_index_add(decoder->index, &entry);
+    }
+}
+
+static void print_location(trace_decoder decoder) {
+    if ((decoder->file < decoder->file_count) &&
+        decoder->files[decoder->file])
+        trace_format_location(decoder->out, decoder->files[decoder->file],
+                              decoder->line);
+}
+
+static int instruction_done(trace_decoder decoder) {
+    if (decoder->cache == NULL) {
+        decoder->cache = arm_disassembly_cache_create();
+        if (decoder->cache == NULL)
+            return -1;
+    }
+    trace_format_instruction(decoder->out, decoder->cache,
+                             &decoder->instruction);
+    return 0;
+}
+
+static int instruction_effect(trace_decoder decoder,
+                              const struct trace_record *record) {
+    struct trace_instruction *instruction = &decoder->instruction;
+
+    switch (record->kind) {
+      case TRACE_RECORD_WRITTEN:
+        if (instruction->register_count == TRACE_MAX_EFFECTS)
+            return -1;
+        instruction->registers[instruction->register_count].id = record->id;
+        instruction->registers[instruction->register_count++].value =
+            record->value;
+        break;
+      case TRACE_RECORD_STORED:
+        if (instruction->store_count == TRACE_MAX_EFFECTS)
+            return -1;
+        instruction->stores[instruction->store_count].address =
+            record->address;
+        instruction->stores[instruction->store_count].value = record->value;
+        instruction->stores[instruction->store_count++].size =
+            record->flags >> TRACE_SIZE_SHIFT;
+        break;
+      default:
+        instruction->cpsr_written = 1;
+        instruction->cpsr_before = record->address;
+        instruction->cpsr_after = record->value;
+    }
+    decoder->effects--;
+    return (decoder->effects == 0) ? instruction_done(decoder) : 0;
+}
+
+int trace_decoder_feed(trace_decoder decoder,
+                       const struct trace_record *records, size_t count) {
+    const struct trace_record *record;
+    uint32_t previous_cycle;
+    size_t chunk;
+    char *content;
+
+    for (record = records; record < records + count; record++) {
+        if (decoder->received < decoder->size) {
+            chunk = decoder->size - decoder->received;
+            if (chunk > sizeof(*record))
+                chunk = sizeof(*record);
+            memcpy(decoder->content + decoder->received, record, chunk);
+            decoder->received += chunk;
+            if ((decoder->received == decoder->size) &&
+                (content_received(decoder) == -1))
+                return -1;
+            continue;
+        }
+        previous_cycle = decoder->cycle;
+        decoder->cycle += record->cycle_delta;
+        switch (record->kind) {
+          case TRACE_RECORD_MEMORY:
+            index_access(decoder, previous_cycle);
+            print_location(decoder);
+            trace_format_memory(decoder->out, decoder->cycle,
+                                (record->flags & TRACE_FLAG_SEQ) != 0,
+                                record->flags & TRACE_FLAG_TYPE,
+                                record->flags >> TRACE_SIZE_SHIFT,
+                                (record->flags & TRACE_FLAG_CAUSE) != 0,
+                                record->address, record->value);
+            break;
+          case TRACE_RECORD_REGISTER:
+            index_access(decoder, previous_cycle);
+            print_location(decoder);
+            trace_format_register(decoder->out, decoder->cycle,
+                                  record->flags & TRACE_FLAG_TYPE,
+                                  record->id & 0xFF, record->id >> 8,
+                                  record->value);
+            break;
+          case TRACE_RECORD_INSTRUCTION:
+            index_access(decoder, previous_cycle);
+            memset(&decoder->instruction, 0, sizeof(decoder->instruction));
+            decoder->instruction.cycle = decoder->cycle;
+            decoder->instruction.address = record->address;
+            decoder->instruction.opcode = record->value;
+            decoder->instruction.truncated =
+                (record->flags & TRACE_FLAG_TRUNCATED) != 0;
+            decoder->effects = record->id;
+            if ((decoder->effects == 0) && (instruction_done(decoder) == -1))
+                return -1;
+            break;
+          case TRACE_RECORD_WRITTEN:
+          case TRACE_RECORD_STORED:
+          case TRACE_RECORD_CPSR:
+            if ((decoder->effects == 0) ||
+                (instruction_effect(decoder, record) == -1)) {
+                fprintf(stderr, "Instruction effect out of place\n");
+                return -1;
+            }
+            break;
+          case TRACE_RECORD_LOCATION:
+            decoder->file = record->id;
+            decoder->line = record->address;
+            break;
+          case TRACE_RECORD_FILE:
+          case TRACE_RECORD_TEXT:
+            decoder->pending = *record;
+            decoder->size = (record->kind == TRACE_RECORD_FILE) ?
+                            record->address : record->id;
+            decoder->received = 0;
+            content = realloc(decoder->content, decoder->size + 1);
+            if (content == NULL)
+                return -1;
+            decoder->content = content;
+            if ((decoder->size == 0) && (content_received(decoder) == -1))
+                return -1;
+            break;
+          default:
+            fprintf(stderr, "Invalid trace record kind %02x\n", record->kind);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int trace_decode(FILE *in, FILE *out) {
+    char magic[sizeof(TRACE_MAGIC)-1];
+    struct trace_record records[256];
+    trace_decoder decoder;
+    uint32_t byte_order;
+    size_t count;
+    int result = 0;
+
+    if ((fread(magic, sizeof(magic), 1, in) != 1) ||
+        (memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) ||
+        (fread(&byte_order, sizeof(byte_order), 1, in) != 1)) {
+        fprintf(stderr, "Not a binary trace\n");
+        return -1;
+    }
+    if (byte_order != TRACE_BYTE_ORDER) {
+        fprintf(stderr, "Trace written by a host with another byte order\n");
+        return -1;
+    }
+    decoder = trace_decoder_create(out);
+    if (decoder == NULL)
+        return -1;
+    while ((result == 0) &&
+           ((count = fread(records, sizeof(struct trace_record), 256, in))
+            > 0))
+        result = trace_decoder_feed(decoder, records, count);
+    if ((result == 0) && (decoder->received < decoder->size)) {
+        fprintf(stderr, "Truncated trace\n");
+        result = -1;
+    }
+    trace_decoder_destroy(decoder);
+    return result;
+}
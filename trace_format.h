@@ -0,0 +1,148 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#ifndef __TRACE_FORMAT_H__
+#define __TRACE_FORMAT_H__
+#include <stdio.h>
+#include <stdint.h>
+#include "trace_index.h"
+#include "arm_disassembler.h"
+
+/* Text format of the traces, shared by the simulator and the decoder of
+ * binary traces so that both produce exactly the same output.
+ *
+ * A binary trace starts with a header (the magic string then the value
+ * TRACE_BYTE_ORDER in the byte order of the host that wrote it) followed by
+ * fixed size records. Memory and register records hold one access, with
+ * the number of cycles since the previous access. Location records give the
+ * source position of the following accesses (file 0xFFFF for none), the
+ * file names being defined once by file records. Text records hold output
+ * that has no record of its own (processor state). File and text records
+ * are followed by their content, padded to a whole number of records. File
+ * records carry the number of the file they define.
+ *
+ * Instruction traces have one instruction record per executed instruction
+ * (address, opcode and number of effect records that follow, as id) then
+ * its effects: registers written (last value of each, the mode is only given
+ * for banked registers and the pc only when it does not reach the next
+ * instruction), memory written and change of the cpsr (value before as
+ * address, after as value).
+ */
+#define TRACE_MAGIC "ARMTRACE"
+#define TRACE_BYTE_ORDER 0x01020304
+
+#define TRACE_RECORD_MEMORY   'M'
+#define TRACE_RECORD_REGISTER 'R'
+#define TRACE_RECORD_LOCATION 'L'
+#define TRACE_RECORD_FILE     'F'
+#define TRACE_RECORD_TEXT     'T'
+#define TRACE_RECORD_INSTRUCTION 'I'
+#define TRACE_RECORD_WRITTEN  'W'
+#define TRACE_RECORD_STORED   'S'
+#define TRACE_RECORD_CPSR     'C'
+
+/* Flags of memory records : type (READ/WRITE), cause (OPCODE_FETCH or not),
+ * sequential access and size (in the upper bits). Register records only
+ * have the type. */
+#define TRACE_FLAG_TYPE  1
+#define TRACE_FLAG_CAUSE 2
+#define TRACE_FLAG_SEQ   4
+#define TRACE_SIZE_SHIFT 4
+/* Flag of instruction records: it had more effects than kept */
+#define TRACE_FLAG_TRUNCATED 1
+
+#define TRACE_NO_FILE 0xFFFF
+
+struct trace_record {
+    uint8_t kind;
+    uint8_t flags;
+    /* Register and mode, file number or content size */
+    uint16_t id;
+    uint32_t cycle_delta;
+    /* Address of memory records, line of location records */
+    uint32_t address;
+    uint32_t value;
+};
+
+/* Net effects of an instruction, at most TRACE_MAX_EFFECTS registers
+ * and memory writes are kept */
+#define TRACE_MAX_EFFECTS 16
+
+struct trace_instruction {
+    uint32_t cycle, address, opcode;
+    int truncated;
+    int register_count;
+    struct {
+        uint16_t id;
+        uint32_t value;
+    } registers[TRACE_MAX_EFFECTS];
+    int store_count;
+    struct {
+        uint32_t address, value;
+        uint8_t size;
+    } stores[TRACE_MAX_EFFECTS];
+    int cpsr_written;
+    uint32_t cpsr_before, cpsr_after;
+};
+
+void trace_format_location(FILE *out, const char *file, int line);
+void trace_format_memory(FILE *out, uint32_t cycle, uint8_t seq, uint8_t type,
+                         uint8_t size, uint8_t cause, uint32_t address,
+                         uint32_t value);
+void trace_format_register(FILE *out, uint32_t cycle, uint8_t type,
+                           uint8_t reg, uint8_t mode, uint32_t value);
+/* Processor state given as its physical registers (see registers.h). Without
+ * previous state, all of them are printed on a "State:" line, otherwise only
+ * those which have changed on a "Changed:" line, if any */
+void trace_format_state(FILE *out, const uint32_t *state,
+                        const uint32_t *previous);
+/* The disassembly comes from cache */
+void trace_format_instruction(FILE *out, arm_disassembly_cache cache,
+                              const struct trace_instruction *instruction);
+
+/* Incremental decoding of records, for instance as they are produced */
+typedef struct trace_decoder_data *trace_decoder;
+
+trace_decoder trace_decoder_create(FILE *out);
+void trace_decoder_destroy(trace_decoder decoder);
+/* Writes to the output of decoder the text form of count records, the
+ * content of a file or text record may be split across calls. Returns -1 if
+ * a record is invalid. */
+int trace_decoder_feed(trace_decoder decoder,
+                       const struct trace_record *records, size_t count);
+/* Entries for the text written by the decoder are added to index */
+void trace_decoder_set_index(trace_decoder decoder, trace_index index);
+/* Decoding from the middle of a trace: state given by an index entry and
+ * names of the files defined before */
+void trace_decoder_resume(trace_decoder decoder, uint32_t previous_cycle,
+                          int file, int line);
+int trace_decoder_define_file(trace_decoder decoder, int number,
+                              const char *name);
+/* Cycle of the last record decoded */
+uint32_t trace_decoder_cycle(trace_decoder decoder);
+
+/* Writes to out the text form of the binary trace read from in. Returns 0
+ * on success, -1 if in is not a valid binary trace (an error message is
+ * then printed on stderr). */
+int trace_decode(FILE *in, FILE *out);
+
+#endif
@@ -0,0 +1,172 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace_hash.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+struct trace_hash_data {
+    FILE *list, *stream;
+    uint32_t interval;
+    uint64_t value;
+    /* Interval of the last access, if any */
+    int started;
+    uint32_t window;
+};
+
+static ssize_t write_hash(void *cookie, const char *data, size_t size) {
+    trace_hash hash = cookie;
+    uint64_t value = hash->value;
+    size_t i;
+
+    for (i=0; i<size; i++)
+        value = (value ^ (uint8_t) data[i]) * FNV_PRIME;
+    hash->value = value;
+    return size;
+}
+
+trace_hash trace_hash_create(FILE *list, uint32_t interval) {
+    cookie_io_functions_t functions = { NULL, write_hash, NULL, NULL };
+    trace_hash hash;
+
+    if (interval == 0)
+        return NULL;
+    hash = malloc(sizeof(struct trace_hash_data));
+    if (hash == NULL)
+        return NULL;
+    hash->stream = fopencookie(hash, "w", functions);
+    if (hash->stream == NULL) {
+        free(hash);
+        return NULL;
+    }
+    hash->list = list;
+    hash->interval = interval;
+    hash->value = FNV_OFFSET;
+    hash->started = 0;
+    fprintf(list, "%s %u\n", TRACE_HASH_MAGIC, interval);
+    return hash;
+}
+
+FILE *trace_hash_stream(trace_hash hash) {
+    return hash->stream;
+}
+
+static void checkpoint(trace_hash hash) {
+    fflush(hash->stream);
+    fprintf(hash->list, "%u %016llx\n", hash->window * hash->interval,
+            (unsigned long long) hash->value);
+}
+
+void trace_hash_cycle(trace_hash hash, uint32_t cycle) {
+    uint32_t window = cycle / hash->interval;
+
+    if (hash->started && (window == hash->window))
+        return;
+    if (hash->started)
+        checkpoint(hash);
+    hash->started = 1;
+    hash->window = window;
+}
+
+void trace_hash_close(trace_hash hash) {
+    if (hash->started)
+        checkpoint(hash);
+    fclose(hash->stream);
+    fflush(hash->list);
+    free(hash);
+}
+
+int trace_hash_text(FILE *in, FILE *list, uint32_t interval) {
+    char *line = NULL, *cycle;
+    size_t size = 0;
+    trace_hash hash;
+
+    hash = trace_hash_create(list, interval);
+    if (hash == NULL)
+        return -1;
+    while (getline(&line, &size, in) != -1) {
+        cycle = strstr(line, "Cycle ");
+        if (cycle) {
+            /* Position or state text may come first on the line */
+            fwrite(line, 1, cycle - line, hash->stream);
+            trace_hash_cycle(hash, strtoul(cycle + 6, NULL, 10));
+            fputs(cycle, hash->stream);
+        } else {
+            fputs(line, hash->stream);
+        }
+    }
+    free(line);
+    trace_hash_close(hash);
+    return 0;
+}
+
+long trace_hash_load(FILE *in, uint32_t *interval,
+                     struct trace_hash_checkpoint **checkpoints) {
+    struct trace_hash_checkpoint *grown;
+    unsigned long long value;
+    char magic[sizeof(TRACE_HASH_MAGIC)];
+    long count = 0, capacity = 0;
+    unsigned int cycle, found;
+    FILE *list = NULL;
+
+    *checkpoints = NULL;
+    if ((fscanf(in, "%13s %u", magic, &found) == 2) &&
+        (strcmp(magic, TRACE_HASH_MAGIC) == 0)) {
+        *interval = found;
+    } else {
+        /* A text trace, hashed into a temporary list */
+        rewind(in);
+        list = tmpfile();
+        if ((list == NULL) || (trace_hash_text(in, list, *interval) == -1) ||
+            (fseek(list, 0, SEEK_SET) == -1) ||
+            (fscanf(list, "%13s %u", magic, interval) != 2)) {
+            if (list)
+                fclose(list);
+            return -1;
+        }
+        in = list;
+    }
+    while (fscanf(in, "%u %llx", &cycle, &value) == 2) {
+        if (count == capacity) {
+            capacity = capacity ? 2 * capacity : 256;
+            grown = realloc(*checkpoints,
+                            capacity * sizeof(struct trace_hash_checkpoint));
+            if (grown == NULL) {
+                free(*checkpoints);
+                *checkpoints = NULL;
+                count = -1;
+                break;
+            }
+            *checkpoints = grown;
+        }
+        (*checkpoints)[count].cycle = cycle;
+        (*checkpoints)[count++].hash = value;
+    }
+    if (list)
+        fclose(list);
+    return count;
+}
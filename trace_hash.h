@@ -0,0 +1,65 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#ifndef __TRACE_HASH_H__
+#define __TRACE_HASH_H__
+#include <stdio.h>
+#include <stdint.h>
+
+/* Hash of a text trace kept instead of the trace itself, for regression
+ * tests. The text is hashed (64 bits FNV-1a) as it is written and the hash
+ * is checkpointed every interval cycles into a text hash list :
+ * ARMTRACE-HASH interval
+ * cycle hash
+ * where hash covers the whole trace up to the "Cycle " of the first access
+ * after the interval starting at cycle (intervals without any access are
+ * skipped). Two traces differ
+ * first in the interval of the first differing checkpoint.
+ */
+#define TRACE_HASH_MAGIC "ARMTRACE-HASH"
+
+typedef struct trace_hash_data *trace_hash;
+
+trace_hash trace_hash_create(FILE *list, uint32_t interval);
+/* Stream into which the text to hash is written */
+FILE *trace_hash_stream(trace_hash hash);
+/* The "Cycle " of an access at this cycle is about to be written */
+void trace_hash_cycle(trace_hash hash, uint32_t cycle);
+/* Writes the last checkpoint */
+void trace_hash_close(trace_hash hash);
+
+/* Writes into list the hash list of the text trace in, as the simulator
+ * would have done. Returns -1 on error. */
+int trace_hash_text(FILE *in, FILE *list, uint32_t interval);
+
+/* Reading side, a checkpoint list */
+struct trace_hash_checkpoint {
+    uint32_t cycle;
+    uint64_t hash;
+};
+
+/* Loads the hash list in, or computes it if in is a text trace (with the
+ * given interval then). Returns the number of checkpoints, -1 on error. */
+long trace_hash_load(FILE *in, uint32_t *interval,
+                     struct trace_hash_checkpoint **checkpoints);
+
+#endif
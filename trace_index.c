@@ -0,0 +1,184 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "trace_index.h"
+
+struct trace_index_data {
+    FILE *out;
+    uint32_t interval;
+    int binary;
+    /* Writing side: first cycle of the next interval */
+    uint32_t next;
+    int started;
+    /* Reading side */
+    struct trace_index_entry *entries;
+    size_t count, allocated;
+    char **files;
+    int file_count;
+};
+
+trace_index trace_index_create(FILE *out, uint32_t interval, int binary) {
+    trace_index index;
+
+    if (interval == 0)
+        return NULL;
+    index = calloc(1, sizeof(struct trace_index_data));
+    if (index == NULL)
+        return NULL;
+    index->out = out;
+    index->interval = interval;
+    index->binary = binary;
+    fprintf(out, "%s %u %s\n", TRACE_INDEX_MAGIC, interval,
+            binary ? "binary" : "text");
+    return index;
+}
+
+int trace_index_due(trace_index index, uint32_t cycle) {
+    return !index->started || (cycle >= index->next);
+}
+
+void trace_index_add(trace_index index, const struct trace_index_entry *entry) {
+    index->next = (entry->cycle / index->interval + 1) * index->interval;
+    index->started = 1;
+    /* An offset cannot be told on unseekable output */
+    if (entry->offset < 0)
+        return;
+    fprintf(index->out, "C %u %ld %u %d %d\n", entry->cycle, entry->offset,
+            entry->previous_cycle, entry->file, entry->line);
+}
+
+void trace_index_file(trace_index index, int number, const char *name) {
+    fprintf(index->out, "F %d %s\n", number, name);
+}
+
+static void destroy(trace_index index) {
+    int i;
+
+    for (i=0; i<index->file_count; i++)
+        free(index->files[i]);
+    free(index->files);
+    free(index->entries);
+    free(index);
+}
+
+void trace_index_close(trace_index index) {
+    fflush(index->out);
+    destroy(index);
+}
+
+static int add_file(trace_index index, int number, const char *name) {
+    char **files;
+
+    if ((number < 0) || (number >= 0xFFFF))
+        return -1;
+    if (number >= index->file_count) {
+        files = realloc(index->files, (number+1) * sizeof(char *));
+        if (files == NULL)
+            return -1;
+        memset(files + index->file_count, 0,
+               (number + 1 - index->file_count) * sizeof(char *));
+        index->files = files;
+        index->file_count = number + 1;
+    }
+    free(index->files[number]);
+    index->files[number] = strdup(name);
+    return index->files[number] ? 0 : -1;
+}
+
+static int add_entry(trace_index index, const struct trace_index_entry *entry)
+{
+    struct trace_index_entry *entries;
+
+    if (index->count == index->allocated) {
+        index->allocated = index->allocated ? 2 * index->allocated : 256;
+        entries = realloc(index->entries,
+                          index->allocated * sizeof(*entries));
+        if (entries == NULL)
+            return -1;
+        index->entries = entries;
+    }
+    index->entries[index->count++] = *entry;
+    return 0;
+}
+
+trace_index trace_index_load(FILE *in) {
+    struct trace_index_entry entry;
+    char line[4096], kind[16], name[4096];
+    trace_index index;
+    int number, result = 0;
+
+    index = calloc(1, sizeof(struct trace_index_data));
+    if (index == NULL)
+        return NULL;
+    if ((fgets(line, sizeof(line), in) == NULL) ||
+        (sscanf(line, TRACE_INDEX_MAGIC " %u %15s", &index->interval, kind)
+         != 2)) {
+        destroy(index);
+        return NULL;
+    }
+    index->binary = (strcmp(kind, "binary") == 0);
+    while ((result == 0) && fgets(line, sizeof(line), in)) {
+        if (sscanf(line, "C %u %ld %u %d %d", &entry.cycle, &entry.offset,
+                   &entry.previous_cycle, &entry.file, &entry.line) == 5)
+            result = add_entry(index, &entry);
+        else if (sscanf(line, "F %d %4095[^\n]", &number, name) == 2)
+            result = add_file(index, number, name);
+        else
+            result = -1;
+    }
+    if (result == -1) {
+        destroy(index);
+        return NULL;
+    }
+    return index;
+}
+
+int trace_index_binary(trace_index index) {
+    return index->binary;
+}
+
+const struct trace_index_entry *trace_index_find(trace_index index,
+                                                 uint32_t cycle) {
+    size_t low = 0, high = index->count, middle;
+
+    /* Entries are sorted by cycle, looking for the last one <= cycle */
+    while (low < high) {
+        middle = (low + high) / 2;
+        if (index->entries[middle].cycle <= cycle)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low ? &index->entries[low - 1] : NULL;
+}
+
+const char *trace_index_file_name(trace_index index, int number) {
+    if ((number < 0) || (number >= index->file_count))
+        return NULL;
+    return index->files[number];
+}
+
+int trace_index_file_count(trace_index index) {
+    return index->file_count;
+}
@@ -0,0 +1,70 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#ifndef __TRACE_INDEX_H__
+#define __TRACE_INDEX_H__
+#include <stdio.h>
+#include <stdint.h>
+
+/* Sparse index of a text or binary trace, kept in a side file. Every
+ * interval cycles, the index gives the offset in the trace of the first
+ * access of the interval, so that a reader jumps close to any cycle
+ * without going through the beginning of the trace. For binary traces, an
+ * entry also gives the state needed to decode from there: the cycle of the
+ * previous access, the current location and, once for all, the names of
+ * the files. The index is a text file :
+ * ARMTRACE-INDEX interval text|binary
+ * F number name
+ * C cycle offset previous_cycle file line
+ */
+#define TRACE_INDEX_MAGIC "ARMTRACE-INDEX"
+
+struct trace_index_entry {
+    uint32_t cycle;
+    long offset;
+    uint32_t previous_cycle;
+    int file, line;
+};
+
+typedef struct trace_index_data *trace_index;
+
+/* Writing side */
+trace_index trace_index_create(FILE *out, uint32_t interval, int binary);
+/* Whether an access at this cycle starts a new interval, in which case its
+ * entry should be added */
+int trace_index_due(trace_index index, uint32_t cycle);
+void trace_index_add(trace_index index, const struct trace_index_entry *entry);
+void trace_index_file(trace_index index, int number, const char *name);
+void trace_index_close(trace_index index);
+
+/* Reading side, returns NULL if in is not a valid index */
+trace_index trace_index_load(FILE *in);
+int trace_index_binary(trace_index index);
+/* Last entry at or before cycle, NULL if there is none (the trace should
+ * then be read from its beginning) */
+const struct trace_index_entry *trace_index_find(trace_index index,
+                                                 uint32_t cycle);
+/* Name of a file of a binary trace, NULL if unknown */
+const char *trace_index_file_name(trace_index index, int number);
+int trace_index_file_count(trace_index index);
+
+#endif
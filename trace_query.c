@@ -0,0 +1,192 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "trace_format.h"
+#include "trace_archive.h"
+
+void usage(char *name) {
+    fprintf(stderr, "Usage:\n"
+        "%s --create archive [ binary trace file ]\n"
+        "%s [ --cycles first:last ] [ --addresses first:last ] "
+        "[ --register number ] archive\n\n"
+        "The first form builds a trace archive from a binary trace written "
+        "with the --trace-binary option of the simulator (read from the "
+        "standard input by default). Simulators run with --trace-archive "
+        "directly write archives.\n"
+        "The second form writes on the standard output, in text form, the "
+        "accesses of the archive selected by all the given filters: cycle "
+        "range, memory address range (memory accesses only), register "
+        "number (register accesses only, cpsr is 16 and spsr 17). Bounds are "
+        "included and can be given in hexadecimal (0x...). Only the parts of "
+        "the archive that may contain selected accesses are decoded.\n",
+        name, name);
+}
+
+/* Parses first:last, either bound may be omitted */
+static int parse_range(char *text, uint32_t *first, uint32_t *last) {
+    char *end;
+
+    if (*text != ':') {
+        *first = strtoul(text, &end, 0);
+        text = end;
+    }
+    if (*text++ != ':')
+        return -1;
+    if (*text != '\0') {
+        *last = strtoul(text, &end, 0);
+        text = end;
+    }
+    return (*text == '\0') ? 0 : -1;
+}
+
+static void print_event(const struct trace_event *event, void *data) {
+    FILE *out = data;
+
+    if (event->kind == TRACE_RECORD_MEMORY)
+        trace_format_memory(out, event->cycle,
+                            (event->flags & TRACE_FLAG_SEQ) != 0,
+                            event->flags & TRACE_FLAG_TYPE,
+                            event->flags >> TRACE_SIZE_SHIFT,
+                            (event->flags & TRACE_FLAG_CAUSE) != 0,
+                            event->address, event->value);
+    else
+        trace_format_register(out, event->cycle,
+                              event->flags & TRACE_FLAG_TYPE,
+                              event->id & 0xFF, event->id >> 8, event->value);
+}
+
+/* Feeds the records of a binary trace to a new archive */
+static int create(FILE *in, FILE *out) {
+    char magic[sizeof(TRACE_MAGIC)-1];
+    struct trace_record records[256];
+    trace_archive archive;
+    uint32_t byte_order;
+    size_t count;
+    int result = 0;
+
+    if ((fread(magic, sizeof(magic), 1, in) != 1) ||
+        (memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) ||
+        (fread(&byte_order, sizeof(byte_order), 1, in) != 1) ||
+        (byte_order != TRACE_BYTE_ORDER)) {
+        fprintf(stderr, "Not a binary trace written by this kind of host\n");
+        return -1;
+    }
+    archive = trace_archive_create(out, 1);
+    if (archive == NULL)
+        return -1;
+    while ((result == 0) &&
+           ((count = fread(records, sizeof(struct trace_record), 256, in))
+            > 0))
+        result = trace_archive_add(archive, records, count);
+    if (trace_archive_close(archive) == -1)
+        result = -1;
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    struct trace_filter filter = { 0, 0xFFFFFFFF, 0, 0, 0xFFFFFFFF, -1 };
+    struct trace_query_stats stats;
+    char *archive_name = NULL;
+    FILE *in, *out;
+    int opt, result;
+
+    struct option longopts[] = {
+        { "create", required_argument, NULL, 'c' },
+        { "cycles", required_argument, NULL, 'y' },
+        { "addresses", required_argument, NULL, 'a' },
+        { "register", required_argument, NULL, 'r' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "c:y:a:r:h", longopts, NULL))
+           != -1) {
+        switch (opt) {
+          case 'c':
+            archive_name = optarg;
+            break;
+          case 'y':
+            if (parse_range(optarg, &filter.cycle_min, &filter.cycle_max)) {
+                fprintf(stderr, "Invalid cycle range %s\n", optarg);
+                exit(1);
+            }
+            break;
+          case 'a':
+            filter.has_addresses = 1;
+            if (parse_range(optarg, &filter.address_min,
+                            &filter.address_max)) {
+                fprintf(stderr, "Invalid address range %s\n", optarg);
+                exit(1);
+            }
+            break;
+          case 'r':
+            filter.reg = atoi(optarg);
+            break;
+          case 'h':
+            usage(argv[0]);
+            exit(0);
+          default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (archive_name) {
+        if (optind < argc - 1) {
+            usage(argv[0]);
+            exit(1);
+        }
+        in = stdin;
+        if ((optind < argc) && ((in = fopen(argv[optind], "r")) == NULL)) {
+            perror(argv[optind]);
+            exit(1);
+        }
+        out = fopen(archive_name, "w");
+        if (out == NULL) {
+            perror(archive_name);
+            exit(1);
+        }
+        result = create(in, out);
+        fclose(out);
+        return result ? 1 : 0;
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        exit(1);
+    }
+    in = fopen(argv[optind], "r");
+    if (in == NULL) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    result = trace_archive_query(in, &filter, print_event, stdout, &stats);
+    fclose(in);
+    fprintf(stderr, "%lu accesses selected, %lu chunks decoded, %lu "
+            "skipped\n", stats.events, stats.chunks_read,
+            stats.chunks_skipped);
+    return result ? 1 : 0;
+}
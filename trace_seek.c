@@ -0,0 +1,209 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "trace_format.h"
+#include "trace_index.h"
+
+void usage(char *name) {
+    fprintf(stderr, "Usage:\n"
+        "%s --cycles first:last [ --index index_file ] trace_file\n\n"
+        "Writes on the standard output, in text form, the part of a text or "
+        "binary trace between two cycles (included, either may be omitted). "
+        "The index written along the trace by the --trace-index option of "
+        "the simulator (trace_file.idx by default) is used to start reading "
+        "close to the first cycle.\n", name);
+}
+
+/* Copies the lines of in, from the first access at or after first, until
+ * an access after last. Other lines (processor states) are kept along the
+ * accesses they follow, inside tells whether the last access was kept.
+ * Returns 1 once past last. */
+static int print_window(FILE *in, uint32_t first, uint32_t last,
+                        int *inside) {
+    char *line = NULL, *cycle;
+    size_t size = 0;
+    uint32_t value;
+    int past = 0;
+
+    while (!past && (getline(&line, &size, in) != -1)) {
+        cycle = strstr(line, "Cycle ");
+        if (cycle) {
+            value = strtoul(cycle + 6, NULL, 10);
+            past = (value > last);
+            *inside = !past && (value >= first);
+        }
+        if (*inside)
+            fputs(line, stdout);
+    }
+    free(line);
+    return past;
+}
+
+static int parse_range(char *text, uint32_t *first, uint32_t *last) {
+    char *end;
+
+    if (*text != ':') {
+        *first = strtoul(text, &end, 0);
+        text = end;
+    }
+    if (*text++ != ':')
+        return -1;
+    if (*text != '\0') {
+        *last = strtoul(text, &end, 0);
+        text = end;
+    }
+    return (*text == '\0') ? 0 : -1;
+}
+
+/* Decodes a binary trace from the current position, by blocks written to a
+ * temporary file and then filtered, until the last cycle is reached */
+static int decode_window(FILE *in, trace_decoder decoder, FILE *text,
+                         uint32_t first, uint32_t last) {
+    struct trace_record records[1024];
+    size_t count;
+    int past = 0, inside = 0;
+
+    while (!past &&
+           ((count = fread(records, sizeof(struct trace_record), 1024, in))
+            > 0)) {
+        rewind(text);
+        if (ftruncate(fileno(text), 0) == -1)
+            return -1;
+        if (trace_decoder_feed(decoder, records, count) == -1)
+            return -1;
+        fflush(text);
+        rewind(text);
+        past = print_window(text, first, last, &inside) ||
+               (trace_decoder_cycle(decoder) > last);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const struct trace_index_entry *entry = NULL;
+    uint32_t first = 0, last = 0xFFFFFFFF, byte_order;
+    char *index_name = NULL, magic[sizeof(TRACE_MAGIC)-1];
+    trace_index index = NULL;
+    trace_decoder decoder;
+    FILE *in, *text;
+    int opt, i, binary, inside = 0, result = 0;
+
+    struct option longopts[] = {
+        { "cycles", required_argument, NULL, 'c' },
+        { "index", required_argument, NULL, 'i' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "c:i:h", longopts, NULL)) != -1) {
+        switch (opt) {
+          case 'c':
+            if (parse_range(optarg, &first, &last)) {
+                fprintf(stderr, "Invalid cycle range %s\n", optarg);
+                exit(1);
+            }
+            break;
+          case 'i':
+            index_name = optarg;
+            break;
+          case 'h':
+            usage(argv[0]);
+            exit(0);
+          default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        exit(1);
+    }
+    in = fopen(argv[optind], "r");
+    if (in == NULL) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    binary = (fread(magic, sizeof(magic), 1, in) == 1) &&
+             (memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0);
+    if (binary && ((fread(&byte_order, sizeof(byte_order), 1, in) != 1) ||
+                   (byte_order != TRACE_BYTE_ORDER))) {
+        fprintf(stderr, "Binary trace written by another kind of host\n");
+        exit(1);
+    }
+    if (!binary)
+        rewind(in);
+
+    if (index_name == NULL) {
+        index_name = malloc(strlen(argv[optind]) + 5);
+        if (index_name)
+            sprintf(index_name, "%s.idx", argv[optind]);
+    }
+    if (index_name) {
+        FILE *f = fopen(index_name, "r");
+
+        if (f) {
+            index = trace_index_load(f);
+            fclose(f);
+            if ((index == NULL) || (trace_index_binary(index) != binary)) {
+                fprintf(stderr, "%s is not an index of this trace, "
+                        "ignored\n", index_name);
+                index = NULL;
+            }
+        }
+    }
+    if (index)
+        entry = trace_index_find(index, first);
+    if (entry && (fseek(in, entry->offset, SEEK_SET) == -1)) {
+        perror(argv[optind]);
+        exit(1);
+    }
+
+    if (binary) {
+        text = tmpfile();
+        decoder = trace_decoder_create(text);
+        if ((text == NULL) || (decoder == NULL)) {
+            fprintf(stderr, "Cannot decode the trace\n");
+            exit(1);
+        }
+        if (index) {
+            for (i=0; i<trace_index_file_count(index); i++)
+                if (trace_index_file_name(index, i))
+                    trace_decoder_define_file(decoder, i,
+                                              trace_index_file_name(index, i));
+        }
+        if (entry)
+            trace_decoder_resume(decoder, entry->previous_cycle, entry->file,
+                                 entry->line);
+        result = decode_window(in, decoder, text, first, last);
+        trace_decoder_destroy(decoder);
+        fclose(text);
+    } else {
+        print_window(in, first, last, &inside);
+    }
+    fclose(in);
+    return result ? 1 : 0;
+}
@@ -0,0 +1,468 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include "trace_select.h"
+#include "trace.h"
+#include "arm_constants.h"
+
+#define MAX_RANGES 8
+#define MAX_TRIGGERS 16
+/* Longest specification, kept to be given back by the status command */
+#define SPEC_SIZE 128
+
+enum { FILTER_ADDRESSES, FILTER_REGISTERS, FILTER_MODES, FILTER_KINDS,
+       FILTERS };
+static const char *filter_names[FILTERS] = { "addresses", "registers",
+                                             "modes", "kinds" };
+static char filter_specs[FILTERS][SPEC_SIZE];
+
+struct range {
+    uint32_t first, last;
+};
+static struct range ranges[MAX_RANGES];
+static int range_count = 0;
+/* Bit sets of register numbers (cpsr and spsr included), modes and kinds */
+#define ALL_REGISTERS ((1 << (SPSR + 1)) - 1)
+#define ALL_MODES 0xFFFFFFFF
+#define ALL_KINDS (TRACE_KIND_READ | TRACE_KIND_WRITE | TRACE_KIND_FETCH)
+static uint32_t register_set = ALL_REGISTERS;
+static uint32_t mode_set = ALL_MODES;
+static uint32_t kind_set = ALL_KINDS;
+
+enum { TRIGGER_PC, TRIGGER_CYCLE, TRIGGER_EXCEPTION, TRIGGERS };
+static const char *trigger_names[TRIGGERS] = { "pc", "cycle", "exception" };
+static const char *exception_names[] = { NULL, "reset", "undefined", "swi",
+                                         "prefetch", "data", "irq", "fiq" };
+#define EXCEPTIONS (sizeof(exception_names)/sizeof(exception_names[0]))
+
+struct trigger {
+    int start, type, fired;
+    uint32_t value;
+    char spec[SPEC_SIZE];
+};
+static struct trigger triggers[MAX_TRIGGERS];
+static int trigger_count = 0;
+
+/* Sampling: period or probability (out of 2^32) and state of the streams */
+enum { NO_SAMPLING, PERIODIC, RANDOM };
+static int sampling = NO_SAMPLING;
+static char sampling_spec[SPEC_SIZE];
+static uint32_t period;
+static uint64_t threshold;
+static uint32_t random_state;
+static uint32_t countdown[TRACE_SAMPLE_STREAMS];
+static uint64_t seen_events[TRACE_SAMPLE_STREAMS];
+static uint64_t sampled_events[TRACE_SAMPLE_STREAMS];
+
+static int active = 1;
+static int used = 0;
+/* Current mode, 0 until the cpsr has been seen */
+static uint8_t current_mode = 0;
+
+/* Index in names of the name before the '=' of spec, value points after
+ * it. Returns -1 if there is none. */
+static int split(const char *spec, const char **names, int count,
+                 const char **value) {
+    const char *equal;
+    int i;
+
+    equal = strchr(spec, '=');
+    if (equal == NULL)
+        return -1;
+    for (i=0; i<count; i++)
+        if ((strlen(names[i]) == equal - spec) &&
+            (strncmp(spec, names[i], equal - spec) == 0)) {
+            *value = equal + 1;
+            return i;
+        }
+    return -1;
+}
+
+static int parse_number(const char *text, uint32_t *value) {
+    char *end;
+
+    if (*text == '\0')
+        return -1;
+    *value = strtoul(text, &end, 0);
+    return (*end == '\0') ? 0 : -1;
+}
+
+static int parse_register(const char *text, uint32_t *reg) {
+    static const char *names[] = { "sp", "lr", "pc", "cpsr", "spsr" };
+    int i;
+
+    for (i=0; i<5; i++)
+        if (strcasecmp(text, names[i]) == 0) {
+            *reg = 13 + i;
+            return 0;
+        }
+    if ((*text == 'r') || (*text == 'R'))
+        text++;
+    return ((parse_number(text, reg) == 0) && (*reg < 16)) ? 0 : -1;
+}
+
+static int parse_mode(const char *text, uint32_t *mode) {
+    for (*mode=0; *mode<32; (*mode)++)
+        if (arm_get_mode_name(*mode) &&
+            (strcasecmp(text, arm_get_mode_name(*mode)) == 0))
+            return 0;
+    return -1;
+}
+
+/* Parses the comma separated items of list into the set of bits or the
+ * count ranges */
+static int parse_list(int filter, const char *list, uint32_t *set,
+                      struct range *found, int *count) {
+    char copy[SPEC_SIZE], *item, *saved, *separator;
+    uint32_t first, last;
+
+    if (strlen(list) >= SPEC_SIZE)
+        return -1;
+    strcpy(copy, list);
+    *set = 0;
+    *count = 0;
+    for (item = strtok_r(copy, ",", &saved); item;
+         item = strtok_r(NULL, ",", &saved)) {
+        separator = strchr(item, (filter == FILTER_ADDRESSES) ? ':' : '-');
+        if (separator)
+            *separator++ = '\0';
+        switch (filter) {
+          case FILTER_ADDRESSES:
+            if ((*count == MAX_RANGES) || !separator ||
+                (parse_number(item, &first) == -1) ||
+                (parse_number(separator, &last) == -1) || (first > last))
+                return -1;
+            found[*count].first = first;
+            found[(*count)++].last = last;
+            continue;
+          case FILTER_REGISTERS:
+            if ((parse_register(item, &first) == -1) ||
+                (parse_register(separator ? separator : item, &last) == -1))
+                return -1;
+            break;
+          case FILTER_MODES:
+            if (separator || (parse_mode(item, &first) == -1))
+                return -1;
+            last = first;
+            break;
+          default:
+            if (separator)
+                return -1;
+            if (strcmp(item, "read") == 0)
+                *set |= TRACE_KIND_READ;
+            else if (strcmp(item, "write") == 0)
+                *set |= TRACE_KIND_WRITE;
+            else if (strcmp(item, "fetch") == 0)
+                *set |= TRACE_KIND_FETCH;
+            else
+                return -1;
+            continue;
+        }
+        for (; first <= last; first++)
+            *set |= 1U << first;
+    }
+    return 0;
+}
+
+int trace_select_filter(const char *spec) {
+    struct range found[MAX_RANGES];
+    const char *list;
+    uint32_t set;
+    int filter, count;
+
+    filter = split(spec, filter_names, FILTERS, &list);
+    if ((filter == -1) || (strlen(spec) >= SPEC_SIZE) ||
+        (parse_list(filter, list, &set, found, &count) == -1))
+        return -1;
+    switch (filter) {
+      case FILTER_ADDRESSES:
+        memcpy(ranges, found, count * sizeof(found[0]));
+        range_count = count;
+        break;
+      case FILTER_REGISTERS:
+        register_set = set;
+        break;
+      case FILTER_MODES:
+        mode_set = set;
+        break;
+      default:
+        kind_set = set;
+    }
+    strcpy(filter_specs[filter], spec);
+    used = 1;
+    return 0;
+}
+
+int trace_select_trigger(int start, const char *spec) {
+    struct trigger *trigger;
+    const char *value;
+    int type;
+
+    type = split(spec, trigger_names, TRIGGERS, &value);
+    if ((type == -1) || (trigger_count == MAX_TRIGGERS) ||
+        (strlen(spec) >= SPEC_SIZE))
+        return -1;
+    trigger = &triggers[trigger_count];
+    if (type == TRIGGER_EXCEPTION) {
+        for (trigger->value=1; (trigger->value<EXCEPTIONS) &&
+             strcmp(value, exception_names[trigger->value]);
+             trigger->value++)
+            ;
+        if (trigger->value == EXCEPTIONS)
+            return -1;
+    } else if (parse_number(value, &trigger->value) == -1) {
+        return -1;
+    }
+    trigger->start = start;
+    trigger->type = type;
+    trigger->fired = 0;
+    strcpy(trigger->spec, spec);
+    trigger_count++;
+    if (start)
+        active = 0;
+    used = 1;
+    return 0;
+}
+
+int trace_select_sampling(const char *spec) {
+    uint32_t value;
+    double rate;
+    char *end;
+    int i;
+
+    if (strcmp(spec, "off") == 0) {
+        sampling = NO_SAMPLING;
+        return 0;
+    }
+    if (strlen(spec) >= SPEC_SIZE)
+        return -1;
+    if (strncmp(spec, "every=", 6) == 0) {
+        if ((parse_number(spec + 6, &value) == -1) || (value == 0))
+            return -1;
+        sampling = PERIODIC;
+        period = value;
+    } else if (strncmp(spec, "rate=", 5) == 0) {
+        rate = strtod(spec + 5, &end);
+        if ((end == spec + 5) || *end || (rate <= 0) || (rate > 1))
+            return -1;
+        sampling = RANDOM;
+        threshold = rate * 4294967296.0;
+        random_state = 0x2545F491;
+    } else {
+        return -1;
+    }
+    for (i=0; i<TRACE_SAMPLE_STREAMS; i++) {
+        countdown[i] = period;
+        seen_events[i] = 0;
+        sampled_events[i] = 0;
+    }
+    strcpy(sampling_spec, spec);
+    used = 1;
+    return 0;
+}
+
+void trace_select_clear() {
+    int i;
+
+    for (i=0; i<FILTERS; i++)
+        filter_specs[i][0] = '\0';
+    range_count = 0;
+    register_set = ALL_REGISTERS;
+    mode_set = ALL_MODES;
+    kind_set = ALL_KINDS;
+    trigger_count = 0;
+    sampling = NO_SAMPLING;
+    active = 1;
+    used = 0;
+}
+
+int trace_select_used() {
+    return used || !active;
+}
+
+static void fire(struct trigger *trigger) {
+    trigger->fired = 1;
+    active = trigger->start;
+}
+
+void trace_select_fetch(uint32_t cycle, uint32_t address) {
+    int i;
+
+    for (i=0; i<trigger_count; i++)
+        if (((triggers[i].type == TRIGGER_PC) &&
+             (triggers[i].value == address)) ||
+            ((triggers[i].type == TRIGGER_CYCLE) && !triggers[i].fired &&
+             (cycle >= triggers[i].value)))
+            fire(&triggers[i]);
+}
+
+void trace_select_exception(uint8_t exception) {
+    int i;
+
+    for (i=0; i<trigger_count; i++)
+        if ((triggers[i].type == TRIGGER_EXCEPTION) &&
+            (triggers[i].value == exception))
+            fire(&triggers[i]);
+}
+
+int trace_select_active() {
+    return active;
+}
+
+void trace_select_set_active(int value) {
+    active = value;
+}
+
+void trace_select_mode(uint8_t mode) {
+    current_mode = mode;
+}
+
+static int in_ranges(uint32_t address) {
+    int i;
+
+    if (range_count == 0)
+        return 1;
+    for (i=0; i<range_count; i++)
+        if ((address >= ranges[i].first) && (address <= ranges[i].last))
+            return 1;
+    return 0;
+}
+
+static int in_modes(uint8_t mode) {
+    return (mode == 0) || ((mode_set >> (mode & 0x1F)) & 1);
+}
+
+int trace_select_memory(uint8_t kind, uint32_t address) {
+    return (kind_set & kind) && in_modes(current_mode) &&
+           in_ranges(address);
+}
+
+int trace_select_register(uint8_t kind, uint8_t reg, uint8_t mode) {
+    return (kind_set & kind) && ((register_set >> reg) & 1) &&
+           in_modes(mode ? mode : current_mode);
+}
+
+int trace_select_instruction(uint32_t address) {
+    return in_modes(current_mode) && in_ranges(address);
+}
+
+int trace_select_sample(int stream) {
+    if (sampling == NO_SAMPLING)
+        return 1;
+    seen_events[stream]++;
+    if (sampling == PERIODIC) {
+        if (--countdown[stream])
+            return 0;
+        countdown[stream] = period;
+    } else {
+        /* xorshift32 */
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 17;
+        random_state ^= random_state << 5;
+        if (random_state >= threshold)
+            return 0;
+    }
+    sampled_events[stream]++;
+    return 1;
+}
+
+int trace_select_samples(uint64_t *seen, uint64_t *sampled) {
+    int i;
+
+    if (sampling == NO_SAMPLING)
+        return -1;
+    for (i=0; i<TRACE_SAMPLE_STREAMS; i++) {
+        seen[i] = seen_events[i];
+        sampled[i] = sampled_events[i];
+        seen_events[i] = 0;
+        sampled_events[i] = 0;
+    }
+    return 0;
+}
+
+static void append(char *answer, size_t size, const char *format, ...) {
+    size_t length = strlen(answer);
+    va_list arguments;
+
+    va_start(arguments, format);
+    if (length < size)
+        vsnprintf(answer + length, size - length, format, arguments);
+    va_end(arguments);
+}
+
+int trace_select_command(const char *command, char *answer, size_t size) {
+    int i, result = 0;
+
+    answer[0] = '\0';
+    while (*command == ' ')
+        command++;
+    if (strcmp(command, "on") == 0) {
+        active = 1;
+    } else if (strcmp(command, "off") == 0) {
+        active = 0;
+    } else if (strcmp(command, "clear") == 0) {
+        trace_select_clear();
+    } else if (strcmp(command, "status") == 0) {
+        append(answer, size, "Tracing is %s\n", active ? "on" : "off");
+        for (i=0; i<FILTERS; i++)
+            if (filter_specs[i][0])
+                append(answer, size, "filter %s\n", filter_specs[i]);
+        for (i=0; i<trigger_count; i++)
+            append(answer, size, "%s %s%s\n",
+                   triggers[i].start ? "start" : "stop", triggers[i].spec,
+                   triggers[i].fired ? " (fired)" : "");
+        if (sampling != NO_SAMPLING)
+            append(answer, size, "sample %s (%llu of %llu memory accesses, "
+                   "%llu of %llu register accesses, %llu of %llu "
+                   "instructions so far)\n", sampling_spec,
+                   (unsigned long long) sampled_events[TRACE_SAMPLE_MEMORY],
+                   (unsigned long long) seen_events[TRACE_SAMPLE_MEMORY],
+                   (unsigned long long)
+                   sampled_events[TRACE_SAMPLE_REGISTERS],
+                   (unsigned long long) seen_events[TRACE_SAMPLE_REGISTERS],
+                   (unsigned long long)
+                   sampled_events[TRACE_SAMPLE_INSTRUCTIONS],
+                   (unsigned long long)
+                   seen_events[TRACE_SAMPLE_INSTRUCTIONS]);
+    } else if (strncmp(command, "filter ", 7) == 0) {
+        result = trace_select_filter(command + 7);
+    } else if (strncmp(command, "start ", 6) == 0) {
+        result = trace_select_trigger(1, command + 6);
+    } else if (strncmp(command, "stop ", 5) == 0) {
+        result = trace_select_trigger(0, command + 5);
+    } else if (strncmp(command, "sample ", 7) == 0) {
+        result = trace_select_sampling(command + 7);
+    } else {
+        append(answer, size, "Unknown trace command, use on, off, clear, "
+               "status, filter spec, start spec, stop spec or sample "
+               "spec\n");
+        return -1;
+    }
+    if (result == -1)
+        append(answer, size, "Invalid trace selection %s\n", command);
+    return result;
+}
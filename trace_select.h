@@ -0,0 +1,95 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#ifndef __TRACE_SELECT_H__
+#define __TRACE_SELECT_H__
+#include <stdint.h>
+#include <stddef.h>
+
+/* Selection of what is traced, set from the command line or from a gdb
+ * monitor command. Filters keep only some of the accesses :
+ * addresses=first:last[,first:last...]  memory accesses and instructions
+ *                                       within these ranges
+ * registers=list                        accesses to these registers (r0-r3,
+ *                                       sp, lr, pc, cpsr, spsr, 5...)
+ * modes=list                            accesses made in these modes (usr,
+ *                                       fiq, irq, svc, abt, und, sys)
+ * kinds=list                            read, write and/or fetch accesses
+ * Triggers start or stop tracing, tracing is off until a start trigger
+ * fires as soon as one is set :
+ * pc=address                            each time this instruction is
+ *                                       fetched
+ * cycle=count                           once this cycle is reached
+ * exception=name                        each time this exception (reset,
+ *                                       undefined, swi, prefetch, data,
+ *                                       irq, fiq) is taken
+ * Sampling then only keeps some of the memory accesses, register accesses
+ * and instructions, counted apart :
+ * every=count                           one in every count
+ * rate=fraction                         each one with this probability (0 to
+ *                                       1), the same run giving the same
+ *                                       samples
+ * off                                   all of them
+ * Specifications return -1 if they are not understood or too many.
+ */
+#define TRACE_KIND_READ  1
+#define TRACE_KIND_WRITE 2
+#define TRACE_KIND_FETCH 4
+
+#define TRACE_SAMPLE_MEMORY       0
+#define TRACE_SAMPLE_REGISTERS    1
+#define TRACE_SAMPLE_INSTRUCTIONS 2
+#define TRACE_SAMPLE_STREAMS      3
+
+int trace_select_filter(const char *spec);
+int trace_select_trigger(int start, const char *spec);
+int trace_select_sampling(const char *spec);
+/* Removes all the filters, triggers and sampling, tracing goes on */
+void trace_select_clear();
+/* Whether a filter or a trigger is set, the calls below are useless
+ * otherwise */
+int trace_select_used();
+
+/* Events checked against the triggers */
+void trace_select_fetch(uint32_t cycle, uint32_t address);
+void trace_select_exception(uint8_t exception);
+int trace_select_active();
+void trace_select_set_active(int active);
+/* Mode of the memory accesses to come, as given by the cpsr */
+void trace_select_mode(uint8_t mode);
+
+/* Whether an access or an executed instruction passes the filters */
+int trace_select_memory(uint8_t kind, uint32_t address);
+int trace_select_register(uint8_t kind, uint8_t reg, uint8_t mode);
+int trace_select_instruction(uint32_t address);
+/* Whether the next event of a stream (TRACE_SAMPLE_...) is sampled */
+int trace_select_sample(int stream);
+/* Number of events of each stream seen and sampled since the previous
+ * call, returns -1 if not sampling */
+int trace_select_samples(uint64_t *seen, uint64_t *sampled);
+
+/* Monitor command (without its leading "trace"), on, off, clear, status,
+ * filter spec, start spec, stop spec or sample spec. The text to give back to the user
+ * is put in answer. Returns -1 if the command fails. */
+int trace_select_command(const char *command, char *answer, size_t size);
+
+#endif
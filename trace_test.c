@@ -0,0 +1,648 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arm.h"
+#include "memory.h"
+#include "trace.h"
+#include "trace_format.h"
+#include "trace_archive.h"
+#include "trace_index.h"
+#include "registers.h"
+#include "trace_select.h"
+#include "trace_hash.h"
+#include "trace_fold.h"
+#include "arm_constants.h"
+
+/* mov r0, #5 ; add r0, r0, #1 ; str r0, [r1, #0x100] ; ldr r2, [r1, #0x100] */
+static uint32_t program[] = { 0xE3A00005, 0xE2800001, 0xE5810100,
+                              0xE5912100 };
+#define STEPS (sizeof(program)/sizeof(program[0]))
+
+/* Its instruction trace */
+static char instructions[] =
+    "Cycle 1, Instruction 00000000: E3A00005 mov r0, #5                   "
+    "R00=00000005\n"
+    "Cycle 2, Instruction 00000004: E2800001 add r0, r0, #1               "
+    "R00=00000006\n"
+    "Cycle 3, Instruction 00000008: E5810100 str r0, [r1, #256]           "
+    "[00000100]=00000006\n"
+    "Cycle 4, Instruction 0000000C: E5912100 ldr r2, [r1, #256]           "
+    "R02=00000006\n";
+
+void print_test(int result) {
+    if (result)
+        printf("Test succeded\n");
+    else
+        printf("TEST FAILED !!\n");
+}
+
+/* Runs the program on a fresh core, tracing into output, through a writer
+ * thread with a tiny buffer unless policy is -1, indexing every cycle into
+ * index unless it is NULL, hashed every hash cycles unless it is 0 */
+void run(FILE *output, int policy, FILE *index, uint32_t hash) {
+    memory mem;
+    arm_core p;
+    int i;
+
+    mem = memory_create(0x1000, 1);
+    for (i=0; i<STEPS; i++)
+        memory_write_word(mem, 4*i, program[i]);
+    set_trace_file(output);
+    if (index && (trace_start_index(index, 1) < 0)) {
+        fprintf(stderr, "Cannot start the trace index\n");
+        exit(1);
+    }
+    if ((policy >= 0) && (trace_start_writer(policy, 0) < 0)) {
+        fprintf(stderr, "Cannot start the trace writer\n");
+        exit(1);
+    }
+    if (hash && (trace_start_hash(hash) < 0)) {
+        fprintf(stderr, "Cannot start the trace hash\n");
+        exit(1);
+    }
+    p = arm_create(mem);
+    for (i=0; i<STEPS; i++) {
+        arm_step(p);
+        trace_arm_state(p);
+    }
+    trace_stop_writer();
+    trace_stop_hash();
+    arm_destroy(p);
+    memory_destroy(mem);
+}
+
+/* Content of a file, size is set to its length */
+char *content(FILE *f, long *size) {
+    char *data;
+
+    fflush(f);
+    *size = ftell(f);
+    data = malloc(*size + 1);
+    rewind(f);
+    if ((data == NULL) || (fread(data, 1, *size, f) != *size)) {
+        fprintf(stderr, "Cannot read temporary file\n");
+        exit(1);
+    }
+    return data;
+}
+
+/* Whether f holds size bytes equal to expected */
+int same_content(FILE *f, char *expected, long size) {
+    char *data;
+    long data_size;
+    int result;
+
+    data = content(f, &data_size);
+    result = (data_size == size) && (memcmp(data, expected, size) == 0);
+    free(data);
+    return result;
+}
+
+FILE *temporary() {
+    FILE *f;
+
+    f = tmpfile();
+    if (f == NULL) {
+        fprintf(stderr, "Cannot create temporary files\n");
+        exit(1);
+    }
+    return f;
+}
+
+/* Decodes the binary trace in f, returns whether it succeeds and, if
+ * expected is not NULL, gives the expected text */
+int check_decode(FILE *f, char *expected, long size) {
+    FILE *decoded;
+    int result;
+
+    rewind(f);
+    decoded = temporary();
+    result = (trace_decode(f, decoded) == 0) &&
+             ((expected == NULL) || same_content(decoded, expected, size));
+    fclose(decoded);
+    return result;
+}
+
+static void print_event(const struct trace_event *event, void *data) {
+    if (event->kind == TRACE_RECORD_MEMORY)
+        trace_format_memory(data, event->cycle,
+                            (event->flags & TRACE_FLAG_SEQ) != 0,
+                            event->flags & TRACE_FLAG_TYPE,
+                            event->flags >> TRACE_SIZE_SHIFT,
+                            (event->flags & TRACE_FLAG_CAUSE) != 0,
+                            event->address, event->value);
+    else
+        trace_format_register(data, event->cycle,
+                              event->flags & TRACE_FLAG_TYPE,
+                              event->id & 0xFF, event->id >> 8, event->value);
+}
+
+/* Whether the archive in f holds the accesses of the text trace expected,
+ * without their positions and instructions */
+int check_archive(FILE *f, char *expected) {
+    struct trace_filter all = { 0, 0xFFFFFFFF, 0, 0, 0, -1 };
+    struct trace_query_stats stats;
+    FILE *accesses, *queried;
+    char *line, *end, *text, *kind;
+    long size;
+    int result;
+
+    accesses = temporary();
+    for (line = expected; *line; line = end) {
+        end = strchr(line, '\n');
+        end = end ? end + 1 : line + strlen(line);
+        text = strstr(line, "Cycle ");
+        kind = text ? strchr(text, ',') : NULL;
+        if (text && (text < end) &&
+            !(kind && (strncmp(kind, ", Instruction ", 14) == 0)))
+            fwrite(text, 1, end - text, accesses);
+    }
+    text = content(accesses, &size);
+    queried = temporary();
+    rewind(f);
+    result = (trace_archive_query(f, &all, print_event, queried, &stats) == 0)
+             && same_content(queried, text, size);
+    fclose(accesses);
+    fclose(queried);
+    free(text);
+    return result;
+}
+
+/* Full state, then changes of r0, lr_svc and the flags, then none */
+int check_state_delta() {
+    static char expected[] =
+        "Changed: R00=00000007 CPSR=600001D3 (nzcv->nZCv) LR_SVC=00000040\n";
+    uint32_t previous[REGISTERS_STORAGE], state[REGISTERS_STORAGE];
+    FILE *f;
+    char *data;
+    long size;
+    int result;
+
+    memset(previous, 0, sizeof(previous));
+    previous[CPSR] = 0x1D3;
+    memcpy(state, previous, sizeof(state));
+    state[0] = 7;
+    state[CPSR] = 0x600001D3;
+    state[R14_SVC] = 0x40;
+    f = temporary();
+    trace_format_state(f, previous, NULL);
+    data = content(f, &size);
+    result = (strncmp(data, "State: R00=00000000 ", 20) == 0) &&
+             (strstr(data, " CPSR=000001D3 ") != NULL) &&
+             (strstr(data, " SPSR_FIQ=00000000\n") != NULL);
+    free(data);
+    rewind(f);
+    trace_format_state(f, state, previous);
+    trace_format_state(f, state, state);
+    result = result && same_content(f, expected, strlen(expected));
+    fclose(f);
+    return result;
+}
+
+/* Filters of accesses, then triggers started by a fetch at 8 and stopped
+ * by a software interrupt */
+int check_selection() {
+    int result;
+
+    result = (trace_select_filter("addresses=0x100:0x1ff,0x400:0x403") == 0)
+             && (trace_select_filter("kinds=read,fetch") == 0) &&
+             trace_select_memory(TRACE_KIND_READ, 0x180) &&
+             trace_select_memory(TRACE_KIND_FETCH, 0x403) &&
+             !trace_select_memory(TRACE_KIND_WRITE, 0x180) &&
+             !trace_select_memory(TRACE_KIND_READ, 0x200) &&
+             (trace_select_filter("registers=r0-r2,cpsr") == 0) &&
+             trace_select_register(TRACE_KIND_READ, CPSR, 0) &&
+             !trace_select_register(TRACE_KIND_READ, 3, SVC) &&
+             (trace_select_filter("modes=usr") == 0) &&
+             !trace_select_register(TRACE_KIND_READ, 0, SVC) &&
+             (trace_select_filter("registers=r16") == -1) &&
+             (trace_select_filter("bogus=1") == -1) &&
+             (trace_select_trigger(1, "pc=0x8") == 0) &&
+             (trace_select_trigger(0, "exception=swi") == 0) &&
+             !trace_select_active();
+    trace_select_fetch(1, 4);
+    result = result && !trace_select_active();
+    trace_select_fetch(2, 8);
+    result = result && trace_select_active();
+    trace_select_exception(SOFTWARE_INTERRUPT);
+    result = result && !trace_select_active();
+    trace_select_clear();
+    return result && trace_select_active() && !trace_select_used() &&
+           trace_select_memory(TRACE_KIND_WRITE, 0x200);
+}
+
+/* Trace of a run started by the fetch at 4 and stopped by the one at 0xC :
+ * from the read of the pc by the first fetch to the last access of cycle 3,
+ * nothing of the instruction fetched in cycle 4 */
+int check_triggered_window() {
+    FILE *f;
+    char *data, *first, *last, *line;
+    long size;
+    int result;
+
+    result = (trace_select_trigger(1, "pc=0x4") == 0) &&
+             (trace_select_trigger(0, "pc=0xc") == 0);
+    f = temporary();
+    run(f, -1, NULL, 0);
+    trace_select_clear();
+    data = content(f, &size);
+    data[size] = '\0';
+    first = strstr(data, "Cycle ");
+    last = NULL;
+    for (line = first; line; line = strstr(line + 1, "Cycle "))
+        last = line;
+    result = result && first &&
+             (strncmp(first, "Cycle 2, Register read, PC_SVC, val: "
+                      "00000008\n", 46) == 0) &&
+             (strncmp(last, "Cycle 3, ", 9) == 0) &&
+             (strstr(data, "Cycle 4, ") == NULL);
+    free(data);
+    fclose(f);
+    return result;
+}
+
+/* One in 4 events, then about a quarter of them, counted by stream */
+int check_sampling() {
+    uint64_t seen[TRACE_SAMPLE_STREAMS], sampled[TRACE_SAMPLE_STREAMS];
+    int i, count, result;
+
+    result = (trace_select_sampling("every=4") == 0);
+    for (i=0, count=0; i<10; i++)
+        count += trace_select_sample(TRACE_SAMPLE_MEMORY);
+    trace_select_sample(TRACE_SAMPLE_INSTRUCTIONS);
+    result = result && (count == 2) &&
+             (trace_select_samples(seen, sampled) == 0) &&
+             (seen[TRACE_SAMPLE_MEMORY] == 10) &&
+             (sampled[TRACE_SAMPLE_MEMORY] == 2) &&
+             (seen[TRACE_SAMPLE_INSTRUCTIONS] == 1) &&
+             (sampled[TRACE_SAMPLE_INSTRUCTIONS] == 0) &&
+             (seen[TRACE_SAMPLE_REGISTERS] == 0) &&
+             (trace_select_sampling("rate=0.25") == 0);
+    for (i=0, count=0; i<10000; i++)
+        count += trace_select_sample(TRACE_SAMPLE_REGISTERS);
+    result = result && (count > 2250) && (count < 2750) &&
+             (trace_select_samples(seen, sampled) == 0) &&
+             (sampled[TRACE_SAMPLE_REGISTERS] == count) &&
+             (trace_select_sampling("rate=2") == -1) &&
+             (trace_select_sampling("every=0") == -1);
+    trace_select_clear();
+    return result && trace_select_sample(TRACE_SAMPLE_MEMORY) &&
+           (trace_select_samples(seen, sampled) == -1);
+}
+
+/* Checkpoints of the hash list f, loaded with the given interval if f is a
+ * text trace */
+static long checkpoints(FILE *f, uint32_t *interval,
+                        struct trace_hash_checkpoint **loaded) {
+    rewind(f);
+    return trace_hash_load(f, interval, loaded);
+}
+
+/* Hash list of a run every 2 cycles, against the one of its text trace,
+ * then against the one of the text changed in cycle 3 */
+int check_hash(char *expected, long size) {
+    struct trace_hash_checkpoint *hashed, *text, *changed;
+    uint32_t hashed_interval, text_interval = 2, changed_interval = 2;
+    long count, i;
+    FILE *list, *f;
+    char *line;
+    int result;
+
+    text = changed = NULL;
+    list = temporary();
+    run(list, -1, NULL, 2);
+    count = checkpoints(list, &hashed_interval, &hashed);
+    f = temporary();
+    fwrite(expected, 1, size, f);
+    result = (count > 1) && (hashed_interval == 2) &&
+             (checkpoints(f, &text_interval, &text) == count);
+    for (i=0; result && (i < count); i++)
+        result = (text[i].cycle == hashed[i].cycle) &&
+                 (text[i].hash == hashed[i].hash);
+    line = strstr(expected, "Cycle 3,");
+    fseek(f, strchr(line, '\n') - expected - 1, SEEK_SET);
+    fputc('X', f);
+    result = result &&
+             (checkpoints(f, &changed_interval, &changed) == count);
+    for (i=0; result && (i < count) && (changed[i].hash == hashed[i].hash);
+         i++)
+        ;
+    result = result && (i < count) && (changed[i].cycle == 2);
+    fclose(list);
+    fclose(f);
+    free(hashed);
+    free(text);
+    free(changed);
+    return result;
+}
+
+/* Ten iterations of a loop storing to increasing addresses, folded after
+ * the first one and expanded back */
+int check_fold() {
+    static char loop[] = "Loop: 9 more times the last 2 instructions, every "
+                         "2 cycles, changes 0.0:+4 0.1:+1 1.0:+1\n";
+    char text[2048], expected[512];
+    FILE *in, *folded, *unfolded;
+    int i, size = 0, first = 0, result;
+
+    for (i=0; i<10; i++) {
+        size += sprintf(text + size, "Cycle %d, Instruction 00000000: "
+                        "E4801004 str r1, [r0], #4            "
+                        "[%08X]=%08X\n", 2*i + 1, 0x100 + 4*i, i);
+        size += sprintf(text + size, "Cycle %d, Instruction 00000004: "
+                        "E2811001 add r1, r1, #1              R01=%08X\n",
+                        2*i + 2, i + 1);
+        if (i == 0)
+            first = size;
+    }
+    size += sprintf(text + size, "Samples: none\n");
+    sprintf(expected, "%.*s%sSamples: none\n", first, text, loop);
+    in = temporary();
+    fwrite(text, 1, size, in);
+    rewind(in);
+    folded = temporary();
+    result = (trace_fold_text(in, folded) == 0) &&
+             same_content(folded, expected, strlen(expected));
+    rewind(folded);
+    unfolded = temporary();
+    result = result && (trace_unfold(folded, unfolded) == 0) &&
+             same_content(unfolded, text, size);
+    fclose(in);
+    fclose(folded);
+    fclose(unfolded);
+    return result;
+}
+
+static void count_event(const struct trace_event *event, void *data) {
+    (*(int *) data)++;
+}
+
+/* Number of events of the archive in f selected by filter, stats tells
+ * how many chunks have been skipped */
+int query_count(FILE *f, struct trace_filter *filter,
+                struct trace_query_stats *stats) {
+    int count = 0;
+
+    rewind(f);
+    if (trace_archive_query(f, filter, count_event, &count, stats) == -1)
+        return -1;
+    return count;
+}
+
+/* An archive of 3 chunks : one memory access every 2 cycles and, in the
+ * middle chunk only, accesses to r3 in between */
+void check_archive_queries() {
+    struct trace_record record = { 0, 0, 0, 1, 0, 0 };
+    struct trace_filter filter = { 0, 0xFFFFFFFF, 0, 0, 0, -1 };
+    struct trace_query_stats stats;
+    trace_archive archive;
+    FILE *f;
+    int i, count;
+
+    f = temporary();
+    archive = trace_archive_create(f, 1);
+    for (i=0; i<3*TRACE_ARCHIVE_CHUNK; i++) {
+        record.kind = TRACE_RECORD_MEMORY;
+        record.flags = (4 << TRACE_SIZE_SHIFT) | READ;
+        record.id = 0;
+        record.address = 0x1000 + 4*(i/2);
+        record.value = i;
+        if ((i >= TRACE_ARCHIVE_CHUNK) && (i < 2*TRACE_ARCHIVE_CHUNK) &&
+            (i % 2)) {
+            record.kind = TRACE_RECORD_REGISTER;
+            record.id = 3;
+            record.address = 0;
+        }
+        trace_archive_add(archive, &record, 1);
+    }
+    trace_archive_close(archive);
+
+    printf("Querying a cycle range of an archive, ");
+    filter.cycle_min = TRACE_ARCHIVE_CHUNK + 10;
+    filter.cycle_max = TRACE_ARCHIVE_CHUNK + 19;
+    count = query_count(f, &filter, &stats);
+    print_test((count == 10) && (stats.chunks_skipped == 2) &&
+               (stats.chunks_read == 1));
+
+    printf("Querying an address range of an archive, ");
+    filter.cycle_min = 0;
+    filter.cycle_max = 0xFFFFFFFF;
+    filter.has_addresses = 1;
+    filter.address_min = 0x1000;
+    filter.address_max = 0x1007;
+    count = query_count(f, &filter, &stats);
+    print_test((count == 4) && (stats.chunks_skipped == 2));
+
+    printf("Querying the accesses to a register in an archive, ");
+    filter.has_addresses = 0;
+    filter.reg = 3;
+    count = query_count(f, &filter, &stats);
+    print_test((count == TRACE_ARCHIVE_CHUNK/2) &&
+               (stats.chunks_skipped == 2));
+    fclose(f);
+}
+
+trace_index load_index(FILE *f) {
+    trace_index index;
+
+    fflush(f);
+    rewind(f);
+    index = trace_index_load(f);
+    if (index == NULL) {
+        fprintf(stderr, "Cannot load index\n");
+        exit(1);
+    }
+    return index;
+}
+
+/* Whether decoding the binary trace from each entry of its index gives the
+ * end of the expected text trace, from the entry of the same cycle in the
+ * index of the text trace */
+int check_index(FILE *binary, FILE *binary_index, char *expected, long size,
+                FILE *text_index) {
+    const struct trace_index_entry *text_entry, *binary_entry;
+    trace_index text_entries, binary_entries;
+    struct trace_record records[64];
+    trace_decoder decoder;
+    FILE *decoded;
+    size_t count;
+    int cycle, i, checked = 0, result = 1;
+
+    text_entries = load_index(text_index);
+    binary_entries = load_index(binary_index);
+    for (cycle = 0; result && (cycle < 16); cycle++) {
+        text_entry = trace_index_find(text_entries, cycle);
+        binary_entry = trace_index_find(binary_entries, cycle);
+        if (!text_entry || !binary_entry) {
+            result = !text_entry && !binary_entry;
+            continue;
+        }
+        if ((text_entry->cycle != binary_entry->cycle) ||
+            (text_entry->offset > size)) {
+            result = 0;
+            continue;
+        }
+        decoded = temporary();
+        decoder = trace_decoder_create(decoded);
+        for (i=0; i<trace_index_file_count(binary_entries); i++)
+            if (trace_index_file_name(binary_entries, i))
+                trace_decoder_define_file(decoder, i,
+                              trace_index_file_name(binary_entries, i));
+        trace_decoder_resume(decoder, binary_entry->previous_cycle,
+                             binary_entry->file, binary_entry->line);
+        fseek(binary, binary_entry->offset, SEEK_SET);
+        while ((count = fread(records, sizeof(struct trace_record), 64,
+                              binary)) > 0)
+            trace_decoder_feed(decoder, records, count);
+        trace_decoder_destroy(decoder);
+        result = same_content(decoded, expected + text_entry->offset,
+                              size - text_entry->offset);
+        fclose(decoded);
+        checked++;
+    }
+    return result && (checked > 1);
+}
+
+int main() {
+    FILE *text, *binary, *decoded, *async, *text_index, *binary_index;
+    char *expected, *result;
+    long expected_size, result_size, binary_size;
+
+    arm_init();
+    text = tmpfile();
+    binary = tmpfile();
+    decoded = tmpfile();
+    if ((text == NULL) || (binary == NULL) || (decoded == NULL)) {
+        fprintf(stderr, "Cannot create temporary files\n");
+        exit(1);
+    }
+    printf("Instruction trace, ");
+    trace_add(INSTRUCTION);
+    run(text, -1, NULL, 0);
+    print_test(same_content(text, instructions, strlen(instructions)));
+    rewind(text);
+
+    /* Instructions are kept in the following traces */
+    trace_add(MEMORY | REGISTERS | STATE | POSITION);
+    run(text, -1, NULL, 0);
+    expected = content(text, &expected_size);
+    text_index = temporary();
+    async = temporary();
+    run(async, -1, text_index, 0);
+    trace_flush();
+    fclose(async);
+
+    printf("Hash list of a text trace, ");
+    print_test(check_hash(expected, expected_size));
+
+    printf("Text trace of the window between two triggers, ");
+    print_test(check_triggered_window());
+
+    printf("Text trace written by a blocking writer thread, ");
+    async = temporary();
+    run(async, TRACE_BLOCK, NULL, 0);
+    print_test(same_content(async, expected, expected_size));
+    fclose(async);
+
+    printf("Text trace written by a growing writer thread, ");
+    async = temporary();
+    run(async, TRACE_GROW, NULL, 0);
+    print_test(same_content(async, expected, expected_size));
+    fclose(async);
+
+    trace_add(BINARY);
+    run(binary, -1, NULL, 0);
+    trace_flush();
+    fflush(binary);
+    binary_size = ftell(binary);
+    rewind(binary);
+
+    printf("Decoding a binary trace of registers, memory, state and "
+           "positions, ");
+    result = NULL;
+    if (trace_decode(binary, decoded) == 0)
+        result = content(decoded, &result_size);
+    print_test(result && (result_size == expected_size) &&
+               (memcmp(result, expected, expected_size) == 0));
+    printf("Binary trace is %ld bytes, text trace %ld bytes\n", binary_size,
+           expected_size);
+
+    printf("Decoding a binary trace from each entry of its index, ");
+    binary_index = temporary();
+    async = temporary();
+    run(async, -1, binary_index, 0);
+    trace_flush();
+    print_test(check_index(async, binary_index, expected, expected_size,
+                           text_index));
+    fclose(async);
+
+    printf("Binary trace written by a blocking writer thread, ");
+    async = temporary();
+    run(async, TRACE_BLOCK, NULL, 0);
+    print_test(check_decode(async, expected, expected_size));
+    fclose(async);
+
+    printf("Binary trace written by a dropping writer thread stays valid, ");
+    async = temporary();
+    run(async, TRACE_DROP, NULL, 0);
+    print_test(check_decode(async, NULL, 0));
+    fclose(async);
+
+    printf("Archive of the accesses of a trace, ");
+    trace_add(ARCHIVE);
+    async = temporary();
+    run(async, -1, NULL, 0);
+    trace_flush();
+    print_test(check_archive(async, expected));
+    fclose(async);
+
+    printf("Archive written by a writer thread, ");
+    async = temporary();
+    run(async, TRACE_BLOCK, NULL, 0);
+    print_test(check_archive(async, expected));
+    fclose(async);
+
+    check_archive_queries();
+
+    printf("Processor state changes, ");
+    print_test(check_state_delta());
+
+    printf("Trace filters and triggers, ");
+    print_test(check_selection());
+
+    printf("Sampling of trace events, ");
+    print_test(check_sampling());
+
+    printf("Folding the loops of an instruction trace, ");
+    print_test(check_fold());
+
+    printf("Rejecting a text trace, ");
+    rewind(text);
+    print_test(trace_decode(text, decoded) == -1);
+
+    free(expected);
+    free(result);
+    return 0;
+}
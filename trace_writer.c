@@ -0,0 +1,261 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "trace_writer.h"
+#include "trace_archive.h"
+
+/* Both sides poll rather than signal each other, so that pushing a record
+ * never costs a system call. The writer sleeps this long when idle. */
+#define IDLE_DELAY_NS 1000000
+#define FULL_DELAY_NS 10000
+/* Records written before giving their room back to a waiting producer */
+#define BATCH_SIZE 1024
+
+/* Records are in [tail, head[, indexes grow forever and are masked. When the
+ * producer grows the buffer, it links a new ring and never writes again to
+ * the old one, which the writer frees once empty. */
+struct ring {
+    struct trace_record *records;
+    size_t mask;
+    /* Written by the producer */
+    size_t head;
+    struct ring *next;
+    /* Written by the writer, kept apart from head to avoid false sharing */
+    char padding[64];
+    size_t tail;
+};
+
+struct trace_writer_data {
+    FILE *output;
+    enum trace_output format;
+    trace_decoder decoder;
+    trace_archive archive;
+    enum trace_full_policy policy;
+    /* Producer side */
+    struct ring *producer;
+    size_t cached_tail;
+    uint64_t dropped;
+    /* Writer side, read by the producer when flushing */
+    struct ring *consumer;
+    int stop;
+    pthread_t thread;
+};
+
+static struct ring *ring_create(size_t capacity) {
+    struct ring *ring;
+
+    ring = calloc(1, sizeof(struct ring));
+    if (ring == NULL)
+        return NULL;
+    ring->records = malloc(capacity * sizeof(struct trace_record));
+    if (ring->records == NULL) {
+        free(ring);
+        return NULL;
+    }
+    ring->mask = capacity - 1;
+    return ring;
+}
+
+static void ring_destroy(struct ring *ring) {
+    free(ring->records);
+    free(ring);
+}
+
+static void pause_for(long ns) {
+    struct timespec delay = { 0, ns };
+
+    nanosleep(&delay, NULL);
+}
+
+static void write_records(trace_writer w, struct trace_record *records,
+                          size_t count) {
+    switch (w->format) {
+      case TRACE_BINARY:
+        fwrite(records, sizeof(struct trace_record), count, w->output);
+        break;
+      case TRACE_ARCHIVE:
+        trace_archive_add(w->archive, records, count);
+        break;
+      default:
+        trace_decoder_feed(w->decoder, records, count);
+    }
+}
+
+static void *writer_thread(void *arg) {
+    trace_writer w = arg;
+    struct ring *ring, *next;
+    size_t head, tail, start, end;
+    int written = 0;
+
+    while (1) {
+        ring = w->consumer;
+        tail = ring->tail;
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head != tail) {
+            if (head - tail > BATCH_SIZE)
+                head = tail + BATCH_SIZE;
+            /* At most two contiguous parts, around the end of the buffer */
+            start = tail & ring->mask;
+            end = ((head - 1) & ring->mask) + 1;
+            if (end > start) {
+                write_records(w, ring->records + start, end - start);
+            } else {
+                write_records(w, ring->records + start,
+                              ring->mask + 1 - start);
+                write_records(w, ring->records, end);
+            }
+            __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+            written = 1;
+            continue;
+        }
+        next = __atomic_load_n(&ring->next, __ATOMIC_ACQUIRE);
+        if (next) {
+            /* Records pushed before the switch are visible now */
+            if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != tail)
+                continue;
+            __atomic_store_n(&w->consumer, next, __ATOMIC_RELEASE);
+            ring_destroy(ring);
+            continue;
+        }
+        if (written) {
+            fflush(w->output);
+            written = 0;
+        }
+        if (__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE))
+            break;
+        pause_for(IDLE_DELAY_NS);
+    }
+    return NULL;
+}
+
+trace_writer trace_writer_create(FILE *output, enum trace_output format,
+                                 size_t capacity,
+                                 enum trace_full_policy policy,
+                                 trace_index index) {
+    trace_writer w;
+    size_t size;
+
+    for (size = TRACE_WRITER_MIN_CAPACITY; size < capacity; size *= 2)
+        ;
+    w = calloc(1, sizeof(struct trace_writer_data));
+    if (w == NULL)
+        return NULL;
+    w->output = output;
+    w->format = format;
+    w->policy = policy;
+    if (format == TRACE_BINARY) {
+        uint32_t byte_order = TRACE_BYTE_ORDER;
+
+        fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC)-1, output);
+        fwrite(&byte_order, sizeof(byte_order), 1, output);
+    } else if (format == TRACE_ARCHIVE) {
+        w->archive = trace_archive_create(output, 1);
+        if (w->archive == NULL)
+            goto error;
+    } else {
+        w->decoder = trace_decoder_create(output);
+        if (w->decoder == NULL)
+            goto error;
+        trace_decoder_set_index(w->decoder, index);
+    }
+    w->producer = ring_create(size);
+    if (w->producer == NULL)
+        goto error;
+    w->consumer = w->producer;
+    if (pthread_create(&w->thread, NULL, writer_thread, w) != 0) {
+        ring_destroy(w->producer);
+        goto error;
+    }
+    return w;
+
+error:
+    if (w->decoder)
+        trace_decoder_destroy(w->decoder);
+    if (w->archive)
+        trace_archive_close(w->archive);
+    free(w);
+    return NULL;
+}
+
+void trace_writer_destroy(trace_writer w) {
+    __atomic_store_n(&w->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(w->thread, NULL);
+    if (w->archive)
+        trace_archive_close(w->archive);
+    fflush(w->output);
+    if (w->dropped)
+        fprintf(stderr, "%llu trace records dropped, the trace writer could "
+                "not keep up\n", (unsigned long long) w->dropped);
+    ring_destroy(w->consumer);
+    if (w->decoder)
+        trace_decoder_destroy(w->decoder);
+    free(w);
+}
+
+int trace_writer_push(trace_writer w, const struct trace_record *records,
+                      size_t count, int reliable) {
+    struct ring *ring = w->producer, *larger;
+    size_t head, i;
+
+    head = ring->head;
+    while (head + count - w->cached_tail > ring->mask + 1) {
+        w->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (head + count - w->cached_tail <= ring->mask + 1)
+            break;
+        if ((w->policy == TRACE_DROP) && !reliable) {
+            w->dropped += count;
+            return -1;
+        }
+        if (w->policy == TRACE_GROW) {
+            larger = ring_create(2 * (ring->mask + 1));
+            if (larger) {
+                __atomic_store_n(&ring->next, larger, __ATOMIC_RELEASE);
+                w->producer = ring = larger;
+                head = 0;
+                w->cached_tail = 0;
+                break;
+            }
+        }
+        pause_for(FULL_DELAY_NS);
+    }
+    for (i=0; i<count; i++)
+        ring->records[(head + i) & ring->mask] = records[i];
+    __atomic_store_n(&ring->head, head + count, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void trace_writer_flush(trace_writer w) {
+    struct ring *ring = w->producer;
+
+    while ((__atomic_load_n(&w->consumer, __ATOMIC_ACQUIRE) != ring) ||
+           (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != ring->head))
+        pause_for(FULL_DELAY_NS);
+    fflush(w->output);
+}
+
+uint64_t trace_writer_dropped(trace_writer w) {
+    return w->dropped;
+}
@@ -0,0 +1,65 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#ifndef __TRACE_WRITER_H__
+#define __TRACE_WRITER_H__
+#include <stdio.h>
+#include <stdint.h>
+#include "trace_format.h"
+#include "trace_index.h"
+
+/* Background writer of traces: records are pushed by a single producer (the
+ * simulation thread) into a lock-free ring buffer, a thread drains it and
+ * performs the formatting (text traces) and the I/O. When the buffer is
+ * full, the producer either waits for the writer (TRACE_BLOCK), loses the
+ * records (TRACE_DROP, they are counted) or switches to a buffer twice as
+ * large (TRACE_GROW).
+ */
+enum trace_full_policy { TRACE_BLOCK, TRACE_DROP, TRACE_GROW };
+/* What is written: text, records as they are (after the header of binary
+ * traces) or a trace archive (see trace_archive.h) */
+enum trace_output { TRACE_TEXT, TRACE_BINARY, TRACE_ARCHIVE };
+
+typedef struct trace_writer_data *trace_writer;
+
+/* The capacity, in records, is rounded up to a power of two of at least
+ * TRACE_WRITER_MIN_CAPACITY. Text traces are indexed into index, unless it
+ * is NULL.
+ */
+#define TRACE_WRITER_MIN_CAPACITY 128
+trace_writer trace_writer_create(FILE *output, enum trace_output format,
+                                 size_t capacity,
+                                 enum trace_full_policy policy,
+                                 trace_index index);
+/* Flushes the writer and reports the dropped records on stderr */
+void trace_writer_destroy(trace_writer w);
+
+/* Producer side. Pushes count records (at most TRACE_WRITER_MIN_CAPACITY/2),
+ * all or none of them. Returns -1 if they have been dropped, which never
+ * happens to reliable records: they are blocked upon instead. */
+int trace_writer_push(trace_writer w, const struct trace_record *records,
+                      size_t count, int reliable);
+/* Waits until everything pushed so far has been written */
+void trace_writer_flush(trace_writer w);
+uint64_t trace_writer_dropped(trace_writer w);
+
+#endif
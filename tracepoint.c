@@ -0,0 +1,662 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tracepoint.h"
+#include "address_map.h"
+#include "debug.h"
+
+/* Default maximum size of the frames buffer */
+#define DEFAULT_BUFFER_SIZE (16*1024*1024)
+/* Registers collected by an R action : r0..r15 and cpsr */
+#define FRAME_REGISTERS 17
+#define GDB_PC 15
+
+/* Frames are stored one after the other in the buffer as a sequence of
+ * blocks, each starting with its kind:
+ * - 'R' followed by the registers (uint32_t)
+ * - 'M' followed by the address and size (uint32_t) and the bytes
+ * - 'V' followed by the variable number (int32_t) and value (int64_t)
+ */
+enum action_kind { COLLECT_REGISTERS, COLLECT_MEMORY, EVALUATE };
+
+struct action {
+    enum action_kind kind;
+    /* COLLECT_MEMORY : base register (-1 for none) + offset, size bytes */
+    int base;
+    uint32_t offset, size;
+    agent_expr expr;
+};
+
+struct tracepoint {
+    int number;
+    uint32_t address;
+    int enabled;
+    uint64_t pass_count;
+    agent_expr condition;
+    int action_count;
+    struct action *actions;
+    uint64_t hits, usage;
+};
+
+struct frame {
+    struct tracepoint *tracepoint;
+    size_t offset, size;
+};
+
+struct variable {
+    int number;
+    int64_t initial, value;
+};
+
+struct tracepoint_set_data {
+    address_map addresses;
+    int count;
+    struct tracepoint *tracepoints;
+    int variable_count;
+    struct variable *variables;
+
+    int running;
+    /* Reason of the last stop, as in qTStatus replies */
+    char stop_reason[32];
+    int created_frames;
+
+    uint8_t *buffer;
+    size_t used, capacity, max_size;
+    int frame_count, frame_capacity;
+    struct frame *frames;
+    /* Frame being collected, its collection fails when the buffer is full */
+    int collect_failed;
+    memory mem;
+};
+
+tracepoint_set tracepoint_set_create(size_t memory_size) {
+    tracepoint_set set;
+
+    set = calloc(1, sizeof(struct tracepoint_set_data));
+    if (set) {
+        set->addresses = address_map_create(memory_size);
+        if (set->addresses == NULL) {
+            free(set);
+            return NULL;
+        }
+        set->max_size = DEFAULT_BUFFER_SIZE;
+        strcpy(set->stop_reason, "tnotrun:0");
+    }
+    return set;
+}
+
+static void free_tracepoint(struct tracepoint *tracepoint) {
+    int i;
+
+    agent_expr_destroy(tracepoint->condition);
+    for (i=0; i<tracepoint->action_count; i++)
+        agent_expr_destroy(tracepoint->actions[i].expr);
+    free(tracepoint->actions);
+}
+
+static void discard_frames(tracepoint_set set) {
+    int i;
+
+    set->used = 0;
+    set->frame_count = 0;
+    set->created_frames = 0;
+    for (i=0; i<set->count; i++) {
+        set->tracepoints[i].hits = 0;
+        set->tracepoints[i].usage = 0;
+    }
+}
+
+void tracepoint_clear(tracepoint_set set) {
+    int i;
+
+    for (i=0; i<set->count; i++) {
+        address_map_set(set->addresses, set->tracepoints[i].address, 0);
+        free_tracepoint(&set->tracepoints[i]);
+    }
+    free(set->tracepoints);
+    set->tracepoints = NULL;
+    set->count = 0;
+    free(set->variables);
+    set->variables = NULL;
+    set->variable_count = 0;
+    discard_frames(set);
+    set->running = 0;
+    strcpy(set->stop_reason, "tnotrun:0");
+}
+
+void tracepoint_set_destroy(tracepoint_set set) {
+    tracepoint_clear(set);
+    address_map_destroy(set->addresses);
+    free(set->buffer);
+    free(set->frames);
+    free(set);
+}
+
+static struct tracepoint *find(tracepoint_set set, int number,
+                               uint32_t address) {
+    int i;
+
+    for (i=0; i<set->count; i++)
+        if ((set->tracepoints[i].number == number) &&
+            (set->tracepoints[i].address == address))
+            return &set->tracepoints[i];
+    return NULL;
+}
+
+static struct variable *find_variable(tracepoint_set set, int number) {
+    int i;
+
+    for (i=0; i<set->variable_count; i++)
+        if (set->variables[i].number == number)
+            return &set->variables[i];
+    return NULL;
+}
+
+/* Actions : R mask, M base,offset,size or X len,bytecode, optionally
+ * preceded by S for while-stepping actions, which are not supported (the
+ * simulator does not step after a tracepoint) and ignored. */
+static int parse_actions(struct tracepoint *tracepoint, const char *text) {
+    struct action action, *actions;
+    int stepping;
+    char *end;
+
+    while (*text && (*text != '-')) {
+        stepping = (*text == 'S');
+        if (stepping)
+            text++;
+        action.expr = NULL;
+        switch (*text) {
+          case 'R':
+            /* All the registers are collected whatever the mask */
+            action.kind = COLLECT_REGISTERS;
+            strtoul(text+1, &end, 16);
+            break;
+          case 'M':
+            action.kind = COLLECT_MEMORY;
+            action.base = strtol(text+1, &end, 16);
+            if (*end++ != ',')
+                return -1;
+            action.offset = strtoull(end, &end, 16);
+            if (*end++ != ',')
+                return -1;
+            action.size = strtoul(end, &end, 16);
+            break;
+          case 'X':
+            action.kind = EVALUATE;
+            action.expr = agent_expr_create(text, (const char **) &end);
+            if (action.expr == NULL)
+                return -1;
+            break;
+          default:
+            return -1;
+        }
+        text = end;
+        if (stepping) {
+            agent_expr_destroy(action.expr);
+            continue;
+        }
+        actions = realloc(tracepoint->actions, (tracepoint->action_count + 1)
+                          * sizeof(struct action));
+        if (actions == NULL) {
+            agent_expr_destroy(action.expr);
+            return -1;
+        }
+        tracepoint->actions = actions;
+        tracepoint->actions[tracepoint->action_count++] = action;
+    }
+    return 0;
+}
+
+int tracepoint_define(tracepoint_set set, const char *definition) {
+    struct tracepoint tracepoint, *tracepoints, *existing;
+    unsigned int number, address, step;
+    unsigned long long pass;
+    const char *position;
+    char enabled;
+
+    if (*definition == '-') {
+        /* Actions of an existing tracepoint */
+        if (sscanf(definition+1, "%x:%x:", &number, &address) != 2)
+            return -1;
+        existing = find(set, number, address);
+        position = index(definition+1, ':');
+        position = position ? index(position+1, ':') : NULL;
+        if ((existing == NULL) || (position == NULL))
+            return -1;
+        return parse_actions(existing, position+1);
+    }
+
+    if (sscanf(definition, "%x:%x:%c:%x:%llx", &number, &address, &enabled,
+               &step, &pass) != 5)
+        return -1;
+    memset(&tracepoint, 0, sizeof(tracepoint));
+    tracepoint.number = number;
+    tracepoint.address = address;
+    tracepoint.enabled = (enabled == 'E');
+    tracepoint.pass_count = pass;
+    /* Optional fast/static tracepoint flags and condition */
+    position = index(definition, ':');
+    while (position && (position[1] != 'X'))
+        position = index(position+1, ':');
+    if (position) {
+        tracepoint.condition = agent_expr_create(position+1, NULL);
+        if (tracepoint.condition == NULL)
+            return -1;
+    }
+
+    /* The address is only marked once a tracepoint is stored there, a
+     * replaced one already marked it */
+    existing = find(set, number, address);
+    if (existing) {
+        free_tracepoint(existing);
+        *existing = tracepoint;
+    } else {
+        tracepoints = realloc(set->tracepoints,
+                              (set->count + 1) * sizeof(struct tracepoint));
+        if (tracepoints == NULL) {
+            free_tracepoint(&tracepoint);
+            return -1;
+        }
+        set->tracepoints = tracepoints;
+        if (address_map_set(set->addresses, address, 1) == -1) {
+            free_tracepoint(&tracepoint);
+            return -1;
+        }
+        set->tracepoints[set->count++] = tracepoint;
+    }
+    debug("Tracepoint %d at %08x\n", number, address);
+    return 0;
+}
+
+int tracepoint_define_variable(tracepoint_set set, const char *definition) {
+    struct variable *variables, *variable;
+    unsigned int number;
+    long long value;
+
+    /* number:value:builtin:name, the value being a 64 bits hex integer */
+    if (sscanf(definition, "%x:%llx:", &number, &value) != 2)
+        return -1;
+    variable = find_variable(set, number);
+    if (variable == NULL) {
+        variables = realloc(set->variables, (set->variable_count + 1) *
+                            sizeof(struct variable));
+        if (variables == NULL)
+            return -1;
+        set->variables = variables;
+        variable = &set->variables[set->variable_count++];
+    }
+    variable->number = number;
+    variable->initial = value;
+    variable->value = value;
+    return 0;
+}
+
+int tracepoint_enable(tracepoint_set set, int number, uint32_t address,
+                      int enabled) {
+    struct tracepoint *tracepoint = find(set, number, address);
+
+    if (tracepoint == NULL)
+        return -1;
+    tracepoint->enabled = enabled;
+    return 0;
+}
+
+void tracepoint_set_buffer_size(tracepoint_set set, long size) {
+    set->max_size = (size < 0) ? DEFAULT_BUFFER_SIZE : size;
+}
+
+void tracepoint_start(tracepoint_set set) {
+    int i;
+
+    discard_frames(set);
+    for (i=0; i<set->variable_count; i++)
+        set->variables[i].value = set->variables[i].initial;
+    set->running = 1;
+    strcpy(set->stop_reason, "tunknown:0");
+}
+
+static void stop(tracepoint_set set, const char *reason) {
+    set->running = 0;
+    snprintf(set->stop_reason, sizeof(set->stop_reason), "%s", reason);
+    debug("Tracing stopped (%s)\n", reason);
+}
+
+void tracepoint_stop(tracepoint_set set) {
+    if (set->running)
+        stop(set, "tstop::0");
+}
+
+int tracepoint_running(tracepoint_set set) {
+    return set->running;
+}
+
+/* Appends size bytes to the frame being collected */
+static int append(tracepoint_set set, const void *data, size_t size) {
+    size_t capacity;
+    uint8_t *buffer;
+
+    if (set->collect_failed || (set->used + size > set->max_size)) {
+        set->collect_failed = 1;
+        return -1;
+    }
+    if (set->used + size > set->capacity) {
+        capacity = set->capacity ? set->capacity : 4096;
+        while (capacity < set->used + size)
+            capacity *= 2;
+        buffer = realloc(set->buffer, capacity);
+        if (buffer == NULL) {
+            set->collect_failed = 1;
+            return -1;
+        }
+        set->buffer = buffer;
+        set->capacity = capacity;
+    }
+    /* Without data, the room is only reserved */
+    if (data)
+        memcpy(set->buffer + set->used, data, size);
+    set->used += size;
+    return 0;
+}
+
+static int collect_memory(void *data, uint32_t address, size_t size) {
+    tracepoint_set set = data;
+    uint32_t header[2] = { address, size };
+    uint8_t kind = 'M';
+    size_t position;
+
+    if ((size > UINT32_MAX) || ((uint64_t) address + size > UINT32_MAX + 1ULL)
+        || (append(set, &kind, 1) == -1) ||
+        (append(set, header, sizeof(header)) == -1))
+        return -1;
+    position = set->used;
+    if ((append(set, NULL, size) == -1) ||
+        (memory_read_block(set->mem, address, size, set->buffer + position)
+         == -1)) {
+        set->collect_failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static int get_variable(void *data, int number, int64_t *value) {
+    struct variable *variable = find_variable(data, number);
+
+    if (variable == NULL)
+        return -1;
+    *value = variable->value;
+    return 0;
+}
+
+static int set_variable(void *data, int number, int64_t value) {
+    struct variable *variable = find_variable(data, number);
+
+    if (variable == NULL)
+        return -1;
+    variable->value = value;
+    return 0;
+}
+
+static int collect_variable(void *data, int number) {
+    tracepoint_set set = data;
+    struct variable *variable = find_variable(set, number);
+    int32_t header = number;
+    uint8_t kind = 'V';
+
+    if ((variable == NULL) || (append(set, &kind, 1) == -1) ||
+        (append(set, &header, sizeof(header)) == -1) ||
+        (append(set, &variable->value, sizeof(variable->value)) == -1))
+        return -1;
+    return 0;
+}
+
+void tracepoint_bind_variables(tracepoint_set set, agent_context context) {
+    context->get_variable = get_variable;
+    context->set_variable = set_variable;
+    context->data = set;
+}
+
+int tracepoint_variable(tracepoint_set set, int number, int64_t *value) {
+    return get_variable(set, number, value);
+}
+
+static int collect_registers(tracepoint_set set, arm_core arm) {
+    uint32_t registers[FRAME_REGISTERS];
+    uint8_t kind = 'R';
+    int i;
+
+    for (i=0; i<16; i++)
+        registers[i] = arm_read_register(arm, i);
+    /* r15 is ahead of the executed instruction */
+    registers[GDB_PC] -= 4;
+    registers[16] = arm_read_cpsr(arm);
+    if ((append(set, &kind, 1) == -1) ||
+        (append(set, registers, sizeof(registers)) == -1))
+        return -1;
+    return 0;
+}
+
+static int run_action(tracepoint_set set, struct action *action,
+                      agent_context context) {
+    uint32_t base = 0;
+
+    switch (action->kind) {
+      case COLLECT_REGISTERS:
+        return collect_registers(set, context->arm);
+      case COLLECT_MEMORY:
+        if (action->base >= 0) {
+            if (action->base > 15)
+                return -1;
+            base = arm_read_register(context->arm, action->base);
+            if (action->base == GDB_PC)
+                base -= 4;
+        }
+        return collect_memory(set, base + action->offset, action->size);
+      case EVALUATE:
+        return agent_expr_eval(action->expr, context, NULL);
+    }
+    return -1;
+}
+
+static void hit(tracepoint_set set, struct tracepoint *tracepoint,
+                agent_context context) {
+    struct frame *frames;
+    size_t start = set->used;
+    int i;
+
+    if (set->frame_count == set->frame_capacity) {
+        frames = realloc(set->frames, (set->frame_capacity * 2 + 16) *
+                         sizeof(struct frame));
+        if (frames == NULL) {
+            stop(set, "tfull:0");
+            return;
+        }
+        set->frames = frames;
+        set->frame_capacity = set->frame_capacity * 2 + 16;
+    }
+    set->collect_failed = 0;
+    for (i=0; i<tracepoint->action_count; i++)
+        /* gdb ignores errors in actions, so does gdbserver : collection goes
+         * on with the following ones unless the buffer is full */
+        if ((run_action(set, &tracepoint->actions[i], context) == -1) &&
+            set->collect_failed)
+            break;
+    if (set->collect_failed) {
+        set->used = start;
+        stop(set, "tfull:0");
+        return;
+    }
+    set->frames[set->frame_count].tracepoint = tracepoint;
+    set->frames[set->frame_count].offset = start;
+    set->frames[set->frame_count].size = set->used - start;
+    set->frame_count++;
+    set->created_frames++;
+    tracepoint->hits++;
+    tracepoint->usage += set->used - start;
+    if (tracepoint->pass_count && (tracepoint->hits >= tracepoint->pass_count))
+    {
+        char reason[32];
+
+        snprintf(reason, sizeof(reason), "tpasscount:%x", tracepoint->number);
+        stop(set, reason);
+    }
+}
+
+void tracepoint_collect(tracepoint_set set, uint32_t address,
+                        agent_context context) {
+    struct agent_context collecting;
+    struct tracepoint *tracepoint;
+    uint64_t value;
+    int i;
+
+    if (!set->running || !address_map_test(set->addresses, address))
+        return;
+    collecting = *context;
+    tracepoint_bind_variables(set, &collecting);
+    collecting.collect_memory = collect_memory;
+    collecting.collect_variable = collect_variable;
+    set->mem = context->mem;
+    for (i=0; (i<set->count) && set->running; i++) {
+        tracepoint = &set->tracepoints[i];
+        if ((tracepoint->address != address) || !tracepoint->enabled)
+            continue;
+        if (tracepoint->condition &&
+            ((agent_expr_eval(tracepoint->condition, &collecting, &value)
+              == -1) || !value))
+            continue;
+        hit(set, tracepoint, &collecting);
+    }
+}
+
+void tracepoint_status(tracepoint_set set, char *buffer) {
+    sprintf(buffer, "T%d;%s;tframes:%x;tcreated:%x;tfree:%lx;tsize:%lx;"
+            "circular:0;disconn:0", set->running, set->stop_reason,
+            set->frame_count, set->created_frames,
+            (unsigned long) (set->max_size - set->used),
+            (unsigned long) set->max_size);
+}
+
+int tracepoint_usage(tracepoint_set set, int number, uint32_t address,
+                     uint64_t *hits, uint64_t *size) {
+    struct tracepoint *tracepoint = find(set, number, address);
+
+    if (tracepoint == NULL)
+        return -1;
+    *hits = tracepoint->hits;
+    *size = tracepoint->usage;
+    return 0;
+}
+
+int tracepoint_frame_count(tracepoint_set set) {
+    return set->frame_count;
+}
+
+int tracepoint_frame_info(tracepoint_set set, int frame, int *number,
+                          uint32_t *address) {
+    if ((frame < 0) || (frame >= set->frame_count))
+        return -1;
+    *number = set->frames[frame].tracepoint->number;
+    *address = set->frames[frame].tracepoint->address;
+    return 0;
+}
+
+/* Walks the blocks of frame, calls visit on each of them until it returns
+ * a non zero value, which is then returned */
+static int walk_frame(tracepoint_set set, int frame,
+                      int (*visit)(uint8_t kind, uint8_t *data, void *arg),
+                      void *arg) {
+    uint8_t *position, *end;
+    uint32_t header[2];
+    int result;
+
+    if ((frame < 0) || (frame >= set->frame_count))
+        return 0;
+    position = set->buffer + set->frames[frame].offset;
+    end = position + set->frames[frame].size;
+    while (position < end) {
+        result = visit(*position, position+1, arg);
+        if (result)
+            return result;
+        switch (*position++) {
+          case 'R':
+            position += FRAME_REGISTERS * sizeof(uint32_t);
+            break;
+          case 'M':
+            memcpy(header, position, sizeof(header));
+            position += sizeof(header) + header[1];
+            break;
+          case 'V':
+            position += sizeof(int32_t) + sizeof(int64_t);
+            break;
+        }
+    }
+    return 0;
+}
+
+static int copy_registers(uint8_t kind, uint8_t *data, void *registers) {
+    if (kind != 'R')
+        return 0;
+    memcpy(registers, data, FRAME_REGISTERS * sizeof(uint32_t));
+    return 1;
+}
+
+int tracepoint_frame_registers(tracepoint_set set, int frame,
+                               uint32_t *registers) {
+    return walk_frame(set, frame, copy_registers, registers) ? 0 : -1;
+}
+
+struct memory_request {
+    uint32_t address;
+    size_t size;
+    uint8_t *buffer;
+};
+
+static int copy_memory(uint8_t kind, uint8_t *data, void *arg) {
+    struct memory_request *request = arg;
+    uint32_t header[2];
+    size_t available;
+
+    if (kind != 'M')
+        return 0;
+    memcpy(header, data, sizeof(header));
+    if ((request->address < header[0]) ||
+        (request->address - header[0] >= header[1]))
+        return 0;
+    available = header[1] - (request->address - header[0]);
+    if (available > request->size)
+        available = request->size;
+    memcpy(request->buffer, data + sizeof(header) + request->address -
+           header[0], available);
+    return available;
+}
+
+size_t tracepoint_frame_memory(tracepoint_set set, int frame,
+                               uint32_t address, size_t size,
+                               uint8_t *buffer) {
+    struct memory_request request = { address, size, buffer };
+
+    if (size == 0)
+        return 0;
+    return walk_frame(set, frame, copy_memory, &request);
+}
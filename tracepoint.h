@@ -0,0 +1,92 @@
+/*
+Armator - simulateur de jeu d'instruction ARMv5T  but pdagogique
+Copyright (C) 2011 Guillaume Huard
+Ce programme est libre, vous pouvez le redistribuer et/ou le modifier selon les
+termes de la Licence Publique Gnrale GNU publie par la Free Software
+Foundation (version 2 ou bien toute autre version ultrieure choisie par vous).
+
+Ce programme est distribu car potentiellement utile, mais SANS AUCUNE
+GARANTIE, ni explicite ni implicite, y compris les garanties de
+commercialisation ou d'adaptation dans un but spcifique. Reportez-vous  la
+Licence Publique Gnrale GNU pour plus de dtails.
+
+Vous devez avoir reu une copie de la Licence Publique Gnrale GNU en mme
+temps que ce programme ; si ce n'est pas le cas, crivez  la Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+tats-Unis.
+
+Contact: Guillaume.Huard@imag.fr
+	 Btiment IMAG
+	 700 avenue centrale, domaine universitaire
+	 38401 Saint Martin d'Hres
+*/
+#ifndef __TRACEPOINT_H__
+#define __TRACEPOINT_H__
+#include <stdint.h>
+#include <sys/types.h>
+#include "agent_expr.h"
+
+/* Tracepoints defined by gdb (QTDP packets). While tracing runs, each hit of
+ * an enabled tracepoint whose condition holds records a frame with the
+ * requested registers, memory ranges and trace state variables into an
+ * in-memory buffer, without stopping the execution. gdb then selects frames
+ * (QTFrame) and reads their content with the usual register and memory
+ * requests.
+ */
+typedef struct tracepoint_set_data *tracepoint_set;
+
+tracepoint_set tracepoint_set_create(size_t memory_size);
+void tracepoint_set_destroy(tracepoint_set set);
+
+/* Removes all tracepoints, trace state variables and frames (QTinit) */
+void tracepoint_clear(tracepoint_set set);
+/* Adds a tracepoint or actions to an existing one from a QTDP definition
+ * (the text following "QTDP:"). Returns 0 on success, -1 if the definition
+ * is invalid.
+ */
+int tracepoint_define(tracepoint_set set, const char *definition);
+/* Adds a trace state variable from a QTDV definition, returns 0 or -1 */
+int tracepoint_define_variable(tracepoint_set set, const char *definition);
+/* Enables or disables (QTEnable/QTDisable) a tracepoint, returns 0 or -1 */
+int tracepoint_enable(tracepoint_set set, int number, uint32_t address,
+                      int enabled);
+/* Sets the maximum size of the frames buffer, -1 for the default one */
+void tracepoint_set_buffer_size(tracepoint_set set, long size);
+
+/* Starting discards the frames of the previous run */
+void tracepoint_start(tracepoint_set set);
+void tracepoint_stop(tracepoint_set set);
+int tracepoint_running(tracepoint_set set);
+/* Called before the execution of the instruction at address, while tracing
+ * runs. context gives access to the target state.
+ */
+void tracepoint_collect(tracepoint_set set, uint32_t address,
+                        agent_context context);
+
+/* Makes expressions evaluated in context use the trace state variables */
+void tracepoint_bind_variables(tracepoint_set set, agent_context context);
+/* Current value of a trace state variable, returns 0 or -1 if unknown */
+int tracepoint_variable(tracepoint_set set, int number, int64_t *value);
+
+/* Writes in buffer the state of tracing as a qTStatus reply */
+void tracepoint_status(tracepoint_set set, char *buffer);
+/* Number of hits of a tracepoint and size of its frames (qTP) */
+int tracepoint_usage(tracepoint_set set, int number, uint32_t address,
+                     uint64_t *hits, uint64_t *size);
+
+int tracepoint_frame_count(tracepoint_set set);
+/* Tracepoint number and address of a frame, returns 0 or -1 */
+int tracepoint_frame_info(tracepoint_set set, int frame, int *number,
+                          uint32_t *address);
+/* Copies the registers collected in frame (r0..r15 then cpsr, as seen by
+ * gdb). Returns 0 or -1 if the frame has no registers.
+ */
+int tracepoint_frame_registers(tracepoint_set set, int frame,
+                               uint32_t *registers);
+/* Copies at most size bytes collected in frame starting at address. Returns
+ * the number of bytes available, 0 if address has not been collected.
+ */
+size_t tracepoint_frame_memory(tracepoint_set set, int frame,
+                               uint32_t address, size_t size,
+                               uint8_t *buffer);
+#endif